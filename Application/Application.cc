@@ -85,8 +85,10 @@ void Application::newFrame() {
 }
 void Application::endFrame() {
     ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-    glfwSwapBuffers(window);
+    // a skipped frame leaves the last one on screen
+    if (ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData(), !dirty))
+        glfwSwapBuffers(window);
+    dirty = false;
 }
 
 void Application::show() { glfwShowWindow(window); }
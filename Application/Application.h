@@ -9,11 +9,16 @@
 class Application {
 protected:
     struct GLFWwindow * window = nullptr;
+    bool dirty = true;
     Application(const char * title = nullptr, int interval = 1, int width = 960, int height = 720);
     ~Application();
     void newFrame();
+    // presents the frame unless the gui is the same as in the last one
     void endFrame();
 public:
+    // the next frame is presented even if the gui did not change, for
+    // textures drawn into behind its back
+    void markDirty() { dirty = true; }
     void bindContext();
     void unbindContext();
     void show();
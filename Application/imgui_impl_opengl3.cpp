@@ -11,6 +11,7 @@
 
 // CHANGELOG
 // (minor and older changes stripped away, please see git history for details)
+//  2026-10-19: OpenGL: Stream vertices and indices through ring buffers with a single mapped upload per frame. RenderDrawData() can skip frames whose draw data is unchanged.
 //  2019-02-11: OpenGL: Projecting clipping rectangles correctly using draw_data->FramebufferScale to allow multi-viewports for retina display.
 //  2019-02-01: OpenGL: Using GLSL 410 shaders for any version over 410 (e.g. 430, 450).
 //  2018-11-30: Misc: Setting up io.BackendRendererName so it can be displayed in the About Window.
@@ -58,6 +59,7 @@
 #include "imgui.h"
 #include "imgui_impl_opengl3.h"
 #include <stdio.h>
+#include <string.h>     // memcpy
 #if defined(_MSC_VER) && _MSC_VER <= 1500 // MSVC 2008 or earlier
 #include <stddef.h>     // intptr_t
 #else
@@ -100,6 +102,15 @@ static int          g_AttribLocationTex = 0, g_AttribLocationProjMtx = 0;
 static int          g_AttribLocationPosition = 0, g_AttribLocationUV = 0, g_AttribLocationColor = 0;
 static unsigned int g_VboHandle = 0, g_ElementsHandle = 0;
 
+// Vertices and indices of a frame are appended to a ring buffer with one unsynchronized map each. When the ring wraps
+// the buffer is orphaned, so draws still in flight keep their old storage and the map never waits for the GPU.
+struct ImGui_ImplOpenGL3_Ring
+{
+    GLsizeiptr  Size, Offset;
+};
+static ImGui_ImplOpenGL3_Ring g_VboRing = { 0, 0 }, g_ElementsRing = { 0, 0 };
+static ImU64        g_LastDrawDataHash = 0;
+
 // Functions
 bool    ImGui_ImplOpenGL3_Init(const char* glsl_version)
 {
@@ -132,16 +143,111 @@ void    ImGui_ImplOpenGL3_NewFrame()
         ImGui_ImplOpenGL3_CreateDeviceObjects();
 }
 
+static void ImGui_ImplOpenGL3_CopyDrawLists(ImDrawData* draw_data, bool vertices, GLenum target, GLsizeiptr offset, char* dst)
+{
+    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    {
+        const ImDrawList* cmd_list = draw_data->CmdLists[n];
+        const void* src = vertices ? (const void*)cmd_list->VtxBuffer.Data : (const void*)cmd_list->IdxBuffer.Data;
+        const GLsizeiptr size = vertices ? (GLsizeiptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert) : (GLsizeiptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx);
+        if (dst)
+            memcpy(dst + offset, src, (size_t)size);
+        else
+            glBufferSubData(target, offset, size, src);
+        offset += size;
+    }
+}
+
+// Writes all vertices (or indices) of the frame to the buffer bound at 'target', returns the byte offset they start at
+static GLsizeiptr ImGui_ImplOpenGL3_RingUpload(ImGui_ImplOpenGL3_Ring& ring, GLenum target, ImDrawData* draw_data, bool vertices)
+{
+    const GLsizeiptr align = vertices ? sizeof(ImDrawVert) : sizeof(ImDrawIdx);
+    const GLsizeiptr size = vertices ? (GLsizeiptr)draw_data->TotalVtxCount * sizeof(ImDrawVert) : (GLsizeiptr)draw_data->TotalIdxCount * sizeof(ImDrawIdx);
+    GLsizeiptr offset = (ring.Offset + align - 1) / align * align;
+    if (size == 0)
+        return offset;
+    if (offset + size > ring.Size)
+    {
+        // Room for a few frames of this size
+        if (size > ring.Size / 4)
+        {
+            const GLsizeiptr want = size * 4 > ((GLsizeiptr)1 << 20) ? size * 4 : ((GLsizeiptr)1 << 20);
+            ring.Size = ring.Size * 2 > want ? ring.Size * 2 : want;
+        }
+        glBufferData(target, ring.Size, NULL, GL_STREAM_DRAW);
+        offset = 0;
+    }
+    char* dst = (char*)glMapBufferRange(target, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    bool stored = false;
+    if (dst)
+    {
+        ImGui_ImplOpenGL3_CopyDrawLists(draw_data, vertices, target, 0, dst);
+        stored = glUnmapBuffer(target) == GL_TRUE;
+    }
+    // A failed map, or a store lost while mapped, falls back to a plain copy
+    if (!stored)
+        ImGui_ImplOpenGL3_CopyDrawLists(draw_data, vertices, target, offset, NULL);
+    ring.Offset = offset + size;
+    return offset;
+}
+
+static ImU64 ImGui_ImplOpenGL3_Hash(ImU64 h, const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for (; size >= 8; p += 8, size -= 8)
+    {
+        ImU64 w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 32;
+    }
+    for (; size > 0; p++, size--)
+        h = (h ^ *p) * 0x100000001B3ULL;
+    return h;
+}
+
+// Everything the frame's pixels depend on, except the contents of user textures. Frames with callbacks never match.
+static ImU64 ImGui_ImplOpenGL3_HashDrawData(ImDrawData* draw_data)
+{
+    const float view[6] = { draw_data->DisplayPos.x, draw_data->DisplayPos.y, draw_data->DisplaySize.x, draw_data->DisplaySize.y, draw_data->FramebufferScale.x, draw_data->FramebufferScale.y };
+    ImU64 h = ImGui_ImplOpenGL3_Hash(0xCBF29CE484222325ULL, view, sizeof(view));
+    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    {
+        const ImDrawList* cmd_list = draw_data->CmdLists[n];
+        h = ImGui_ImplOpenGL3_Hash(h, cmd_list->VtxBuffer.Data, (size_t)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+        h = ImGui_ImplOpenGL3_Hash(h, cmd_list->IdxBuffer.Data, (size_t)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+        for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
+        {
+            const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
+            if (pcmd->UserCallback)
+                return 0;
+            const ImU64 texture = (ImU64)(intptr_t)pcmd->TextureId;
+            h = ImGui_ImplOpenGL3_Hash(h, &pcmd->ElemCount, sizeof(pcmd->ElemCount));
+            h = ImGui_ImplOpenGL3_Hash(h, &pcmd->ClipRect, sizeof(pcmd->ClipRect));
+            h = ImGui_ImplOpenGL3_Hash(h, &texture, sizeof(texture));
+        }
+    }
+    return h ? h : 1;
+}
+
 // OpenGL3 Render function.
 // (this used to be set in io.RenderDrawListsFn and called by ImGui::Render(), but you can now call this directly from your main loop)
 // Note that this implementation is little overcomplicated because we are saving/setting up/restoring every OpenGL state explicitly, in order to be able to run within any OpenGL engine that doesn't do so.
-void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
+// With 'skip_unchanged' a frame identical to the previous one is not rendered, the caller can keep the last one on screen.
+// Returns whether anything was rendered.
+bool    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data, bool skip_unchanged)
 {
     // Avoid rendering when minimized, scale coordinates for retina displays (screen coordinates != framebuffer coordinates)
     int fb_width = (int)(draw_data->DisplaySize.x * draw_data->FramebufferScale.x);
     int fb_height = (int)(draw_data->DisplaySize.y * draw_data->FramebufferScale.y);
     if (fb_width <= 0 || fb_height <= 0)
-        return;
+        return false;
+
+    const ImU64 hash = ImGui_ImplOpenGL3_HashDrawData(draw_data);
+    const bool unchanged = hash != 0 && hash == g_LastDrawDataHash;
+    g_LastDrawDataHash = hash;
+    if (skip_unchanged && unchanged)
+        return false;
 
     // Backup GL state
     GLenum last_active_texture; glGetIntegerv(GL_ACTIVE_TEXTURE, (GLint*)&last_active_texture);
@@ -212,6 +318,9 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
     glGenVertexArrays(1, &vao_handle);
     glBindVertexArray(vao_handle);
     glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ElementsHandle);
+    const GLsizeiptr vtx_buffer_offset = ImGui_ImplOpenGL3_RingUpload(g_VboRing, GL_ARRAY_BUFFER, draw_data, true);
+    size_t idx_buffer_offset = (size_t)ImGui_ImplOpenGL3_RingUpload(g_ElementsRing, GL_ELEMENT_ARRAY_BUFFER, draw_data, false);
     glEnableVertexAttribArray(g_AttribLocationPosition);
     glEnableVertexAttribArray(g_AttribLocationUV);
     glEnableVertexAttribArray(g_AttribLocationColor);
@@ -224,16 +333,17 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
     ImVec2 clip_scale = draw_data->FramebufferScale; // (1,1) unless using retina display which are often (2,2)
 
     // Render command lists
+    GLint vtx_base = (GLint)(vtx_buffer_offset / (GLsizeiptr)sizeof(ImDrawVert));
     for (int n = 0; n < draw_data->CmdListsCount; n++)
     {
         const ImDrawList* cmd_list = draw_data->CmdLists[n];
-        size_t idx_buffer_offset = 0;
-
-        glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
-        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), (const GLvoid*)cmd_list->VtxBuffer.Data, GL_STREAM_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ElementsHandle);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), (const GLvoid*)cmd_list->IdxBuffer.Data, GL_STREAM_DRAW);
+#ifdef USE_GL_ES3
+        // No base vertex before ES 3.2, the attributes point at this list's vertices instead
+        const size_t vtx_list_offset = (size_t)vtx_base * sizeof(ImDrawVert);
+        glVertexAttribPointer(g_AttribLocationPosition, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)(vtx_list_offset + IM_OFFSETOF(ImDrawVert, pos)));
+        glVertexAttribPointer(g_AttribLocationUV, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)(vtx_list_offset + IM_OFFSETOF(ImDrawVert, uv)));
+        glVertexAttribPointer(g_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)(vtx_list_offset + IM_OFFSETOF(ImDrawVert, col)));
+#endif
 
         for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
         {
@@ -262,11 +372,16 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
 
                     // Bind texture, Draw
                     glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
+#ifdef USE_GL_ES3
                     glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)idx_buffer_offset);
+#else
+                    glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)idx_buffer_offset, vtx_base);
+#endif
                 }
             }
             idx_buffer_offset += pcmd->ElemCount * sizeof(ImDrawIdx);
         }
+        vtx_base += cmd_list->VtxBuffer.Size;
     }
     glDeleteVertexArrays(1, &vao_handle);
 
@@ -290,6 +405,7 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
 #endif
     glViewport(last_viewport[0], last_viewport[1], (GLsizei)last_viewport[2], (GLsizei)last_viewport[3]);
     glScissor(last_scissor_box[0], last_scissor_box[1], (GLsizei)last_scissor_box[2], (GLsizei)last_scissor_box[3]);
+    return true;
 }
 
 bool ImGui_ImplOpenGL3_CreateFontsTexture()
@@ -546,6 +662,8 @@ void    ImGui_ImplOpenGL3_DestroyDeviceObjects()
     if (g_VboHandle) glDeleteBuffers(1, &g_VboHandle);
     if (g_ElementsHandle) glDeleteBuffers(1, &g_ElementsHandle);
     g_VboHandle = g_ElementsHandle = 0;
+    g_VboRing.Size = g_VboRing.Offset = g_ElementsRing.Size = g_ElementsRing.Offset = 0;
+    g_LastDrawDataHash = 0;
 
     if (g_ShaderHandle && g_VertHandle) glDetachShader(g_ShaderHandle, g_VertHandle);
     if (g_VertHandle) glDeleteShader(g_VertHandle);
@@ -0,0 +1,198 @@
+#include "threedbg.h"
+#include "widgets.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// headless timings of the ingestion, upload, draw and snapshot paths, printed
+// as json so runs can be compared across versions. runs on any gl 3.3
+// context, e.g. mesa's llvmpipe with LIBGL_ALWAYS_SOFTWARE=1 under xvfb.
+//
+//   threedbg-bench [--max-points n] [--out file.json]
+
+typedef std::chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+struct Results {
+    std::string json;
+    void add(const char * name, size_t n, const char * unit, double value) {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%s\n    {\"name\": \"%s\", \"n\": %zu, \"unit\": \"%s\", \"value\": %.6g}",
+                 json.empty() ? "" : ",", name, n, unit, value);
+        json += buf;
+        fprintf(stderr, "%-28s %10zu %12.4g %s\n", name, n, value, unit);
+    }
+};
+
+static void cloud(size_t n, std::vector<glm::fvec3> & pos, std::vector<glm::fvec3> & col) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> u(-1, 1);
+    pos.resize(n);
+    col.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        pos[i] = glm::fvec3(u(rng), u(rng), u(rng));
+        col[i] = pos[i] * 0.5f + 0.5f;
+    }
+}
+
+static void ingestion(Results & r, size_t n) {
+    std::vector<glm::fvec3> pos, col;
+    cloud(n, pos, col);
+    {
+        PointsDrawerFactory f;
+        auto t = Clock::now();
+        for (size_t i = 0; i < n; i++) f.addPoint(pos[i], col[i]);
+        r.add("addPoint", n, "Mpoints/s", n / msSince(t) * 1e-3);
+    }
+    {
+        PointsDrawerFactory f;
+        const size_t batch = 4096;
+        auto t = Clock::now();
+        for (size_t i = 0; i < n; i += batch)
+            f.addPoints(std::min(batch, n - i), &pos[i], &col[i]);
+        r.add("addPoints", n, "Mpoints/s", n / msSince(t) * 1e-3);
+    }
+}
+
+// time of the call only, the upload happens at the next flush
+static void publish(Results & r) {
+    const int calls = 2000;
+    std::vector<std::unique_ptr<PointsDrawerFactory>> fs;
+    for (int i = 0; i < calls; i++) {
+        fs.push_back(std::make_unique<PointsDrawerFactory>());
+        for (int k = 0; k < 1000; k++) fs.back()->addPoint(glm::fvec3(k * 1e-3f), glm::fvec3(1));
+    }
+    std::vector<double> us;
+    for (auto & f : fs) {
+        auto t = Clock::now();
+        threedbg::addDrawerFactory("publish", std::move(f));
+        us.push_back(msSince(t) * 1e3);
+    }
+    r.add("addDrawerFactory p50", calls, "us", percentile(us, 0.5));
+    r.add("addDrawerFactory p99", calls, "us", percentile(us, 0.99));
+    threedbg::setInvisible({ "publish" });
+}
+
+// uploads through a snapshot, then reads the profiling numbers
+static void uploadAndDraw(Results & r, size_t n, bool lines) {
+    std::vector<glm::fvec3> pos, col;
+    cloud(n, pos, col);
+    std::unique_ptr<DrawerFactory> df;
+    if (lines) {
+        auto f = std::make_unique<LinesDrawerFactory>();
+        f->pos = std::move(pos); f->col = std::move(col);
+        f->vertexNumber = n;
+        df = std::move(f);
+    } else {
+        auto f = std::make_unique<PointsDrawerFactory>();
+        f->pos = std::move(pos); f->col = std::move(col);
+        f->particleNumber = n;
+        f->particleRadius = 0.01f;
+        df = std::move(f);
+    }
+    const std::string name = lines ? "lines" : "points";
+    threedbg::setInvisible({ "publish", lines ? "points" : "lines" });
+    threedbg::addDrawerFactory(name, std::move(df));
+    int w, h;
+    std::vector<unsigned char> pixels;
+    // the gpu times arrive a few frames late
+    for (int i = 0; i < 8; i++) threedbg::snapshot(w, h, pixels);
+    threedbg::DrawerStats s = threedbg::drawerStats()[name];
+    const double gb = s.uploadBytes * 1e-9;
+    r.add(lines ? "createLineDrawer cpu" : "createPointDrawer cpu", n, "GB/s", s.uploadCpuMs > 0 ? gb / (s.uploadCpuMs * 1e-3) : 0);
+    r.add(lines ? "createLineDrawer gpu" : "createPointDrawer gpu", n, "GB/s", s.uploadGpuMs > 0 ? gb / (s.uploadGpuMs * 1e-3) : 0);
+    r.add(lines ? "draw lines gpu" : "draw points gpu", n, "ms", s.gpuMs);
+    r.add(lines ? "draw lines cpu" : "draw points cpu", n, "ms", s.cpuMs);
+}
+
+static void snapshots(Results & r) {
+    const int sizes[][2] = { { 256, 256 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+    const glm::ivec2 keep = threedbg::camera().resolution;
+    for (auto & s : sizes) {
+        threedbg::camera().resolution = glm::ivec2(s[0], s[1]);
+        int w, h;
+        std::vector<unsigned char> pixels;
+        threedbg::snapshot(w, h, pixels); // framebuffer allocation
+        std::vector<double> ms;
+        for (int i = 0; i < 10; i++) {
+            auto t = Clock::now();
+            threedbg::snapshot(w, h, pixels);
+            ms.push_back(msSince(t));
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "snapshot %dx%d", s[0], s[1]);
+        r.add(name, (size_t)s[0] * s[1], "ms", percentile(ms, 0.5));
+    }
+    threedbg::camera().resolution = keep;
+}
+
+static void barriers(Results & r) {
+    const size_t n = 1000000;
+    ExecuteManager em;
+    auto t = Clock::now();
+    for (size_t i = 0; i < n; i++) em.barrier();
+    r.add("ExecuteManager::barrier", n, "ns", msSince(t) * 1e6 / n);
+    t = Clock::now();
+    for (size_t i = 0; i < n; i++) threedbg::working();
+    r.add("working", n, "ns", msSince(t) * 1e6 / n);
+}
+
+int main(int argc, char ** argv) {
+    size_t maxPoints = 10000000;
+    std::string out;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--max-points") && i + 1 < argc) maxPoints = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) out = argv[++i];
+        else {
+            fprintf(stderr, "usage: threedbg-bench [--max-points n] [--out file.json]\n");
+            return 1;
+        }
+    }
+    threedbg::showGui = false;
+    threedbg::viewer.clear();
+    threedbg::stream.clear();
+    threedbg::init();
+    threedbg::setProfiling(true);
+    Results r;
+    ingestion(r, std::min<size_t>(maxPoints, 10000000));
+    publish(r);
+    for (size_t n = 1000; n <= maxPoints; n *= 10) uploadAndDraw(r, n, false);
+    for (size_t n = 1000; n <= maxPoints; n *= 10) uploadAndDraw(r, n, true);
+    // a mid-sized scene for the snapshots
+    auto f = std::make_unique<PointsDrawerFactory>();
+    cloud(100000, f->pos, f->col);
+    f->particleNumber = f->pos.size();
+    f->particleRadius = 0.01f;
+    threedbg::addDrawerFactory("points", std::move(f));
+    threedbg::setInvisible({ "publish", "lines" });
+    snapshots(r);
+    barriers(r);
+    threedbg::free(true);
+
+    const std::string json = "{\n  \"threads\": " + std::to_string(std::thread::hardware_concurrency()) +
+                             ",\n  \"results\": [" + r.json + "\n  ]\n}\n";
+    FILE * fp = out.empty() ? stdout : fopen(out.c_str(), "w");
+    if (!fp) {
+        fprintf(stderr, "cannot open %s for writing\n", out.c_str());
+        return 1;
+    }
+    fputs(json.c_str(), fp);
+    if (fp != stdout) fclose(fp);
+    return 0;
+}
@@ -0,0 +1,527 @@
+#include "capture.h"
+#include "codec.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace capture;
+
+static const char fileMagic[8] = "3DBGCAP";
+static const char indexMagic[8] = "3DBGIDX";
+
+// record header with the size patched in once the body is known
+static void beginRecord(ScatterBuffer & b, uint32_t tag, uint32_t flags = 0) {
+    b.put(tag);
+    b.put(flags);
+    b.put((uint64_t)0);
+}
+static void endRecord(ScatterBuffer & b) {
+    b.align(16);
+    b.patch(8, (uint64_t)b.total);
+}
+
+CaptureWriter::CaptureWriter(const std::string & path, const CaptureOptions & o) : opt(o) {
+    fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        fprintf(stderr, "capture: cannot open %s for writing\n", path.c_str());
+        return;
+    }
+    setvbuf(fp, nullptr, _IOFBF, 1 << 20);
+    ScatterBuffer b;
+    b.put(fileMagic, 8);
+    b.put(VERSION);
+    b.put((uint32_t)0);
+    write(b);
+    current.index = 0;
+    if (opt.threads <= 0) {
+        opt.threads = std::thread::hardware_concurrency() / 4;
+        if (opt.threads < 1) opt.threads = 1;
+        if (opt.threads > 4) opt.threads = 4;
+    }
+    // the writer thread takes part in the encoding loops
+    if (opt.compress) pool = std::make_unique<TaskPool>(opt.threads - 1);
+    if (opt.keyInterval < 1) opt.keyInterval = 1;
+    start = std::chrono::steady_clock::now();
+    writer = std::thread([this] { work(); });
+}
+
+CaptureWriter::~CaptureWriter() {
+    if (!fp) return;
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        if (!current.factories.empty()) {
+            // submissions after the last step still belong in the log
+            current.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            current.bytes = 0;
+            queue.push_back(std::move(current));
+        }
+        stopping = true;
+    }
+    cv.notify_all();
+    writer.join();
+
+    ScatterBuffer b;
+    beginRecord(b, TAG_INDX);
+    b.put((uint64_t)index.size());
+    b.put(index.data(), index.size() * sizeof(uint64_t));
+    endRecord(b);
+    uint64_t at = pos;
+    write(b);
+    ScatterBuffer t;
+    t.put(at);
+    t.put((uint64_t)index.size());
+    t.put(indexMagic, 8);
+    write(t);
+    fclose(fp);
+}
+
+void CaptureWriter::add(const std::string & name, std::shared_ptr<DrawerFactory> df) {
+    std::unique_lock<std::mutex> lk(mtx);
+    current.factories.emplace_back(name, std::move(df));
+}
+
+void CaptureWriter::endFrame(const Camera & cam, const std::vector<std::string> & invisible) {
+    std::unique_lock<std::mutex> lk(mtx);
+    current.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    current.cam = cam;
+    current.invisible = invisible;
+    current.bytes = 0;
+    for (auto & f : current.factories) {
+        FactoryView v;
+        if (f.second->view(v))
+            for (auto & s : v.streams) current.bytes += s.bytes;
+    }
+    // the factories stay alive until written, bound how much that may be
+    while (pendingBytes > 0 && pendingBytes + current.bytes > opt.maxPending) cv.wait(lk);
+    pendingBytes += current.bytes;
+    uint64_t next = current.index + 1;
+    queue.push_back(std::move(current));
+    current = Frame();
+    current.index = next;
+    current.cam = cam;
+    current.invisible = invisible;
+    lk.unlock();
+    cv.notify_all();
+}
+
+size_t CaptureWriter::framesWritten() {
+    std::unique_lock<std::mutex> lk(mtx);
+    return index.size();
+}
+
+void CaptureWriter::work() {
+    while (true) {
+        Frame f;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            while (queue.empty() && !stopping) cv.wait(lk);
+            if (queue.empty()) break;
+            f = std::move(queue.front());
+            queue.pop_front();
+        }
+        writeFrame(f);
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            pendingBytes -= f.bytes;
+        }
+        cv.notify_all();
+    }
+    fflush(fp);
+}
+
+bool CaptureWriter::write(const ScatterBuffer & b) {
+    bool ok = true;
+    for (auto & p : b.pieces)
+        ok = ok && fwrite(b.data(p), 1, p.size, fp) == p.size;
+    pos += b.total;
+    return ok;
+}
+
+void CaptureWriter::writeFrame(Frame & f) {
+    if (opt.compress) writeCompressed(f);
+    else for (auto & nf : f.factories) {
+        FactoryView v;
+        if (!nf.second->view(v)) {
+            if (live.find(nf.first) == live.end())
+                fprintf(stderr, "capture: drawer '%s' cannot be serialized, skipped\n", nf.first.c_str());
+            continue;
+        }
+        ScatterBuffer b;
+        beginRecord(b, TAG_FACT);
+        putFactory(b, nf.first, v);
+        endRecord(b);
+        uint64_t at = pos;
+        if (write(b)) live[nf.first] = at;
+        nf.second.reset(); // drop our reference as soon as possible
+    }
+    ScatterBuffer b;
+    beginRecord(b, TAG_FRAM);
+    b.put(f.index);
+    b.put(f.time);
+    putCamera(b, f.cam);
+    putStrings(b, f.invisible);
+    b.put((uint32_t)live.size());
+    for (auto & l : live) {
+        b.putString(l.first);
+        b.put(l.second);
+    }
+    endRecord(b);
+    uint64_t at = pos;
+    if (write(b)) {
+        std::unique_lock<std::mutex> lk(mtx);
+        index.push_back(at);
+    }
+}
+
+// all chunks of all streams of the frame are encoded in one parallel loop
+void CaptureWriter::writeCompressed(Frame & f) {
+    struct Stream {
+        const unsigned char * cur, * prev, * prev2;
+        size_t bytes;
+        int mode, stride;
+        size_t firstChunk;
+    };
+    struct Job {
+        size_t stream, chunk;
+    };
+    std::vector<FactoryView> views(f.factories.size());
+    std::vector<bool> keys(f.factories.size());
+    std::vector<Stream> streams;
+    std::vector<Job> jobs;
+    for (size_t i = 0; i < f.factories.size(); i++) {
+        auto & nf = f.factories[i];
+        if (!nf.second->view(views[i])) {
+            if (live.find(nf.first) == live.end())
+                fprintf(stderr, "capture: drawer '%s' cannot be serialized, skipped\n", nf.first.c_str());
+            nf.second.reset();
+            continue;
+        }
+        auto p = previous.find(nf.first);
+        FactoryView pv, ov;
+        bool key = p == previous.end() || p->second.sinceKey + 1 >= opt.keyInterval
+            || !p->second.df->view(pv) || pv.type != views[i].type || pv.streams.size() != views[i].streams.size();
+        bool linear = !key && p->second.older && p->second.older->view(ov) && ov.streams.size() == pv.streams.size();
+        keys[i] = key;
+        for (size_t k = 0; k < views[i].streams.size(); k++) {
+            auto & vs = views[i].streams[k];
+            Stream s{ (const unsigned char *)vs.data, nullptr, nullptr, vs.bytes, codec::MODE_INTRA, codec::stride(vs.bytes), jobs.size() };
+            if (!key && pv.streams[k].bytes == vs.bytes) {
+                s.mode = codec::MODE_DELTA;
+                s.prev = (const unsigned char *)pv.streams[k].data;
+                if (linear && ov.streams[k].bytes == vs.bytes) {
+                    s.mode = codec::MODE_LINEAR;
+                    s.prev2 = (const unsigned char *)ov.streams[k].data;
+                }
+            }
+            for (size_t c = 0; c < codec::chunks(vs.bytes); c++) jobs.push_back(Job{ streams.size(), c });
+            streams.push_back(s);
+        }
+    }
+    std::vector<std::vector<unsigned char>> encoded(jobs.size());
+    pool->parallelFor(jobs.size(), [&](size_t j) {
+        const Stream & s = streams[jobs[j].stream];
+        codec::encodeChunk(encoded[j], s.cur, s.prev, s.prev2, s.bytes, jobs[j].chunk, s.mode, s.stride);
+    });
+
+    size_t si = 0;
+    for (size_t i = 0; i < f.factories.size(); i++) {
+        auto & nf = f.factories[i];
+        if (!nf.second) continue;
+        const FactoryView & v = views[i];
+        auto p = previous.find(nf.first);
+        bool delta = false;
+        for (size_t k = 0; k < v.streams.size(); k++)
+            delta = delta || streams[si + k].mode != codec::MODE_INTRA;
+        ScatterBuffer b;
+        beginRecord(b, TAG_FACT, FLAG_COMPRESSED);
+        b.putString(nf.first);
+        b.putString(v.type);
+        b.put((uint32_t)v.params.size());
+        b.put(v.params.data(), v.params.size() * sizeof(float));
+        b.put((uint64_t)(delta ? p->second.offset : 0));
+        b.put((uint32_t)v.streams.size());
+        for (size_t k = 0; k < v.streams.size(); k++, si++) {
+            const Stream & s = streams[si];
+            const size_t n = codec::chunks(s.bytes);
+            b.put((uint64_t)s.bytes);
+            b.put((uint8_t)s.mode);
+            b.put((uint8_t)s.stride);
+            b.put((uint16_t)codec::FORMAT_PLANES);
+            b.put((uint32_t)n);
+            for (size_t c = 0; c < n; c++) b.put((uint32_t)encoded[s.firstChunk + c].size());
+            b.align(16);
+            for (size_t c = 0; c < n; c++) b.ref(encoded[s.firstChunk + c].data(), encoded[s.firstChunk + c].size());
+            b.align(16);
+        }
+        endRecord(b);
+        uint64_t at = pos;
+        if (write(b)) {
+            live[nf.first] = at;
+            // the raw factories are kept until the next two submissions of this name are coded against them
+            previous[nf.first] = Previous{ std::move(nf.second), delta ? p->second.df : nullptr, at,
+                                           keys[i] ? 0 : p->second.sinceKey + 1 };
+        }
+        nf.second.reset();
+    }
+}
+
+bool CaptureReader::open(const std::string & path) {
+    close();
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) { file = nullptr; return false; }
+    LARGE_INTEGER sz;
+    GetFileSizeEx(file, &sz);
+    length = (size_t)sz.QuadPart;
+    mapping = length ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : nullptr;
+    base = mapping ? (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    fstat(fd, &st);
+    length = st.st_size;
+    void * m = length ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    base = m == MAP_FAILED ? nullptr : (const unsigned char *)m;
+#endif
+    if (!base || length < 16 || memcmp(base, fileMagic, 8) != 0) {
+        fprintf(stderr, "capture: %s is not a capture file\n", path.c_str());
+        close();
+        return false;
+    }
+    ByteReader r(base + 8, 8);
+    if (r.get<uint32_t>() > VERSION) {
+        fprintf(stderr, "capture: %s was written by a newer version\n", path.c_str());
+        close();
+        return false;
+    }
+    if (!readIndex()) scan();
+    return true;
+}
+
+void CaptureReader::close() {
+#ifdef _WIN32
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+    mapping = file = nullptr;
+#else
+    if (base) munmap((void *)base, length);
+#endif
+    base = nullptr;
+    length = 0;
+    index.clear();
+    cache.clear();
+}
+
+bool CaptureReader::readIndex() {
+    if (length < 16 + 24 || memcmp(base + length - 8, indexMagic, 8) != 0) return false;
+    ByteReader t(base + length - 24, 16);
+    uint64_t at = t.get<uint64_t>(), n = t.get<uint64_t>();
+    if (at + 24 > length) return false;
+    ByteReader r(base + at, length - at);
+    if (r.get<uint32_t>() != TAG_INDX) return false;
+    r.get<uint32_t>();
+    r.get<uint64_t>();
+    if (r.get<uint64_t>() != n || n > r.left() / sizeof(uint64_t)) return false;
+    const uint64_t * offsets = (const uint64_t *)r.take(n * sizeof(uint64_t));
+    if (!offsets) return false;
+    index.resize(n);
+    memcpy(index.data(), offsets, n * sizeof(uint64_t));
+    return true;
+}
+
+void CaptureReader::scan() {
+    index.clear();
+    uint64_t at = 16;
+    while (at + 16 <= length) {
+        ByteReader r(base + at, 16);
+        uint32_t tag = r.get<uint32_t>();
+        r.get<uint32_t>();
+        uint64_t size = r.get<uint64_t>();
+        if (size < 16 || size % 16 || size > length - at) break; // cut off by a crash
+        if (tag == TAG_FRAM) index.push_back(at);
+        at += size;
+    }
+    fprintf(stderr, "capture: no index found, recovered %zu frames\n", index.size());
+}
+
+bool CaptureReader::frame(size_t i, Frame & f) const {
+    if (i >= index.size()) return false;
+    uint64_t at = index[i];
+    ByteReader h(base + at, length - at);
+    if (h.get<uint32_t>() != TAG_FRAM) return false;
+    h.get<uint32_t>();
+    uint64_t size = h.get<uint64_t>();
+    if (!h.ok || size > length - at) return false;
+    ByteReader r(base + at, size);
+    r.take(16);
+    f.index = r.get<uint64_t>();
+    f.time = r.get<double>();
+    f.cam = getCamera(r);
+    f.invisible = getStrings(r);
+    uint32_t n = r.get<uint32_t>();
+    f.factories.clear();
+    f.offsets.clear();
+    for (uint32_t k = 0; k < n && r.ok; k++) {
+        std::string name = r.getString();
+        uint64_t fat = r.get<uint64_t>();
+        if (!r.ok || fat + 16 > length) return false;
+        f.offsets.push_back(fat);
+        FactoryView v;
+        if (!factory(fat, v)) return false;
+        f.factories.emplace_back(name, std::move(v));
+    }
+    // the next frame's linear predictions also read the references of this one
+    std::vector<uint64_t> keep = f.offsets;
+    for (uint64_t o : f.offsets) {
+        ByteReader rr(base, 0);
+        uint64_t refAt;
+        if (compressedHeader(o, rr, refAt) && refAt) keep.push_back(refAt);
+    }
+    for (auto it = cache.begin(); it != cache.end();) {
+        if (std::find(keep.begin(), keep.end(), it->first) == keep.end()) it = cache.erase(it);
+        else ++it;
+    }
+    return r.ok;
+}
+
+double CaptureReader::time(size_t i) const {
+    if (i >= index.size() || index[i] + 32 > length) return -1;
+    ByteReader r(base + index[i], 32);
+    if (r.get<uint32_t>() != TAG_FRAM) return -1;
+    r.take(12);
+    r.get<uint64_t>();
+    return r.get<double>();
+}
+
+bool CaptureReader::factory(uint64_t at, FactoryView & v) const {
+    if (at + 16 > length) return false;
+    ByteReader h(base + at, 16);
+    if (h.get<uint32_t>() != TAG_FACT) return false;
+    uint32_t flags = h.get<uint32_t>();
+    uint64_t size = h.get<uint64_t>();
+    if (size > length - at) return false;
+    ByteReader r(base + at, size);
+    r.take(16);
+    std::string name;
+    if (!(flags & FLAG_COMPRESSED)) return getFactory(r, name, v);
+    name = r.getString();
+    v.type = r.getString();
+    uint32_t n = r.get<uint32_t>();
+    if (!r.ok || n > 4096 || n > r.left() / sizeof(float)) return false;
+    v.params.resize(n);
+    for (auto & p : v.params) p = r.get<float>();
+    const std::vector<std::vector<unsigned char>> * d = decode(at);
+    if (!d) return false;
+    v.streams.clear();
+    for (auto & s : *d) v.streams.push_back(FactoryView::Stream{ s.data(), s.size() });
+    return r.ok;
+}
+
+// positions r after the reference offset of the compressed FACT record at `at`
+bool CaptureReader::compressedHeader(uint64_t at, ByteReader & r, uint64_t & refAt) const {
+    if (at + 16 > length) return false;
+    ByteReader h(base + at, 16);
+    if (h.get<uint32_t>() != TAG_FACT || !(h.get<uint32_t>() & FLAG_COMPRESSED)) return false;
+    uint64_t size = h.get<uint64_t>();
+    if (size > length - at) return false;
+    r = ByteReader(base + at, size);
+    r.take(16);
+    r.getString();
+    r.getString();
+    r.take(r.get<uint32_t>() * sizeof(float));
+    refAt = r.get<uint64_t>();
+    return r.ok && refAt < at;
+}
+
+// decodes forward from the last keyframe, or from a cached record and its
+// reference, holding only the two records the next one predicts from. the
+// requested record and its reference, which the next frame reads, are cached
+const std::vector<std::vector<unsigned char>> * CaptureReader::decode(uint64_t at) const {
+    auto it = cache.find(at);
+    if (it != cache.end()) return &it->second;
+    std::vector<uint64_t> chain{ at };
+    for (;;) {
+        ByteReader r(base, 0);
+        uint64_t refAt;
+        if (!compressedHeader(chain.back(), r, refAt)) return nullptr;
+        if (!refAt) break;
+        chain.push_back(refAt);
+        if (!cache.count(refAt)) continue;
+        uint64_t ref2At;
+        if (!compressedHeader(refAt, r, ref2At)) return nullptr;
+        if (!ref2At) break;
+        if (cache.count(ref2At)) {
+            chain.push_back(ref2At);
+            break;
+        }
+    }
+    std::vector<std::vector<unsigned char>> slots[3];
+    const std::vector<std::vector<unsigned char>> * ref = nullptr, * ref2 = nullptr;
+    for (size_t j = chain.size(); j-- > 0;) {
+        const std::vector<std::vector<unsigned char>> * d;
+        auto c = cache.find(chain[j]);
+        if (c != cache.end()) d = &c->second;
+        else {
+            // the slot of the record two steps back, neither reference
+            std::vector<std::vector<unsigned char>> & out = slots[j % 3];
+            if (!decodeRecord(chain[j], ref, ref2, out)) return nullptr;
+            d = j <= 1 ? &(cache[chain[j]] = std::move(out)) : &out;
+        }
+        ref2 = ref;
+        ref = d;
+    }
+    return ref;
+}
+
+// MODE_LINEAR also reads the reference's own reference, ref2
+bool CaptureReader::decodeRecord(uint64_t at, const std::vector<std::vector<unsigned char>> * ref,
+                                 const std::vector<std::vector<unsigned char>> * ref2,
+                                 std::vector<std::vector<unsigned char>> & streams) const {
+    ByteReader r(base, 0);
+    uint64_t refAt;
+    if (!compressedHeader(at, r, refAt)) return false;
+    uint32_t n = r.get<uint32_t>();
+    if (!r.ok || n > 4096) return false;
+    streams.resize(n);
+    for (uint32_t k = 0; k < n && r.ok; k++) {
+        uint64_t bytes = r.get<uint64_t>();
+        int mode = r.get<uint8_t>(), stride = r.get<uint8_t>();
+        int format = r.get<uint16_t>();
+        uint32_t chunks = r.get<uint32_t>();
+        if (!r.ok || chunks != codec::chunks(bytes) || bytes > length * 4096 || format > codec::FORMAT_PLANES ||
+            chunks > r.left() / sizeof(uint32_t))
+            return false;
+        std::vector<uint32_t> sizes(chunks);
+        for (auto & c : sizes) c = r.get<uint32_t>();
+        r.align(16);
+        const unsigned char * prev = nullptr, * prev2 = nullptr;
+        if (mode == codec::MODE_DELTA || mode == codec::MODE_LINEAR) {
+            if (!refAt || !ref || ref->size() <= k || (*ref)[k].size() != bytes) return false;
+            prev = (*ref)[k].data();
+        }
+        if (mode == codec::MODE_LINEAR) {
+            if (!ref2 || ref2->size() <= k || (*ref2)[k].size() != bytes) return false;
+            prev2 = (*ref2)[k].data();
+        }
+        streams[k].resize(bytes);
+        for (uint32_t c = 0; c < chunks; c++) {
+            const unsigned char * enc = (const unsigned char *)r.take(sizes[c]);
+            if (!enc || !codec::decodeChunk(enc, sizes[c], streams[k].data(), prev, prev2, bytes, c, mode, stride, format))
+                return false;
+        }
+        r.align(16);
+    }
+    return r.ok;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "serialize.h"
+#include "taskpool.h"
+
+// append-only session log of every submitted factory plus the camera and
+// visibility at each step.
+//
+//   header  "3DBGCAP\0" u32 version u32 0
+//   records u32 tag u32 flags u64 size, 16-byte aligned
+//     FACT  one factory (see putFactory), or with FLAG_COMPRESSED:
+//           name type params u64 offset of the reference FACT (0 for keys)
+//           u32 n, n x stream: u64 bytes u8 mode u8 stride u16 format u32 chunks
+//           u32 size[chunks], padding, chunk data (see codec.h)
+//     FRAM  u64 index f64 time camera invisible[] and the live drawer table:
+//           u32 n, n x (name, u64 offset of its latest FACT record)
+//     INDX  u64 n, n x u64 offset of each FRAM record
+//   trailer u64 offset of INDX, u64 n, "3DBGIDX\0"
+//
+// since each frame lists where all of its drawers live, any frame can be
+// rebuilt from the mapped file without replaying earlier ones. a log cut
+// short by a crash has no trailer and is indexed by scanning the records.
+namespace capture {
+const uint32_t VERSION = 3;
+const uint32_t FLAG_COMPRESSED = 1;
+constexpr uint32_t tag(const char (&s)[5]) {
+    return (uint32_t)s[0] | (uint32_t)s[1] << 8 | (uint32_t)s[2] << 16 | (uint32_t)s[3] << 24;
+}
+const uint32_t TAG_FACT = tag("FACT"), TAG_FRAM = tag("FRAM"), TAG_INDX = tag("INDX");
+}
+
+struct CaptureOptions {
+    // delta-code each factory against its previous two submissions (codec.h),
+    // with a self-contained keyframe every keyInterval submissions
+    bool compress = false;
+    int keyInterval = 30;
+    // encoder threads including the writer's own, -1 for a quarter of the
+    // cores but 1 to 4, like the recorder: the simulation keeps the rest
+    int threads = -1;
+    size_t maxPending = (size_t)1 << 30;  // bytes queued before endFrame() waits
+};
+
+class CaptureWriter {
+public:
+    CaptureWriter(const std::string & path, const CaptureOptions & opt = CaptureOptions());
+    ~CaptureWriter(); // writes what is queued and the index
+    bool good() const { return fp != nullptr; }
+    void add(const std::string & name, std::shared_ptr<DrawerFactory> df);
+    void endFrame(const Camera & cam, const std::vector<std::string> & invisible);
+    size_t framesWritten();
+private:
+    struct Frame {
+        uint64_t index;
+        double time;
+        Camera cam;
+        std::vector<std::string> invisible;
+        std::vector<std::pair<std::string, std::shared_ptr<DrawerFactory>>> factories;
+        size_t bytes;
+    };
+    struct Previous {
+        std::shared_ptr<DrawerFactory> df; // reference for the next delta
+        std::shared_ptr<DrawerFactory> older; // df's own reference, for linear prediction
+        uint64_t offset;
+        int sinceKey;
+    };
+    FILE * fp = nullptr;
+    uint64_t pos = 0;
+    CaptureOptions opt;
+    size_t pendingBytes = 0;
+    bool stopping = false;
+    std::mutex mtx;
+    std::condition_variable cv;
+    Frame current;
+    std::deque<Frame> queue;
+    std::map<std::string, uint64_t> live;
+    std::map<std::string, Previous> previous;
+    std::vector<uint64_t> index;
+    std::unique_ptr<TaskPool> pool;
+    std::chrono::steady_clock::time_point start;
+    std::thread writer;
+
+    void work();
+    bool write(const ScatterBuffer & b);
+    void writeFrame(Frame & f);
+    void writeCompressed(Frame & f);
+};
+
+class CaptureReader {
+public:
+    struct Frame {
+        uint64_t index;
+        double time;
+        Camera cam;
+        std::vector<std::string> invisible;
+        // views point into the mapped file, or for compressed logs into a
+        // decode cache, and stay valid until the next call to frame()
+        std::vector<std::pair<std::string, FactoryView>> factories;
+        // record offset of each factory, a drawer that was not resubmitted
+        // keeps its offset from the previous frame
+        std::vector<uint64_t> offsets;
+    };
+    ~CaptureReader() { close(); }
+    bool open(const std::string & path);
+    void close();
+    size_t frames() const { return index.size(); }
+    bool frame(size_t i, Frame & f) const;
+    double time(size_t i) const; // seconds since the capture started, -1 if damaged
+    const unsigned char * data() const { return base; }
+    size_t size() const { return length; }
+private:
+    const unsigned char * base = nullptr;
+    size_t length = 0;
+    std::vector<uint64_t> index;
+    // decoded compressed factories, the ones of the last frame and their
+    // references are kept for the next one
+    mutable std::map<uint64_t, std::vector<std::vector<unsigned char>>> cache;
+    bool factory(uint64_t at, FactoryView & v) const;
+    bool compressedHeader(uint64_t at, ByteReader & r, uint64_t & refAt) const;
+    const std::vector<std::vector<unsigned char>> * decode(uint64_t at) const;
+    bool decodeRecord(uint64_t at, const std::vector<std::vector<unsigned char>> * ref,
+                      const std::vector<std::vector<unsigned char>> * ref2,
+                      std::vector<std::vector<unsigned char>> & streams) const;
+#ifdef _WIN32
+    void * file = nullptr, * mapping = nullptr;
+#endif
+    bool readIndex();
+    void scan();
+};
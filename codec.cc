@@ -0,0 +1,249 @@
+#include "codec.h"
+
+#include <string.h>
+
+namespace codec {
+
+static const size_t BLOCK = 64;
+// rans: 12-bit frequencies, 32-bit state renormalized a byte at a time
+static const int SCALE = 12;
+static const uint32_t M = 1u << SCALE, L = 1u << 23;
+
+void pack(std::vector<unsigned char> & out, const unsigned char * src, size_t n) {
+    for (size_t b = 0; b < n; b += BLOCK) {
+        const size_t m = n - b < BLOCK ? n - b : BLOCK;
+        unsigned char any = 0;
+        for (size_t i = 0; i < m; i++) any |= src[b + i];
+        int k = 0;
+        while (k < 8 && (any >> k)) k++;
+        out.push_back(k);
+        if (k == 0) continue;
+        if (k == 8) {
+            out.insert(out.end(), src + b, src + b + m);
+            continue;
+        }
+        uint64_t acc = 0;
+        int bits = 0;
+        for (size_t i = 0; i < m; i++) {
+            acc |= (uint64_t)src[b + i] << bits;
+            bits += k;
+            if (bits >= 32) {
+                for (int j = 0; j < 4; j++) out.push_back((unsigned char)(acc >> (8 * j)));
+                acc >>= 32; bits -= 32;
+            }
+        }
+        for (; bits > 0; bits -= 8, acc >>= 8) out.push_back((unsigned char)acc);
+    }
+}
+
+bool unpack(const unsigned char * & src, const unsigned char * end, unsigned char * dst, size_t n) {
+    for (size_t b = 0; b < n; b += BLOCK) {
+        const size_t m = n - b < BLOCK ? n - b : BLOCK;
+        if (src >= end) return false;
+        const int k = *src++;
+        if (k > 8) return false;
+        const size_t bytes = (m * k + 7) / 8;
+        if ((size_t)(end - src) < bytes) return false;
+        if (k == 0) {
+            memset(dst + b, 0, m);
+        } else if (k == 8) {
+            memcpy(dst + b, src, m);
+        } else {
+            const unsigned mask = (1u << k) - 1;
+            uint64_t acc = 0;
+            int bits = 0;
+            const unsigned char * s = src;
+            for (size_t i = 0; i < m; i++) {
+                while (bits < k) { acc |= (uint64_t)*s++ << bits; bits += 8; }
+                dst[b + i] = acc & mask;
+                acc >>= k; bits -= k;
+            }
+        }
+        src += bytes;
+    }
+    return true;
+}
+
+// scales the counts to frequencies summing to M, every present byte keeps at least 1
+static void normalize(const size_t count[256], size_t n, uint32_t freq[256]) {
+    uint32_t sum = 0;
+    for (int b = 0; b < 256; b++) {
+        freq[b] = count[b] ? (uint32_t)((uint64_t)count[b] * M / n) : 0;
+        if (count[b] && !freq[b]) freq[b] = 1;
+        sum += freq[b];
+    }
+    // the rounding leaves the sum a little off, the most frequent bytes absorb it
+    while (sum != M) {
+        int best = -1;
+        for (int b = 0; b < 256; b++)
+            if (freq[b] > (sum > M ? 1u : 0u) && (best < 0 || freq[b] > freq[best])) best = b;
+        if (sum < M) {
+            freq[best] += M - sum;
+            sum = M;
+        } else {
+            freq[best]--;
+            sum--;
+        }
+    }
+}
+
+// four interleaved rans states, byte i is coded by state i % 4 so the
+// dependency chains overlap. the encoder runs backwards and writes backwards,
+// the decoder reads the bytes in order starting with the final states
+void entropyEncode(std::vector<unsigned char> & out, const unsigned char * src, size_t n) {
+    size_t count[256] = {};
+    for (size_t i = 0; i < n; i++) count[src[i]]++;
+    uint32_t freq[256] = {}, cum[257] = {};
+    if (n) normalize(count, n, freq);
+    for (int b = 0; b < 256; b++) {
+        cum[b + 1] = cum[b] + freq[b];
+        // one byte per frequency below 128, two for the others
+        if (freq[b] < 128) out.push_back((unsigned char)freq[b]);
+        else {
+            out.push_back((unsigned char)(0x80 | freq[b] >> 8));
+            out.push_back((unsigned char)freq[b]);
+        }
+    }
+    // a byte renormalizes at most SCALE bits out of its state
+    std::vector<unsigned char> tmp(2 * n + 16);
+    unsigned char * const end = tmp.data() + tmp.size();
+    unsigned char * ptr = end;
+    uint32_t x[4] = { L, L, L, L };
+    for (size_t i = n; i-- > 0;) {
+        uint32_t & s = x[i & 3];
+        const uint32_t f = freq[src[i]];
+        const uint32_t limit = ((L >> SCALE) << 8) * f;
+        while (s >= limit) {
+            *--ptr = (unsigned char)s;
+            s >>= 8;
+        }
+        s = ((s / f) << SCALE) + s % f + cum[src[i]];
+    }
+    for (int k = 3; k >= 0; k--)
+        for (int j = 0; j < 4; j++, x[k] >>= 8) *--ptr = (unsigned char)x[k];
+    const uint32_t len = (uint32_t)(end - ptr);
+    for (int j = 0; j < 4; j++) out.push_back((unsigned char)(len >> (8 * j)));
+    out.insert(out.end(), ptr, end);
+}
+
+bool entropyDecode(const unsigned char * & src, const unsigned char * end, unsigned char * dst, size_t n) {
+    uint32_t freq[256], cum[257] = {};
+    for (int b = 0; b < 256; b++) {
+        if (src >= end) return false;
+        uint32_t f = *src++;
+        if (f & 0x80) {
+            if (src >= end) return false;
+            f = (f & 0x7f) << 8 | *src++;
+        }
+        freq[b] = f;
+        cum[b + 1] = cum[b] + f;
+    }
+    if (cum[256] != M || end - src < 4) return false;
+    // per slot of the state's low bits: the byte, its frequency and the
+    // slot's offset into the byte's range
+    struct Slot {
+        uint16_t freq, bias;
+        unsigned char b;
+    };
+    std::vector<Slot> slots(M);
+    for (int b = 0; b < 256; b++)
+        for (uint32_t k = 0; k < freq[b]; k++) slots[cum[b] + k] = Slot{ (uint16_t)freq[b], (uint16_t)k, (unsigned char)b };
+    const uint32_t len = src[0] | src[1] << 8 | src[2] << 16 | (uint32_t)src[3] << 24;
+    src += 4;
+    if (len < 16 || (size_t)(end - src) < len) return false;
+    const unsigned char * p = src, * e = src + len;
+    uint32_t x[4];
+    for (int k = 0; k < 4; k++, p += 4) x[k] = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+    for (size_t i = 0; i < n; i++) {
+        uint32_t & s = x[i & 3];
+        const Slot & t = slots[s & (M - 1)];
+        dst[i] = t.b;
+        s = t.freq * (s >> SCALE) + t.bias;
+        while (s < L) {
+            if (p == e) return false;
+            s = s << 8 | *p++;
+        }
+    }
+    src = e;
+    return true;
+}
+
+static inline uint32_t reference(const unsigned char * cur, const unsigned char * prev, const unsigned char * prev2,
+                                 size_t w, int mode, int stride) {
+    uint32_t r = 0;
+    if (mode == MODE_DELTA) {
+        memcpy(&r, prev + 4 * w, 4);
+    } else if (mode == MODE_LINEAR) {
+        uint32_t a, b;
+        memcpy(&a, prev + 4 * w, 4);
+        memcpy(&b, prev2 + 4 * w, 4);
+        r = 2 * a - b;
+    } else if (w >= (size_t)stride) {
+        memcpy(&r, cur + 4 * (w - stride), 4);
+    }
+    return r;
+}
+
+void encodeChunk(std::vector<unsigned char> & out, const unsigned char * cur, const unsigned char * prev,
+                 const unsigned char * prev2, size_t bytes, size_t c, int mode, int stride) {
+    const size_t begin = c * CHUNK;
+    const size_t n = (bytes - begin < CHUNK ? bytes - begin : CHUNK);
+    const size_t words = n / 4, w0 = begin / 4;
+    std::vector<unsigned char> planes(n);
+    for (size_t i = 0; i < words; i++) {
+        uint32_t v;
+        memcpy(&v, cur + 4 * (w0 + i), 4);
+        v -= reference(cur, prev, prev2, w0 + i, mode, stride);
+        v = (v << 1) ^ (uint32_t)((int32_t)v >> 31); // zigzag, small negative deltas stay small
+        for (int p = 0; p < 4; p++) planes[p * words + i] = (unsigned char)(v >> (8 * p));
+    }
+    // each plane goes out as a coding byte and the smaller of the two codings
+    std::vector<unsigned char> packed, coded;
+    for (int p = 0; p < 4; p++) {
+        const unsigned char * plane = &planes[p * words];
+        packed.clear();
+        coded.clear();
+        pack(packed, plane, words);
+        // the frequency table alone takes 256 bytes
+        if (packed.size() > 256 + 8) entropyEncode(coded, plane, words);
+        const bool entropy = !coded.empty() && coded.size() < packed.size();
+        out.push_back(entropy ? 1 : 0);
+        const std::vector<unsigned char> & e = entropy ? coded : packed;
+        out.insert(out.end(), e.begin(), e.end());
+    }
+    // a stream that is not a whole number of words keeps its tail as is
+    out.insert(out.end(), cur + begin + 4 * words, cur + begin + n);
+}
+
+bool decodeChunk(const unsigned char * enc, size_t encBytes, unsigned char * cur, const unsigned char * prev,
+                 const unsigned char * prev2, size_t bytes, size_t c, int mode, int stride, int format) {
+    const size_t begin = c * CHUNK;
+    const size_t n = (bytes - begin < CHUNK ? bytes - begin : CHUNK);
+    const size_t words = n / 4, w0 = begin / 4;
+    const unsigned char * end = enc + encBytes;
+    std::vector<unsigned char> planes(n);
+    if (format == FORMAT_PACKED) {
+        if (!unpack(enc, end, planes.data(), n)) return false;
+    } else {
+        for (int p = 0; p < 4; p++) {
+            if (enc >= end) return false;
+            const int coding = *enc++;
+            if (coding == 0 ? !unpack(enc, end, &planes[p * words], words)
+                : coding != 1 || !entropyDecode(enc, end, &planes[p * words], words))
+                return false;
+        }
+        if ((size_t)(end - enc) < n - 4 * words) return false;
+        memcpy(&planes[4 * words], enc, n - 4 * words);
+    }
+    for (size_t i = 0; i < words; i++) {
+        uint32_t v = 0;
+        for (int p = 0; p < 4; p++) v |= (uint32_t)planes[p * words + i] << (8 * p);
+        v = (v >> 1) ^ (0u - (v & 1));
+        v += reference(cur, prev, prev2, w0 + i, mode, stride);
+        memcpy(cur + 4 * (w0 + i), &v, 4);
+    }
+    memcpy(cur + begin + 4 * words, &planes[4 * words], n - 4 * words);
+    return true;
+}
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// lossless codec for float streams that change little between frames.
+// words are stored as zigzag integer differences to a reference (the same
+// stream one frame earlier, extrapolated from the two frames before, or the
+// previous element of the same stream in keyframes); for floats of similar
+// magnitude that is the distance in ulps. the words are split into byte
+// planes so the mostly-zero high bytes line up. each plane is then either
+// bit-packed per block to the width of its largest value, or entropy coded
+// (order-0 rans) when that is smaller; the latter wins on planes of small
+// but noisy differences, such as particles moving at a steady velocity.
+namespace codec {
+// MODE_LINEAR predicts 2 * prev - prev2, exact for steady motion
+enum { MODE_INTRA = 0, MODE_DELTA = 1, MODE_LINEAR = 2 };
+// chunk layouts: FORMAT_PACKED is bit-packing only (capture version 2),
+// FORMAT_PLANES chooses the coding per plane
+enum { FORMAT_PACKED = 0, FORMAT_PLANES = 1 };
+// chunks are coded independently so they can be spread over threads,
+// a multiple of 12 so vec3 elements never straddle two chunks
+const size_t CHUNK = 12 << 16;
+
+inline size_t chunks(size_t bytes) { return (bytes + CHUNK - 1) / CHUNK; }
+// element stride in 32-bit words used for intra prediction
+inline int stride(size_t bytes) { return bytes % 12 == 0 ? 3 : 1; }
+
+// chunk c of the stream `cur` of `bytes` bytes in FORMAT_PLANES. prev is the
+// previous frame's stream in MODE_DELTA and MODE_LINEAR, prev2 the one before
+// it in MODE_LINEAR (same sizes), both are ignored in MODE_INTRA
+void encodeChunk(std::vector<unsigned char> & out, const unsigned char * cur, const unsigned char * prev,
+                 const unsigned char * prev2, size_t bytes, size_t c, int mode, int stride);
+// chunks have to be decoded in order in MODE_INTRA, they read decoded words of the one before
+bool decodeChunk(const unsigned char * enc, size_t encBytes, unsigned char * cur, const unsigned char * prev,
+                 const unsigned char * prev2, size_t bytes, size_t c, int mode, int stride, int format);
+
+void pack(std::vector<unsigned char> & out, const unsigned char * src, size_t n);
+bool unpack(const unsigned char * & src, const unsigned char * end, unsigned char * dst, size_t n);
+// order-0 rans with its frequency table, about the entropy of the bytes
+void entropyEncode(std::vector<unsigned char> & out, const unsigned char * src, size_t n);
+bool entropyDecode(const unsigned char * & src, const unsigned char * end, unsigned char * dst, size_t n);
+}
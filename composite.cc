@@ -0,0 +1,180 @@
+#include "composite.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COMPOSITE_SSE2
+#endif
+
+// own connections, so numbered apart from the viewer messages; MSG_SHM is
+// still the one from remote.h
+enum : uint32_t {
+    MSG_RANK = 0x100, // i32 rank, first message of a child
+    MSG_CAMERA,       // camera, parent to children
+    MSG_IMAGE,        // i32 w h, align16, rgba, depth
+};
+
+void compositeDepth(unsigned char * color, float * depth,
+                    const unsigned char * srcColor, const float * srcDepth, size_t n) {
+    size_t i = 0;
+#ifdef COMPOSITE_SSE2
+    for (; i + 4 <= n; i += 4) {
+        __m128 d = _mm_loadu_ps(depth + i), s = _mm_loadu_ps(srcDepth + i);
+        __m128 nearer = _mm_cmplt_ps(s, d);
+        _mm_storeu_ps(depth + i, _mm_or_ps(_mm_and_ps(nearer, s), _mm_andnot_ps(nearer, d)));
+        // one rgba8 pixel per 32-bit lane, selected by the same mask
+        __m128i m = _mm_castps_si128(nearer);
+        __m128i c = _mm_loadu_si128((const __m128i *)(color + 4 * i));
+        __m128i sc = _mm_loadu_si128((const __m128i *)(srcColor + 4 * i));
+        _mm_storeu_si128((__m128i *)(color + 4 * i), _mm_or_si128(_mm_and_si128(m, sc), _mm_andnot_si128(m, c)));
+    }
+#endif
+    for (; i < n; i++) {
+        if (srcDepth[i] < depth[i]) {
+            depth[i] = srcDepth[i];
+            memcpy(color + 4 * i, srcColor + 4 * i, 4);
+        }
+    }
+}
+
+// "unix:/p" -> "unix:/p.<r>", "tcp:host:port" -> port + r
+static std::string rankAddress(const std::string & address, int r) {
+    if (address.compare(0, 5, "unix:") == 0 || address.compare(0, 4, "shm:") == 0)
+        return address + "." + std::to_string(r);
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) return address;
+    return address.substr(0, colon + 1) + std::to_string(atoi(address.c_str() + colon + 1) + r);
+}
+
+static int lowestBit(int r) {
+    return r & -r;
+}
+
+bool Compositor::fail(const char * what) {
+    fprintf(stderr, "composite: rank %d %s\n", rank, what);
+    close();
+    return false;
+}
+
+// ranks sharing this node's cores
+static int localRanks(const std::string & address, int ranks) {
+    if (address.compare(0, 4, "tcp:") != 0) return ranks;
+    for (const char * v : { "OMPI_COMM_WORLD_LOCAL_SIZE", "MPI_LOCALNRANKS", "SLURM_NTASKS_PER_NODE" }) {
+        const char * s = getenv(v);
+        if (s && atoi(s) > 0) return atoi(s);
+    }
+    return 1;
+}
+
+bool Compositor::connect(const std::string & address, int rank, int ranks, int timeoutMs, int threads) {
+    close();
+    this->rank = rank;
+    if (rank < 0 || ranks <= 1) return true;
+    const bool shm = address.compare(0, 4, "shm:") == 0;
+    const std::string own = rankAddress(shm ? "unix:" + address.substr(4) : address, rank);
+    // rank 0 takes 1, 2, 4.. as children, rank r only those below its lowest bit
+    int expected = 0;
+    for (int k = 1; rank + k < ranks && (rank == 0 || k < lowestBit(rank)); k <<= 1) expected++;
+    if (expected && !listener.listen(own)) return fail("cannot listen");
+    if (rank > 0) {
+        const std::string up = rankAddress(address, rank - lowestBit(rank));
+        // an image is 8 bytes per pixel and has to fit in half the ring
+        if (shm) parent = ShmTransport::connect("unix:" + up.substr(4), (size_t)256 << 20, timeoutMs);
+        else parent = SocketTransport::connect(up, timeoutMs);
+        ScatterBuffer b;
+        b.put((int32_t)rank);
+        if (!parent || !parent->send(MSG_RANK, b)) return fail("cannot reach its parent");
+    }
+    std::vector<std::pair<int, std::unique_ptr<Transport>>> found;
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while ((int)found.size() < expected) {
+        int left = (int)std::chrono::duration_cast<std::chrono::milliseconds>(until - std::chrono::steady_clock::now()).count();
+        std::unique_ptr<SocketTransport> s = listener.accept(std::max(0, left));
+        if (!s) return fail("timed out waiting for its children");
+        std::unique_ptr<Transport> t;
+        uint32_t type;
+        const unsigned char * data;
+        size_t size;
+        if (!s->receive(type, data, size)) continue;
+        if (type == remote::MSG_SHM) {
+            t = ShmTransport::accept(std::move(s), data, size);
+            if (!t || !t->receive(type, data, size)) continue;
+        } else t = std::move(s);
+        ByteReader r(data, size);
+        int child = r.get<int32_t>();
+        if (type != MSG_RANK || !r.ok) continue;
+        found.push_back(std::make_pair(child, std::move(t)));
+    }
+    listener.close();
+    std::sort(found.begin(), found.end(), [](const std::pair<int, std::unique_ptr<Transport>> & a,
+                                             const std::pair<int, std::unique_ptr<Transport>> & b) {
+        return a.first < b.first;
+    });
+    for (auto & f : found) children.push_back(std::move(f.second));
+    // leaves only send, the calling thread takes part in the loops
+    if (threads < 0) threads = std::max(1, (int)std::thread::hardware_concurrency() / localRanks(address, ranks));
+    if (!children.empty()) pool = std::make_unique<TaskPool>(threads - 1);
+    return true;
+}
+
+void Compositor::close() {
+    listener.close();
+    parent.reset(nullptr);
+    children.clear();
+    pool.reset(nullptr);
+}
+
+bool Compositor::shareCamera(Camera & cam) {
+    if (parent) {
+        uint32_t type;
+        const unsigned char * data;
+        size_t size;
+        if (!parent->receive(type, data, size) || type != MSG_CAMERA) return fail("lost its parent");
+        ByteReader r(data, size);
+        Camera c = getCamera(r);
+        if (!r.ok) return fail("got a damaged camera");
+        cam = c;
+    }
+    ScatterBuffer b;
+    putCamera(b, cam);
+    // the farthest child heads the biggest subtree, it goes first
+    for (size_t i = children.size(); i-- > 0;)
+        if (!children[i]->send(MSG_CAMERA, b)) return fail("lost a child");
+    return true;
+}
+
+bool Compositor::reduce(int w, int h, unsigned char * color, float * depth) {
+    const size_t n = (size_t)w * h, chunk = 1 << 16;
+    for (auto & c : children) {
+        uint32_t type;
+        const unsigned char * data;
+        size_t size;
+        if (!c->receive(type, data, size) || type != MSG_IMAGE) return fail("lost a child");
+        ByteReader r(data, size);
+        int cw = r.get<int32_t>(), ch = r.get<int32_t>();
+        if (cw != w || ch != h) return fail("got an image of another size");
+        r.align(16);
+        const unsigned char * srcColor = (const unsigned char *)r.take(n * 4);
+        const float * srcDepth = (const float *)r.take(n * sizeof(float));
+        if (!r.ok) return fail("got a damaged image");
+        // in place from the receive buffer or the shared ring
+        pool->parallelFor((n + chunk - 1) / chunk, [&](size_t i) {
+            size_t first = i * chunk, count = std::min(chunk, n - first);
+            compositeDepth(color + 4 * first, depth + first, srcColor + 4 * first, srcDepth + first, count);
+        });
+    }
+    if (parent) {
+        ScatterBuffer b;
+        b.put((int32_t)w); b.put((int32_t)h);
+        b.align(16);
+        b.ref(color, n * 4);
+        b.ref(depth, n * sizeof(float));
+        if (!parent->send(MSG_IMAGE, b)) return fail("lost its parent");
+    }
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "remote.h"
+#include "taskpool.h"
+
+// keeps the nearer of two rgba + depth pixels, `color` and `depth` take the
+// result. sse2 where available, 4 pixels at a time
+void compositeDepth(unsigned char * color, float * depth,
+                    const unsigned char * srcColor, const float * srcDepth, size_t n);
+
+// sort-last compositing for processes that each render a part of the scene.
+// the ranks form a binomial tree, rank r sends to r minus its lowest set bit,
+// so rank 0 holds the image of all ranks after log2(ranks) steps.
+//
+//   address  as in remote.h. rank r listens on "<path>.<r>" or port + r,
+//            shm:/path moves the images through shared rings
+class Compositor {
+public:
+    // blocks until the tree is connected, waiting up to timeoutMs for the
+    // other ranks to start. one rank (or none) composites nothing. threads
+    // merge the images on ranks with children; -1 divides the cores among
+    // the ranks on this node: all of them for unix and shm addresses, the
+    // launcher's local rank count (open mpi, mpich, slurm) over tcp
+    bool connect(const std::string & address, int rank, int ranks, int timeoutMs = 60000, int threads = -1);
+    void close();
+    bool root() const { return rank <= 0; }
+    // hands rank 0's camera to all ranks
+    bool shareCamera(Camera & cam);
+    // merges color (rgba) and depth (inf for background) of w x h pixels with
+    // the images of all other ranks, rank 0 has the final image afterwards
+    bool reduce(int w, int h, unsigned char * color, float * depth);
+private:
+    int rank = -1;
+    SocketListener listener;
+    std::unique_ptr<Transport> parent;
+    std::vector<std::unique_ptr<Transport>> children; // nearest rank first
+    std::unique_ptr<TaskPool> pool;
+    bool fail(const char * what);
+};
@@ -0,0 +1,71 @@
+#include "downsample.h"
+
+static const char vert_src[] = R"(
+#version 330
+void main() {
+    // one triangle covering the viewport
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+static const char frag_src[] = R"(
+#version 330
+uniform sampler2D src;
+uniform ivec2 origin;
+uniform ivec2 size;
+uniform int factor;
+uniform int luma;
+layout (location = 0) out vec4 fragColor;
+void main() {
+    ivec2 lo = ivec2(gl_FragCoord.xy) * factor + origin;
+    ivec2 hi = min(lo + factor, origin + size);
+    vec4 sum = vec4(0.0);
+    for (int y = lo.y; y < hi.y; y++)
+        for (int x = lo.x; x < hi.x; x++)
+            sum += texelFetch(src, ivec2(x, y), 0);
+    vec4 c = sum / float((hi.x - lo.x) * (hi.y - lo.y));
+    if (luma != 0) c.rgb = vec3(dot(c.rgb, vec3(0.299, 0.587, 0.114)));
+    fragColor = c;
+}
+)";
+
+static GLuint program;
+static GLuint vao;
+
+void Downsampler::initGL() {
+    program = glCreateProgram();
+    if (programFromSource(program, vert_src, frag_src))
+        abort();
+    glGenVertexArrays(1, &vao);
+    glCheckError();
+}
+void Downsampler::freeGL() {
+    glDeleteVertexArrays(1, &vao);
+    glDeleteProgram(program);
+    glCheckError();
+}
+
+void Downsampler::run(GLuint src, int x, int y, int w, int h, int factor, bool luma) {
+    const int ow = (w + factor - 1) / factor, oh = (h + factor - 1) / factor;
+    if (target.resolution[0] != ow || target.resolution[1] != oh) {
+        target.destroy();
+        target.create(ow, oh, GL_RGBA8);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fb);
+    glViewport(0, 0, ow, oh);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, src);
+    glUniform1i(glGetUniformLocation(program, "src"), 0);
+    glUniform2i(glGetUniformLocation(program, "origin"), x, y);
+    glUniform2i(glGetUniformLocation(program, "size"), w, h);
+    glUniform1i(glGetUniformLocation(program, "factor"), factor);
+    glUniform1i(glGetUniformLocation(program, "luma"), luma ? 1 : 0);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glCheckError();
+}
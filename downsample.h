@@ -0,0 +1,17 @@
+#pragma once
+
+#include "drawer.h"
+
+// gpu box filter used to shrink snapshots before readback
+struct Downsampler {
+    static void initGL();
+    static void freeGL();
+
+    FrameBuffer target;
+
+    // averages factor x factor blocks of src[x, x+w) x [y, y+h) into target,
+    // which ends up bound and sized ceil(w/factor) x ceil(h/factor).
+    // with luma set the rgb channels hold the BT.601 luminance
+    void run(GLuint src, int x, int y, int w, int h, int factor, bool luma);
+    ~Downsampler() { target.destroy(); }
+};
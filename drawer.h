@@ -3,6 +3,7 @@
 #include <GL/gl3w.h>
 #include <string>
 #include <map>
+#include <vector>
 
 #include "camera.h"
 #include "Application.h"
@@ -12,14 +13,56 @@
 struct draw_param {
     float mat[4][4];
     Camera cam;
+    // written to the id attachment: 0 is background, drawers count from 1
+    unsigned drawerId = 0;
+};
+
+// gpu-side counterpart of FactoryView: the vertex buffers a drawer draws
+// from, three floats per vertex each. lets a scene be read back after its
+// factories are gone, see scene_io.h
+struct DrawerView {
+    std::string type;
+    std::vector<float> params;
+    size_t vertices = 0;
+    std::vector<GLuint> buffers;
 };
 
 struct Drawer {
     virtual ~Drawer() {}
     virtual void draw(const struct draw_param &)=0;
+    // fills v and returns true if the drawer's buffers can be exported
+    virtual bool view(DrawerView &) const { return false; }
+    // world space box around everything drawn, the scene skips the drawer
+    // when it is out of view. left empty (lo > hi) it is always drawn
+    glm::fvec3 lo = glm::fvec3(1), hi = glm::fvec3(-1);
+    // gpu memory of its buffers and textures, for accounting
+    size_t gpuBytes = 0;
+};
+
+// non-owning description of a factory's contents: a type tag, a few scalar
+// parameters and raw data streams. used to capture or ship factories
+// without copying their buffers, see serialize.h
+struct FactoryView {
+    struct Stream {
+        const void * data;
+        size_t bytes;
+    };
+    std::string type;
+    std::vector<float> params;
+    std::vector<Stream> streams;
 };
 
 struct DrawerFactory {
     virtual ~DrawerFactory() {}
     virtual Drawer * createDrawer()=0;
+    // fills v and returns true if the factory can be serialized
+    virtual bool view(FactoryView &) const { return false; }
+    // host memory it holds, for accounting
+    virtual size_t hostBytes() const {
+        FactoryView v;
+        size_t n = 0;
+        if (view(v))
+            for (auto & s : v.streams) n += s.bytes;
+        return n;
+    }
 };
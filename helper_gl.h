@@ -2,7 +2,10 @@
 
 #include <GL/gl.h>
 
+#include <assert.h>
+#include <math.h>
 #include <string>
+#include <list>
 
 #define errorln(fmt, ...) fprintf(stderr, fmt "\n", __VA_ARGS__)
 
@@ -81,42 +84,164 @@ fail_vert:
     return ret;
 }
 
-struct DrawingCtx {
-    GLuint fb; GLuint rb; GLuint texture;
-    DrawingCtx() {
+// offscreen render target: rgba color texture + depth/stencil renderbuffer,
+// optionally with extra outputs written by the drawers' fragment shaders:
+// location 1 linear view depth (R32F), location 2 drawer and primitive id (RG32UI).
+// with samples > 1 fb renders into multisampled renderbuffers and resolve()
+// blits them into texture; the id/depth outputs are never multisampled.
+struct FrameBuffer {
+    enum { ATTACH_DEPTH = 1, ATTACH_ID = 2 };
+    GLuint fb = 0, rb = 0, texture = 0;
+    GLuint aux[2] = { 0,0 }; // depth, id
+    GLuint resolveFb = 0, msColor = 0;
+    int resolution[2] = { 0,0 };
+    GLenum format = GL_RGBA8;
+    unsigned attachments = 0;
+    int samples = 1;
+    size_t bytes = 0;
+    static size_t bytesPerPixel(GLenum format) {
+        switch (format) {
+        case GL_RGBA16F: return 8;
+        case GL_RGBA32F: return 16;
+        default: return 4;
+        }
+    }
+    void create(int width, int height, GLenum fmt, unsigned attach = 0, int nsamples = 1) {
+        resolution[0] = width; resolution[1] = height; format = fmt; attachments = attach;
+        samples = (nsamples > 1 && !attach) ? nsamples : 1;
         glGenFramebuffers(1, &fb);
         glGenTextures(1, &texture);
         glGenRenderbuffers(1, &rb);
+        if (samples > 1) {
+            glGenFramebuffers(1, &resolveFb);
+            glGenRenderbuffers(1, &msColor);
+            glBindFramebuffer(GL_FRAMEBUFFER, resolveFb);
+        } else {
+            glBindFramebuffer(GL_FRAMEBUFFER, fb);
+        }
+        // create a color attachment texture
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, resolution[0], resolution[1], 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
         glCheckError();
-    }
-    int resolution[2] = { 0,0 };
-    void bindFB(int weight, int height) {
-        glBindFramebuffer(GL_FRAMEBUFFER, fb);
+        GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_NONE, GL_NONE };
+        const GLenum auxFormat[2][3] = { { GL_R32F, GL_RED, GL_FLOAT }, { GL_RG32UI, GL_RG_INTEGER, GL_UNSIGNED_INT } };
+        for (int i = 0; i < 2; i++) {
+            if (!(attachments & (1u << i))) continue;
+            glGenTextures(1, &aux[i]);
+            glBindTexture(GL_TEXTURE_2D, aux[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, auxFormat[i][0], resolution[0], resolution[1], 0, auxFormat[i][1], auxFormat[i][2], NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1 + i, GL_TEXTURE_2D, aux[i], 0);
+            drawBuffers[1 + i] = GL_COLOR_ATTACHMENT1 + i;
+        }
+        glDrawBuffers(3, drawBuffers);
         glCheckError();
-        if (resolution[0] != weight || resolution[1] != height) {
-            resolution[0] = weight; resolution[1] = height;
-            // create a color attachment texture
-            glBindTexture(GL_TEXTURE_2D, texture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, resolution[0], resolution[1], 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
-            glCheckError();
-            // create a renderbuffer object for depth and stencil attachment (we won't be sampling these)
-            glBindRenderbuffer(GL_RENDERBUFFER, rb);
-            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, resolution[0], resolution[1]); // use a single renderbuffer object for both a depth AND stencil buffer.
-            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rb); // now actually attach it
-            glCheckError();
-            // now that we actually created the framebuffer and added all attachments we want to check if it is actually complete now
+        if (samples > 1) {
             assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
-            glViewport(0, 0, resolution[0], resolution[1]);
+            glBindFramebuffer(GL_FRAMEBUFFER, fb);
+            glBindRenderbuffer(GL_RENDERBUFFER, msColor);
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, format, resolution[0], resolution[1]);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, msColor);
             glCheckError();
         }
+        // create a renderbuffer object for depth and stencil attachment (we won't be sampling these)
+        glBindRenderbuffer(GL_RENDERBUFFER, rb);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples > 1 ? samples : 0, GL_DEPTH24_STENCIL8, resolution[0], resolution[1]); // use a single renderbuffer object for both a depth AND stencil buffer.
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rb); // now actually attach it
+        glCheckError();
+        // now that we actually created the framebuffer and added all attachments we want to check if it is actually complete now
+        assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+        bytes = (size_t)width * height * (samples * (bytesPerPixel(format) + 4) + (samples > 1 ? bytesPerPixel(format) : 0)
+                + (attachments & ATTACH_DEPTH ? 4 : 0) + (attachments & ATTACH_ID ? 8 : 0));
     }
-    ~DrawingCtx() {
+    // leaves the single sampled framebuffer holding `texture` bound
+    void resolve() {
+        if (!resolveFb) return;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fb);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFb);
+        glBlitFramebuffer(0, 0, resolution[0], resolution[1], 0, 0, resolution[0], resolution[1], GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, resolveFb);
+        glCheckError();
+    }
+    void clear(float r, float g, float b, float a) {
+        const GLfloat color[4] = { r, g, b, a };
+        const GLfloat far[4] = { INFINITY, 0, 0, 0 };
+        const GLuint none[4] = { 0, 0, 0, 0 };
+        glClearBufferfv(GL_COLOR, 0, color);
+        if (attachments & ATTACH_DEPTH) glClearBufferfv(GL_COLOR, 1, far);
+        if (attachments & ATTACH_ID) glClearBufferuiv(GL_COLOR, 2, none);
+        glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.f, 0);
+    }
+    void destroy() {
         glDeleteFramebuffers(1, &fb);
         glDeleteTextures(1, &texture);
         glDeleteRenderbuffers(1, &rb);
+        for (auto & t : aux) if (t) glDeleteTextures(1, &t);
+        if (resolveFb) glDeleteFramebuffers(1, &resolveFb);
+        if (msColor) glDeleteRenderbuffers(1, &msColor);
+        glCheckError();
+        fb = rb = texture = resolveFb = msColor = 0;
+        aux[0] = aux[1] = 0;
+        bytes = 0;
+    }
+};
+
+// framebuffers are pooled by size, format, attachments and sample count, so switching between the
+// interactive view and snapshot resolutions does not reallocate. the least
+// recently used ones are released once the pool exceeds memoryCap.
+struct DrawingCtx {
+    // the bound framebuffer, as seen by the viewer and snapshot readback
+    GLuint fb = 0; GLuint texture = 0;
+    int resolution[2] = { 0,0 };
+    size_t memoryCap = (size_t)512 << 20;
+    int samples = 1; // msaa for color-only targets
+    std::list<FrameBuffer> pool; // most recently used first
+    void bindFB(int weight, int height, GLenum format = GL_RGBA8, unsigned attachments = 0) {
+        const int s = attachments ? 1 : samples;
+        auto it = pool.begin();
+        for (; it != pool.end(); ++it)
+            if (it->resolution[0] == weight && it->resolution[1] == height
+                && it->format == format && it->attachments == attachments && it->samples == s)
+                break;
+        if (it == pool.end()) {
+            pool.emplace_front();
+            pool.front().create(weight, height, format, attachments, s);
+        } else if (it != pool.begin()) {
+            pool.splice(pool.begin(), pool, it);
+        }
+        const FrameBuffer & cur = pool.front();
+        fb = cur.fb; texture = cur.texture;
+        resolution[0] = weight; resolution[1] = height;
+        glBindFramebuffer(GL_FRAMEBUFFER, fb);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glViewport(0, 0, resolution[0], resolution[1]);
         glCheckError();
+        trim();
+    }
+    FrameBuffer & current() { return pool.front(); }
+    // clears every attachment of the bound framebuffer, aux outputs to "nothing"
+    void clear(float r, float g, float b, float a) { current().clear(r, g, b, a); }
+    // call after drawing, before texture or readback are used
+    void resolve() { current().resolve(); }
+    size_t memoryUsed() const {
+        size_t s = 0;
+        for (auto & f : pool) s += f.bytes;
+        return s;
+    }
+    // drop least recently used framebuffers, the bound one is always kept
+    void trim() {
+        size_t used = memoryUsed();
+        while (used > memoryCap && pool.size() > 1) {
+            used -= pool.back().bytes;
+            pool.back().destroy();
+            pool.pop_back();
+        }
+    }
+    ~DrawingCtx() {
+        for (auto & f : pool) f.destroy();
     }
 };
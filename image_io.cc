@@ -0,0 +1,525 @@
+#include "image_io.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+// deflate tables (RFC 1951, section 3.2.5)
+static const unsigned short lenBase[29] = {
+    3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const unsigned char lenExtra[29] = {
+    0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const unsigned short distBase[30] = {
+    1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
+    1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const unsigned char distExtra[30] = {
+    0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+static struct DeflateLUT {
+    unsigned char lenSym[259];
+    unsigned char distSym[512]; // dist <= 256 directly, larger ones by (dist-1) >> 7
+    DeflateLUT() {
+        for (int s = 0; s < 29; s++)
+            for (int l = lenBase[s]; l < (s == 28 ? 259 : lenBase[s + 1]); l++)
+                lenSym[l] = s;
+        for (int s = 0; s < 30; s++) {
+            int end = s == 29 ? 32769 : distBase[s + 1];
+            for (int d = distBase[s]; d < end; d++) {
+                if (d <= 256) distSym[d - 1] = s;
+                else distSym[256 + ((d - 1) >> 7)] = s;
+            }
+        }
+    }
+    int dist(int d) const { return d <= 256 ? distSym[d - 1] : distSym[256 + ((d - 1) >> 7)]; }
+} lut;
+
+static const int hashBits = 15;
+static const int windowSize = 32768;
+static const int minMatch = 3, maxMatch = 258;
+
+void Deflater::putBits(uint32_t bits, int n) {
+    bitbuf |= (uint64_t)bits << bitcount;
+    bitcount += n;
+    while (bitcount >= 8) {
+        out->push_back(bitbuf & 0xff);
+        bitbuf >>= 8; bitcount -= 8;
+    }
+}
+void Deflater::flushBits() {
+    if (bitcount > 0) out->push_back(bitbuf & 0xff);
+    bitbuf = 0; bitcount = 0;
+}
+void Deflater::putCode(uint32_t code, int n) {
+    uint32_t r = 0;
+    for (int i = 0; i < n; i++) r |= ((code >> i) & 1) << (n - 1 - i);
+    putBits(r, n);
+}
+void Deflater::putLiteral(int lit) {
+    if (lit < 144) putCode(0x30 + lit, 8);
+    else if (lit < 256) putCode(0x190 + lit - 144, 9);
+    else if (lit < 280) putCode(lit - 256, 7);
+    else putCode(0xc0 + lit - 280, 8);
+}
+void Deflater::putMatch(int len, int dist) {
+    int ls = lut.lenSym[len];
+    putLiteral(257 + ls);
+    if (lenExtra[ls]) putBits(len - lenBase[ls], lenExtra[ls]);
+    int ds = lut.dist(dist);
+    putCode(ds, 5);
+    if (distExtra[ds]) putBits(dist - distBase[ds], distExtra[ds]);
+}
+void Deflater::putStored(const unsigned char * data, size_t n, bool final) {
+    do {
+        size_t m = n < 65535 ? n : 65535;
+        putBits((final && m == n) ? 1 : 0, 1);
+        putBits(0, 2);
+        flushBits();
+        unsigned char hdr[4] = {
+            (unsigned char)(m & 0xff), (unsigned char)(m >> 8),
+            (unsigned char)(~m & 0xff), (unsigned char)((~m >> 8) & 0xff) };
+        out->insert(out->end(), hdr, hdr + 4);
+        out->insert(out->end(), data, data + m);
+        data += m; n -= m;
+    } while (n > 0);
+}
+
+void Deflater::begin(std::vector<unsigned char> & o) {
+    out = &o;
+    bitbuf = 0; bitcount = 0;
+    adler_a = 1; adler_b = 0;
+    out->push_back(0x78); out->push_back(0x01); // 32k window, fastest
+}
+
+void Deflater::feed(const unsigned char * data, size_t n, bool final) {
+    for (size_t i = 0; i < n;) {
+        size_t m = n - i < 5552 ? n - i : 5552;
+        for (size_t j = 0; j < m; j++) {
+            adler_a += data[i + j];
+            adler_b += adler_a;
+        }
+        adler_a %= 65521; adler_b %= 65521;
+        i += m;
+    }
+
+    const size_t saved_size = out->size();
+    const uint64_t saved_buf = bitbuf;
+    const int saved_count = bitcount;
+
+    putBits(final ? 1 : 0, 1);
+    putBits(1, 2); // fixed huffman
+    head.assign(1 << hashBits, -1);
+    size_t i = 0;
+    while (i + minMatch <= n) {
+        uint32_t h = (data[i] | data[i + 1] << 8 | data[i + 2] << 16) * 2654435761u >> (32 - hashBits);
+        int32_t cand = head[h];
+        head[h] = (int32_t)i;
+        int len = 0;
+        if (cand >= 0 && i - cand <= windowSize) {
+            size_t lim = n - i < (size_t)maxMatch ? n - i : maxMatch;
+            while (len < (int)lim && data[cand + len] == data[i + len]) len++;
+        }
+        if (len >= minMatch) {
+            putMatch(len, (int)(i - cand));
+            i += len;
+        } else {
+            putLiteral(data[i]);
+            i++;
+        }
+    }
+    for (; i < n; i++) putLiteral(data[i]);
+    putLiteral(256);
+
+    // incompressible input: roll back and store the bytes instead
+    size_t stored = n + 5 * (n / 65535 + 1) + 1;
+    if (n > 0 && out->size() - saved_size > stored) {
+        out->resize(saved_size);
+        bitbuf = saved_buf; bitcount = saved_count;
+        putStored(data, n, final);
+    }
+
+    if (final) {
+        flushBits();
+        unsigned char a[4] = {
+            (unsigned char)(adler_b >> 8), (unsigned char)adler_b,
+            (unsigned char)(adler_a >> 8), (unsigned char)adler_a };
+        out->insert(out->end(), a, a + 4);
+    }
+}
+
+static uint32_t crc32(uint32_t crc, const unsigned char * data, size_t n) {
+    static struct CrcTable {
+        uint32_t t[256];
+        CrcTable() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+        }
+    } table;
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = table.t[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putBE32(std::vector<unsigned char> & out, uint32_t v) {
+    out.push_back(v >> 24); out.push_back(v >> 16); out.push_back(v >> 8); out.push_back(v);
+}
+
+void PngEncoder::chunk(std::vector<unsigned char> & out, const char * type, const unsigned char * data, size_t n) {
+    putBE32(out, (uint32_t)n);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + n);
+    putBE32(out, crc32(0, &out[start], n + 4));
+}
+
+void PngEncoder::begin(std::vector<unsigned char> & out, int w, int h, int c) {
+    static const unsigned char sig[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    static const unsigned char colorType[5] = { 0, 0, 4, 2, 6 };
+    width = w; height = h; channels = c; rows_done = 0;
+    out.insert(out.end(), sig, sig + 8);
+    unsigned char ihdr[13];
+    for (int i = 0; i < 4; i++) {
+        ihdr[i] = (unsigned char)(w >> (24 - 8 * i));
+        ihdr[4 + i] = (unsigned char)(h >> (24 - 8 * i));
+    }
+    ihdr[8] = 8; ihdr[9] = colorType[c]; ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    chunk(out, "IHDR", ihdr, 13);
+    prev.assign((size_t)w * c, 0);
+    idat.clear();
+    deflater.begin(idat);
+}
+
+void PngEncoder::addRows(std::vector<unsigned char> & out, const unsigned char * rows, int n, bool flip) {
+    const size_t stride = (size_t)width * channels;
+    if (n > height - rows_done) n = height - rows_done;
+    filtered.resize((stride + 1) * n);
+    std::vector<unsigned char> sub(stride), up(stride);
+    for (int r = 0; r < n; r++) {
+        const unsigned char * row = rows + stride * (flip ? n - 1 - r : r);
+        // pick the filter with the smallest sum of absolute residuals
+        unsigned long cost_none = 0, cost_sub = 0, cost_up = 0;
+        for (size_t i = 0; i < stride; i++) {
+            sub[i] = row[i] - (i >= (size_t)channels ? row[i - channels] : 0);
+            up[i] = row[i] - prev[i];
+            cost_none += row[i] < 128 ? row[i] : 256 - row[i];
+            cost_sub += sub[i] < 128 ? sub[i] : 256 - sub[i];
+            cost_up += up[i] < 128 ? up[i] : 256 - up[i];
+        }
+        unsigned char * dst = &filtered[(stride + 1) * r];
+        if (cost_sub <= cost_none && cost_sub <= cost_up) {
+            dst[0] = 1; memcpy(dst + 1, sub.data(), stride);
+        } else if (cost_up <= cost_none) {
+            dst[0] = 2; memcpy(dst + 1, up.data(), stride);
+        } else {
+            dst[0] = 0; memcpy(dst + 1, row, stride);
+        }
+        memcpy(prev.data(), row, stride);
+    }
+    rows_done += n;
+    deflater.feed(filtered.data(), filtered.size(), done());
+    if (!idat.empty()) chunk(out, "IDAT", idat.data(), idat.size());
+    idat.clear();
+    if (done()) chunk(out, "IEND", nullptr, 0);
+}
+
+bool encodePng(std::vector<unsigned char> & out, const unsigned char * pixels,
+               int w, int h, int channels, bool flip) {
+    if (w <= 0 || h <= 0 || channels < 1 || channels > 4) return false;
+    PngEncoder enc;
+    enc.begin(out, w, h, channels);
+    enc.addRows(out, pixels, h, flip);
+    return true;
+}
+
+bool writePng(const std::string & path, const unsigned char * pixels,
+              int w, int h, int channels, bool flip) {
+    std::vector<unsigned char> buf;
+    if (!encodePng(buf, pixels, w, h, channels, flip)) return false;
+    FILE * fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        fprintf(stderr, "cannot open %s for writing\n", path.c_str());
+        return false;
+    }
+    bool ok = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+    return fclose(fp) == 0 && ok;
+}
+
+// jpeg tables (ITU T.81 annex K). quantizers are in natural order, zigzag
+// maps a natural index to its position in the coded order
+static const unsigned char zigzag[64] = {
+    0,1,5,6,14,15,27,28,2,4,7,13,16,26,29,42,3,8,12,17,25,30,41,43,9,11,18,24,31,40,44,53,
+    10,19,23,32,39,45,52,54,20,22,33,38,46,51,55,60,21,34,37,47,50,56,59,61,35,36,48,49,57,58,62,63 };
+static const unsigned char lumQuant[64] = {
+    16,11,10,16,24,40,51,61,12,12,14,19,26,58,60,55,14,13,16,24,40,57,69,56,14,17,22,29,51,87,80,62,
+    18,22,37,56,68,109,103,77,24,35,55,64,81,104,113,92,49,64,78,87,103,121,120,101,72,92,95,98,112,100,103,99 };
+static const unsigned char chromQuant[64] = {
+    17,18,24,47,99,99,99,99,18,21,26,66,99,99,99,99,24,26,56,99,99,99,99,99,47,66,99,99,99,99,99,99,
+    99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99 };
+static const unsigned char dcLumCounts[16] = { 0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
+static const unsigned char dcChromCounts[16] = { 0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0 };
+static const unsigned char dcValues[12] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
+static const unsigned char acLumCounts[16] = { 0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7d };
+static const unsigned char acLumValues[162] = {
+    0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,0x22,0x71,0x14,0x32,0x81,0x91,0xa1,0x08,
+    0x23,0x42,0xb1,0xc1,0x15,0x52,0xd1,0xf0,0x24,0x33,0x62,0x72,0x82,0x09,0x0a,0x16,0x17,0x18,0x19,0x1a,0x25,0x26,0x27,0x28,
+    0x29,0x2a,0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,
+    0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
+    0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,
+    0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,0xe1,0xe2,
+    0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa };
+static const unsigned char acChromCounts[16] = { 0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,0x77 };
+static const unsigned char acChromValues[162] = {
+    0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,
+    0xa1,0xb1,0xc1,0x09,0x23,0x33,0x52,0xf0,0x15,0x62,0x72,0xd1,0x0a,0x16,0x24,0x34,0xe1,0x25,0xf1,0x17,0x18,0x19,0x1a,0x26,
+    0x27,0x28,0x29,0x2a,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,
+    0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x82,0x83,0x84,0x85,0x86,0x87,
+    0x88,0x89,0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,
+    0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,
+    0xe2,0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa };
+
+// canonical codes from the per-length counts, indexed by symbol
+struct HuffTable {
+    uint16_t code[256];
+    uint8_t size[256];
+    HuffTable(const unsigned char * counts, const unsigned char * values) {
+        int k = 0, c = 0;
+        for (int len = 1; len <= 16; len++, c <<= 1)
+            for (int i = 0; i < counts[len - 1]; i++, k++, c++) {
+                code[values[k]] = (uint16_t)c;
+                size[values[k]] = (uint8_t)len;
+            }
+    }
+};
+static const HuffTable dcLum(dcLumCounts, dcValues), dcChrom(dcChromCounts, dcValues);
+static const HuffTable acLum(acLumCounts, acLumValues), acChrom(acChromCounts, acChromValues);
+
+// msb-first entropy coded segment, 0xff bytes are stuffed with a zero
+struct JpegBits {
+    std::vector<unsigned char> & out;
+    uint32_t buf = 0;
+    int count = 0;
+    explicit JpegBits(std::vector<unsigned char> & o) : out(o) {}
+    void put(uint32_t bits, int n) {
+        count += n;
+        buf |= bits << (24 - count);
+        while (count >= 8) {
+            unsigned char c = (unsigned char)(buf >> 16);
+            out.push_back(c);
+            if (c == 0xff) out.push_back(0);
+            buf <<= 8;
+            count -= 8;
+        }
+    }
+    void flush() { put(0x7f, 7); } // pad with ones
+};
+
+// magnitude category and its value bits for a coefficient
+static inline int category(int v, uint32_t & bits) {
+    int a = v < 0 ? -v : v, n = 0;
+    while (a) { n++; a >>= 1; }
+    bits = (uint32_t)(v < 0 ? v - 1 : v) & ((1u << n) - 1);
+    return n;
+}
+
+// scaled 1-d dct (Arai, Agui, Nakajima), the scale is folded into quantization
+static inline void fdct8(float * d, int s) {
+    float t0 = d[0] + d[7 * s], t7 = d[0] - d[7 * s];
+    float t1 = d[s] + d[6 * s], t6 = d[s] - d[6 * s];
+    float t2 = d[2 * s] + d[5 * s], t5 = d[2 * s] - d[5 * s];
+    float t3 = d[3 * s] + d[4 * s], t4 = d[3 * s] - d[4 * s];
+    float t10 = t0 + t3, t13 = t0 - t3, t11 = t1 + t2, t12 = t1 - t2;
+    d[0] = t10 + t11;
+    d[4 * s] = t10 - t11;
+    float z1 = (t12 + t13) * 0.707106781f;
+    d[2 * s] = t13 + z1;
+    d[6 * s] = t13 - z1;
+    t10 = t4 + t5; t11 = t5 + t6; t12 = t6 + t7;
+    float z5 = (t10 - t12) * 0.382683433f;
+    float z2 = t10 * 0.541196100f + z5, z4 = t12 * 1.306562965f + z5, z3 = t11 * 0.707106781f;
+    float z11 = t7 + z3, z13 = t7 - z3;
+    d[5 * s] = z13 + z2;
+    d[3 * s] = z13 - z2;
+    d[s] = z11 + z4;
+    d[7 * s] = z11 - z4;
+}
+
+// transforms, quantizes and codes one 8x8 block, returns its dc value
+static int jpegBlock(JpegBits & bw, float * b, const float * scale, int prevDc,
+                     const HuffTable & dc, const HuffTable & ac) {
+    for (int i = 0; i < 64; i += 8) fdct8(b + i, 1);
+    for (int i = 0; i < 8; i++) fdct8(b + i, 8);
+    int q[64];
+    for (int i = 0; i < 64; i++) q[zigzag[i]] = (int)lrintf(b[i] * scale[i]);
+    uint32_t bits;
+    int n = category(q[0] - prevDc, bits);
+    bw.put(dc.code[n], dc.size[n]);
+    if (n) bw.put(bits, n);
+    int last = 63;
+    while (last > 0 && !q[last]) last--;
+    for (int i = 1; i <= last; i++) {
+        int run = 0;
+        while (!q[i]) { i++; run++; }
+        for (; run >= 16; run -= 16) bw.put(ac.code[0xf0], ac.size[0xf0]);
+        n = category(q[i], bits);
+        bw.put(ac.code[(run << 4) | n], ac.size[(run << 4) | n]);
+        bw.put(bits, n);
+    }
+    if (last != 63) bw.put(ac.code[0], ac.size[0]);
+    return q[0];
+}
+
+static void putBE16(std::vector<unsigned char> & out, int v) {
+    out.push_back((unsigned char)(v >> 8)); out.push_back((unsigned char)v);
+}
+
+bool encodeJpeg(std::vector<unsigned char> & out, const unsigned char * pixels,
+                int w, int h, int channels, int quality, bool flip) {
+    if (w <= 0 || h <= 0 || w > 65535 || h > 65535 || channels < 3 || channels > 4) return false;
+    quality = quality < 1 ? 1 : quality > 100 ? 100 : quality;
+    const int qs = quality < 50 ? 5000 / quality : 200 - 2 * quality;
+    static const float aan[8] = { 1.f, 1.387039845f, 1.306562965f, 1.175875602f,
+                                  1.f, 0.785694958f, 0.541196100f, 0.275899379f };
+    unsigned char qt[2][64];
+    float scale[2][64];
+    for (int t = 0; t < 2; t++) {
+        const unsigned char * base = t ? chromQuant : lumQuant;
+        for (int i = 0; i < 64; i++) {
+            int v = (base[i] * qs + 50) / 100;
+            qt[t][zigzag[i]] = (unsigned char)(v < 1 ? 1 : v > 255 ? 255 : v);
+        }
+        for (int i = 0; i < 64; i++)
+            scale[t][i] = 1.f / (qt[t][zigzag[i]] * aan[i / 8] * aan[i % 8] * 8.f);
+    }
+
+    static const unsigned char jfif[18] = { 0xff,0xd8, 0xff,0xe0, 0,16, 'J','F','I','F',0, 1,1, 0, 0,1, 0,1 };
+    out.insert(out.end(), jfif, jfif + 18);
+    out.push_back(0); out.push_back(0); // no thumbnail
+    out.push_back(0xff); out.push_back(0xdb); putBE16(out, 2 + 2 * 65);
+    for (int t = 0; t < 2; t++) {
+        out.push_back((unsigned char)t);
+        out.insert(out.end(), qt[t], qt[t] + 64);
+    }
+    static const unsigned char sofStart[5] = { 0xff,0xc0, 0,17, 8 };
+    out.insert(out.end(), sofStart, sofStart + 5);
+    putBE16(out, h); putBE16(out, w);
+    static const unsigned char sofComps[10] = { 3, 1,0x22,0, 2,0x11,1, 3,0x11,1 };
+    out.insert(out.end(), sofComps, sofComps + 10);
+    out.push_back(0xff); out.push_back(0xc4); putBE16(out, 2 + 4 * 17 + 12 + 162 + 12 + 162);
+    const unsigned char * tables[4][2] = { { dcLumCounts, dcValues }, { acLumCounts, acLumValues },
+                                           { dcChromCounts, dcValues }, { acChromCounts, acChromValues } };
+    static const unsigned char tableIds[4] = { 0x00, 0x10, 0x01, 0x11 };
+    for (int t = 0; t < 4; t++) {
+        int n = 0;
+        for (int i = 0; i < 16; i++) n += tables[t][0][i];
+        out.push_back(tableIds[t]);
+        out.insert(out.end(), tables[t][0], tables[t][0] + 16);
+        out.insert(out.end(), tables[t][1], tables[t][1] + n);
+    }
+    static const unsigned char sos[14] = { 0xff,0xda, 0,12, 3, 1,0x00, 2,0x11, 3,0x11, 0,63,0 };
+    out.insert(out.end(), sos, sos + 14);
+
+    // 16x16 macroblocks: four luma blocks and one averaged block per chroma
+    const size_t stride = (size_t)w * channels;
+    JpegBits bw(out);
+    int dcY = 0, dcCb = 0, dcCr = 0;
+    float Y[4][64], Cb[64], Cr[64];
+    for (int my = 0; my < h; my += 16) {
+        for (int mx = 0; mx < w; mx += 16) {
+            memset(Cb, 0, sizeof(Cb));
+            memset(Cr, 0, sizeof(Cr));
+            for (int y = 0; y < 16; y++) {
+                int iy = my + y < h ? my + y : h - 1; // edges repeat the last pixel
+                const unsigned char * row = pixels + stride * (flip ? h - 1 - iy : iy);
+                for (int x = 0; x < 16; x++) {
+                    const unsigned char * p = row + (size_t)(mx + x < w ? mx + x : w - 1) * channels;
+                    float r = p[0], g = p[1], b = p[2];
+                    Y[(y >> 3) * 2 + (x >> 3)][(y & 7) * 8 + (x & 7)] = 0.299f * r + 0.587f * g + 0.114f * b - 128.f;
+                    int c = (y >> 1) * 8 + (x >> 1);
+                    Cb[c] += 0.25f * (-0.168736f * r - 0.331264f * g + 0.5f * b);
+                    Cr[c] += 0.25f * (0.5f * r - 0.418688f * g - 0.081312f * b);
+                }
+            }
+            for (int i = 0; i < 4; i++) dcY = jpegBlock(bw, Y[i], scale[0], dcY, dcLum, acLum);
+            dcCb = jpegBlock(bw, Cb, scale[1], dcCb, dcChrom, acChrom);
+            dcCr = jpegBlock(bw, Cr, scale[1], dcCr, dcChrom, acChrom);
+        }
+    }
+    bw.flush();
+    out.push_back(0xff); out.push_back(0xd9);
+    return true;
+}
+
+bool PngWriter::drain() {
+    bool ok = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+    buf.clear();
+    return ok;
+}
+bool PngWriter::open(const std::string & path, int w, int h, int channels) {
+    close();
+    if (w <= 0 || h <= 0 || channels < 1 || channels > 4) return false;
+    fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        fprintf(stderr, "cannot open %s for writing\n", path.c_str());
+        return false;
+    }
+    enc.begin(buf, w, h, channels);
+    return drain();
+}
+bool PngWriter::writeRows(const unsigned char * rows, int n, bool flip) {
+    if (!fp) return false;
+    enc.addRows(buf, rows, n, flip);
+    return drain();
+}
+bool PngWriter::close() {
+    if (!fp) return true;
+    if (!enc.done()) fprintf(stderr, "png closed before all rows were written\n");
+    bool ok = enc.done();
+    ok = fclose(fp) == 0 && ok;
+    fp = nullptr;
+    return ok;
+}
+
+bool Y4mWriter::open(FILE * f, int w, int h, int fps) {
+    close();
+    fp = f; own = false;
+    width = w; height = h;
+    return fprintf(fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", w, h, fps) > 0;
+}
+bool Y4mWriter::open(const std::string & path, int w, int h, int fps) {
+    FILE * f = fopen(path.c_str(), "wb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s for writing\n", path.c_str());
+        return false;
+    }
+    bool r = open(f, w, h, fps);
+    own = true;
+    return r;
+}
+void Y4mWriter::convert(std::vector<unsigned char> & yuv, const unsigned char * rgba, int w, int h, bool flip) {
+    const size_t n = (size_t)w * h;
+    yuv.resize(n * 3);
+    unsigned char * Y = yuv.data(), * U = Y + n, * V = U + n;
+    for (int r = 0; r < h; r++) {
+        const unsigned char * src = rgba + (size_t)w * 4 * (flip ? h - 1 - r : r);
+        size_t o = (size_t)w * r;
+        for (int x = 0; x < w; x++, src += 4, o++) {
+            int R = src[0], G = src[1], B = src[2];
+            Y[o] = ((66 * R + 129 * G + 25 * B + 128) >> 8) + 16;
+            U[o] = ((-38 * R - 74 * G + 112 * B + 128) >> 8) + 128;
+            V[o] = ((112 * R - 94 * G - 18 * B + 128) >> 8) + 128;
+        }
+    }
+}
+bool Y4mWriter::writeFrame(const std::vector<unsigned char> & yuv) {
+    if (!fp || yuv.size() != (size_t)width * height * 3) return false;
+    return fputs("FRAME\n", fp) >= 0 && fwrite(yuv.data(), 1, yuv.size(), fp) == yuv.size();
+}
+void Y4mWriter::close() {
+    if (fp) {
+        if (own) fclose(fp);
+        else fflush(fp);
+    }
+    fp = nullptr; own = false;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// dependency-free image writers used by the recorder and snapshot helpers.
+// pixels are tightly packed 8-bit channels; `flip` treats the input as
+// bottom-up rows (the OpenGL readback order) and writes them top-down.
+
+// zlib stream built from fixed-huffman deflate blocks, falls back to stored
+// blocks for incompressible input. blocks are emitted per feed() call so the
+// encoder can be used on row strips without holding the whole image.
+class Deflater {
+    std::vector<unsigned char> * out;
+    uint64_t bitbuf;
+    int bitcount;
+    uint32_t adler_a, adler_b;
+    std::vector<int32_t> head;
+    void putBits(uint32_t bits, int n);
+    void flushBits();
+    void putCode(uint32_t code, int n); // huffman codes are stored msb-first
+    void putLiteral(int lit);
+    void putMatch(int len, int dist);
+    void putStored(const unsigned char * data, size_t n, bool final);
+public:
+    Deflater() : out(nullptr), bitbuf(0), bitcount(0), adler_a(1), adler_b(0) {}
+    void begin(std::vector<unsigned char> & o);
+    void feed(const unsigned char * data, size_t n, bool final);
+};
+
+// png encoder writing into a growing buffer, rows may be supplied in strips
+class PngEncoder {
+    int width, height, channels, rows_done;
+    Deflater deflater;
+    std::vector<unsigned char> idat, filtered, prev;
+    void chunk(std::vector<unsigned char> & out, const char * type, const unsigned char * data, size_t n);
+public:
+    PngEncoder() : width(0), height(0), channels(0), rows_done(0) {}
+    void begin(std::vector<unsigned char> & out, int w, int h, int c);
+    // `rows` holds n top-down rows, or bottom-up rows when flip is set
+    void addRows(std::vector<unsigned char> & out, const unsigned char * rows, int n, bool flip = false);
+    bool done() const { return rows_done == height; }
+};
+
+bool encodePng(std::vector<unsigned char> & out, const unsigned char * pixels,
+               int w, int h, int channels, bool flip = false);
+bool writePng(const std::string & path, const unsigned char * pixels,
+              int w, int h, int channels, bool flip = false);
+
+// baseline jpeg, 4:2:0 chroma, standard huffman tables. channels 3 or 4
+// (alpha is dropped), quality 1..100
+bool encodeJpeg(std::vector<unsigned char> & out, const unsigned char * pixels,
+                int w, int h, int channels, int quality = 85, bool flip = false);
+
+// streaming file writer, used when the image does not fit in host memory
+class PngWriter {
+    FILE * fp;
+    PngEncoder enc;
+    std::vector<unsigned char> buf;
+    bool drain();
+public:
+    PngWriter() : fp(nullptr) {}
+    ~PngWriter() { close(); }
+    bool open(const std::string & path, int w, int h, int channels);
+    bool writeRows(const unsigned char * rows, int n, bool flip = false);
+    bool close();
+};
+
+// YUV4MPEG2 (4:4:4, BT.601 limited range) stream, readable by ffmpeg/mpv
+class Y4mWriter {
+    FILE * fp;
+    bool own;
+    int width, height;
+public:
+    Y4mWriter() : fp(nullptr), own(false), width(0), height(0) {}
+    ~Y4mWriter() { close(); }
+    bool open(const std::string & path, int w, int h, int fps = 30);
+    bool open(FILE * f, int w, int h, int fps = 30); // e.g. a popen() pipe, not closed by us
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // converts rgba pixels into planar yuv, can run on any thread
+    static void convert(std::vector<unsigned char> & yuv, const unsigned char * rgba, int w, int h, bool flip = false);
+    bool writeFrame(const std::vector<unsigned char> & yuv);
+    void close();
+};
@@ -1,22 +1,33 @@
 #include "lines.h"
 
+#include <algorithm>
+
 static const char vert_src[] = R"(
 #version 330
 uniform mat4 VP;
 layout (location = 0) in vec3 vPos;
 layout (location = 1) in vec3 vColor;
 out vec3 fColor;
+out float fDist;
 void main() {
     fColor = vColor;
     gl_Position = VP * vec4(vPos.xyz,1);
+    fDist = gl_Position.w;
 }
 )";
 
 static const char frag_src[] = R"(
 #version 330
+uniform uint drawerId;
 in vec3 fColor;
+in float fDist;
+layout (location = 0) out vec4 fragColor;
+layout (location = 1) out float fragDist;
+layout (location = 2) out uvec2 fragId;
 void main() {
-    gl_FragColor = vec4(fColor, 1.0);
+    fragColor = vec4(fColor, 1.0);
+    fragDist = fDist;
+    fragId = uvec2(drawerId, uint(gl_PrimitiveID));
 }
 )";
 
@@ -51,11 +62,21 @@ void LinesDrawer::draw(const struct draw_param & dp) {
     glUseProgram(program);
     int VPLoc = glGetUniformLocation(program, "VP");
     glUniformMatrix4fv(VPLoc, 1, GL_FALSE, &dp.mat[0][0]);
+    int drawerIdLoc = glGetUniformLocation(program, "drawerId");
+    glUniform1ui(drawerIdLoc, dp.drawerId);
     glBindVertexArray(vao);
     glDrawArrays(GL_LINES, 0, vertexNumber);
     glCheckError();
 }
 
+bool LinesDrawer::view(DrawerView & v) const {
+    v.type = "lines";
+    v.params.clear();
+    v.vertices = vertexNumber;
+    v.buffers = { buffers[0], buffers[1] };
+    return true;
+}
+
 LinesDrawer::~LinesDrawer() {
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(sizeof(buffers)/sizeof(buffers[0]), buffers);
@@ -63,12 +84,48 @@ LinesDrawer::~LinesDrawer() {
 }
 
 LinesDrawer * LinesDrawerFactory::createLineDrawer() {
+    FactoryView v;
+    view(v);
+    LinesDrawer * p = static_cast<LinesDrawer *>(upload(v));
+    p->vertexNumber = std::min(p->vertexNumber, vertexNumber);
+    return p;
+}
+
+bool LinesDrawerFactory::view(FactoryView & v) const {
+    v.type = "lines";
+    v.params.clear();
+    v.streams = { { pos.data(), pos.size() * sizeof(pos[0]) }, { col.data(), col.size() * sizeof(col[0]) } };
+    return true;
+}
+
+// whole vertices that have both a position and a color, views may come
+// from other processes
+static size_t count(const FactoryView & v) {
+    return std::min(v.streams[0].bytes, v.streams[1].bytes) / sizeof(glm::fvec3);
+}
+
+std::unique_ptr<DrawerFactory> LinesDrawerFactory::load(const FactoryView & v) {
+    if (v.streams.size() < 2) return nullptr;
+    auto f = std::make_unique<LinesDrawerFactory>();
+    const glm::fvec3 * p = (const glm::fvec3 *)v.streams[0].data;
+    const glm::fvec3 * c = (const glm::fvec3 *)v.streams[1].data;
+    f->pos.assign(p, p + count(v));
+    f->col.assign(c, c + count(v));
+    f->vertexNumber = f->pos.size();
+    return f;
+}
+
+// builds the drawer from the view's memory without an intermediate factory
+Drawer * LinesDrawerFactory::upload(const FactoryView & v) {
+    if (v.streams.size() < 2) return nullptr;
     LinesDrawer * p = new LinesDrawer();
-    p->vertexNumber = vertexNumber;
+    p->vertexNumber = count(v);
     glBindBuffer(GL_ARRAY_BUFFER, p->buffers[0]);
-    glBufferData(GL_ARRAY_BUFFER, pos.size() * sizeof(pos[0]), pos.data(), GL_DYNAMIC_DRAW);
+    const size_t bytes = p->vertexNumber * sizeof(glm::fvec3);
+    glBufferData(GL_ARRAY_BUFFER, bytes, v.streams[0].data, GL_DYNAMIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, p->buffers[1]);
-    glBufferData(GL_ARRAY_BUFFER, col.size() * sizeof(col[0]), col.data(), GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, bytes, v.streams[1].data, GL_DYNAMIC_DRAW);
+    p->gpuBytes = 2 * bytes;
     glCheckError();
     return p;
 }
@@ -3,6 +3,7 @@
 #include "drawer.h"
 
 #include <vector>
+#include <memory>
 #include <glm/glm.hpp>
 
 struct LinesDrawer : Drawer {
@@ -16,12 +17,19 @@ struct LinesDrawer : Drawer {
     LinesDrawer();
     virtual ~LinesDrawer() override;
     virtual void draw(const struct draw_param &) override;
+    virtual bool view(DrawerView & v) const override;
 };
 
 struct LinesDrawerFactory : DrawerFactory {
     virtual Drawer * createDrawer() override {
         return createLineDrawer();
     }
+    virtual bool view(FactoryView & v) const override;
+    virtual size_t hostBytes() const override {
+        return (pos.capacity() + col.capacity()) * sizeof(glm::fvec3);
+    }
+    static std::unique_ptr<DrawerFactory> load(const FactoryView & v);
+    static Drawer * upload(const FactoryView & v);
     size_t vertexNumber;
     std::vector<glm::fvec3> pos, col;
     LinesDrawerFactory() : vertexNumber(0) {}
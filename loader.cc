@@ -0,0 +1,582 @@
+#include "loader.h"
+#include "points.h"
+#include "lines.h"
+#include "taskpool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read-only mapping of a whole file
+struct MappedFile {
+    const char * data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void * file = nullptr, * mapping = nullptr;
+#endif
+    bool open(const std::string & path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) { file = nullptr; return false; }
+        LARGE_INTEGER sz;
+        GetFileSizeEx(file, &sz);
+        size = (size_t)sz.QuadPart;
+        mapping = size ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : nullptr;
+        data = mapping ? (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        fstat(fd, &st);
+        size = st.st_size;
+        void * m = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        data = m == MAP_FAILED ? nullptr : (const char *)m;
+#ifdef MADV_WILLNEED
+        if (data) madvise(m, size, MADV_WILLNEED); // the chunks are read in parallel, read ahead all of it
+#endif
+#endif
+        return data != nullptr;
+    }
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file) CloseHandle(file);
+#else
+        if (data) munmap((void *)data, size);
+#endif
+    }
+};
+
+static const double pow10tab[23] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static inline bool isSeparator(char c) {
+    return c == ' ' || c == '\t' || c == ',' || c == ';' || c == '\r';
+}
+
+// nan, inf, hex and the like
+static bool slowNumber(const char *& p, const char * end, double & out) {
+    char buf[64];
+    size_t n = 0;
+    while (p + n < end && n < sizeof(buf) - 1 && !isSeparator(p[n])) { buf[n] = p[n]; n++; }
+    buf[n] = 0;
+    char * e;
+    out = strtod(buf, &e);
+    p += e - buf;
+    return e != buf;
+}
+
+// plain decimals without strtod, which is locale-bound and wants a
+// terminated string. leaves p after the number
+static inline bool parseNumber(const char *& p, const char * end, double & out) {
+    const char * s = p;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    uint64_t m = 0;
+    int exp = 0, digits = 0;
+    // digits past 17 significant ones only scale the value
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        if (m < 100000000000000000ull) m = m * 10 + (*p - '0');
+        else exp++;
+        p++; digits++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && (unsigned)(*p - '0') < 10) {
+            if (m < 100000000000000000ull) { m = m * 10 + (*p - '0'); exp--; }
+            p++; digits++;
+        }
+    }
+    if (!digits) {
+        p = s;
+        return slowNumber(p, end, out);
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char * e = p + 1;
+        bool eneg = false;
+        if (e < end && (*e == '-' || *e == '+')) eneg = *e++ == '-';
+        if (e < end && (unsigned)(*e - '0') < 10) {
+            int x = 0;
+            while (e < end && (unsigned)(*e - '0') < 10) {
+                if (x < 10000) x = x * 10 + (*e - '0');
+                e++;
+            }
+            exp += eneg ? -x : x;
+            p = e;
+        }
+    }
+    // exact only while m and 10^exp are both exact doubles, strtod rounds the rest
+    if (m > (1ull << 53) || exp < -22 || exp > 22) {
+        p = s;
+        return slowNumber(p, end, out);
+    }
+    double v = exp < 0 ? (double)m / pow10tab[-exp] : (double)m * pow10tab[exp];
+    out = neg ? -v : v;
+    return true;
+}
+
+// up to n numbers from the start of a line, until a field is not a number
+static int parseLine(const char * p, const char * end, double * v, int n) {
+    int k = 0;
+    while (true) {
+        while (p < end && isSeparator(*p)) p++;
+        if (p == end || k == n) return k;
+        if (!parseNumber(p, end, v[k]) || (p < end && !isSeparator(*p))) return k;
+        k++;
+    }
+}
+
+struct TextChunk {
+    const char * begin, * end;
+    size_t firstLine, lines;
+};
+
+// pieces of a few MiB that end at line breaks, numbered by their first line
+static std::vector<TextChunk> splitLines(const char * begin, const char * end, TaskPool & pool) {
+    const size_t size = 4 << 20;
+    std::vector<TextChunk> chunks;
+    for (const char * p = begin; p < end;) {
+        const char * e = p + std::min(size, (size_t)(end - p));
+        if (e < end) {
+            const char * nl = (const char *)memchr(e, '\n', end - e);
+            e = nl ? nl + 1 : end;
+        }
+        chunks.push_back(TextChunk{ p, e, 0, 0 });
+        p = e;
+    }
+    pool.parallelFor(chunks.size(), [&](size_t i) {
+        TextChunk & c = chunks[i];
+        size_t n = 0;
+        for (const char * q = c.begin; (q = (const char *)memchr(q, '\n', c.end - q)); q++) n++;
+        if (c.end[-1] != '\n') n++; // the last line may have no break
+        c.lines = n;
+    });
+    for (size_t i = 1; i < chunks.size(); i++) chunks[i].firstLine = chunks[i - 1].firstLine + chunks[i - 1].lines;
+    return chunks;
+}
+
+// f(line number, begin, end) for each line of the chunk, without the break
+template<class F> static void eachLine(const TextChunk & c, F f) {
+    size_t line = c.firstLine;
+    for (const char * p = c.begin; p < c.end; line++) {
+        const char * nl = (const char *)memchr(p, '\n', c.end - p);
+        const char * e = nl ? nl : c.end;
+        f(line, p, e);
+        p = e + 1;
+    }
+}
+
+// x y z [r g b] lines. every chunk writes from the slot of its first line on,
+// the gaps left by skipped lines are closed afterwards
+static void loadText(const char * begin, const char * end, TaskPool & pool,
+                     std::vector<glm::fvec3> & pos, std::vector<glm::fvec3> & col) {
+    std::vector<TextChunk> chunks = splitLines(begin, end, pool);
+    const size_t lines = chunks.empty() ? 0 : chunks.back().firstLine + chunks.back().lines;
+    pos.resize(lines);
+    col.resize(lines);
+    std::vector<size_t> kept(chunks.size());
+    pool.parallelFor(chunks.size(), [&](size_t i) {
+        size_t k = chunks[i].firstLine;
+        eachLine(chunks[i], [&](size_t, const char * p, const char * e) {
+            double v[6];
+            int n = parseLine(p, e, v, 6);
+            if (n < 3) return; // blank, comment or header
+            pos[k] = glm::fvec3(v[0], v[1], v[2]);
+            // negative marks a point without color, filled in later
+            col[k] = n == 6 ? glm::max(glm::fvec3(v[3], v[4], v[5]), glm::fvec3(0)) : glm::fvec3(-1);
+            k++;
+        });
+        kept[i] = k - chunks[i].firstLine;
+    });
+    size_t n = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (n != chunks[i].firstLine) {
+            memmove(&pos[n], &pos[chunks[i].firstLine], kept[i] * sizeof(glm::fvec3));
+            memmove(&col[n], &col[chunks[i].firstLine], kept[i] * sizeof(glm::fvec3));
+        }
+        n += kept[i];
+    }
+    pos.resize(n);
+    col.resize(n);
+}
+
+enum { PLY_I8, PLY_U8, PLY_I16, PLY_U16, PLY_I32, PLY_U32, PLY_F32, PLY_F64 };
+static const int plySize[8] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+static int plyType(const std::string & s) {
+    static const char * names[8][2] = { { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+                                        { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" } };
+    for (int t = 0; t < 8; t++)
+        if (s == names[t][0] || s == names[t][1]) return t;
+    return -1;
+}
+
+static inline double plyValue(const unsigned char * p, int type, bool swap) {
+    unsigned char b[8];
+    if (swap) for (int i = 0; i < plySize[type]; i++) b[i] = p[plySize[type] - 1 - i];
+    else memcpy(b, p, plySize[type]);
+    switch (type) {
+    case PLY_I8: return (int8_t)b[0];
+    case PLY_U8: return b[0];
+    case PLY_I16: { int16_t v; memcpy(&v, b, 2); return v; }
+    case PLY_U16: { uint16_t v; memcpy(&v, b, 2); return v; }
+    case PLY_I32: { int32_t v; memcpy(&v, b, 4); return v; }
+    case PLY_U32: { uint32_t v; memcpy(&v, b, 4); return v; }
+    case PLY_F32: { float v; memcpy(&v, b, 4); return v; }
+    default: { double v; memcpy(&v, b, 8); return v; }
+    }
+}
+
+struct PlyProperty {
+    std::string name;
+    int type, countType; // countType is -1 except for lists
+    size_t offset;       // in a binary record without lists
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> props;
+    size_t stride = 0; // 0 with list properties
+    int find(const char * a, const char * b = nullptr, const char * c = nullptr) const {
+        for (size_t i = 0; i < props.size(); i++)
+            if (props[i].name == a || (b && props[i].name == b) || (c && props[i].name == c)) return (int)i;
+        return -1;
+    }
+};
+
+enum { PLY_ASCII, PLY_LITTLE, PLY_BIG };
+
+static bool plyHeader(const char * data, size_t size, int & format, std::vector<PlyElement> & elements, size_t & body) {
+    const char * end = data + size, * p = data;
+    format = -1;
+    while (p < end) {
+        const char * nl = (const char *)memchr(p, '\n', end - p);
+        if (!nl) return false;
+        std::string line(p, nl);
+        p = nl + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        char a[64] = "", b[64] = "", c[64] = "", d[64] = "";
+        int n = sscanf(line.c_str(), "%63s %63s %63s %63s", a, b, c, d);
+        std::string key = n > 0 ? a : "";
+        if (key == "end_header") {
+            body = p - data;
+            return format >= 0;
+        } else if (key == "format" && n >= 2) {
+            format = !strcmp(b, "ascii") ? PLY_ASCII : !strcmp(b, "binary_little_endian") ? PLY_LITTLE
+                   : !strcmp(b, "binary_big_endian") ? PLY_BIG : -1;
+        } else if (key == "element" && n >= 3) {
+            elements.push_back(PlyElement{ b, (size_t)strtoull(c, nullptr, 10) });
+        } else if (key == "property" && n >= 3 && !elements.empty()) {
+            PlyElement & el = elements.back();
+            PlyProperty pr = { n == 3 ? c : d, plyType(b), -1, 0 };
+            if (!strcmp(b, "list") && n == 4) {
+                pr = PlyProperty{ "", plyType(d), plyType(c), 0 };
+                // "property list <count type> <item type> <name>" has five words
+                char e[64] = "";
+                if (sscanf(line.c_str(), "%*s %*s %*s %*s %63s", e) == 1) pr.name = e;
+                if (pr.countType < 0) return false;
+            }
+            if (pr.type < 0) return false;
+            el.props.push_back(pr);
+            el.stride = 0;
+            for (auto & q : el.props) {
+                if (q.countType >= 0) { el.stride = 0; break; }
+                el.stride += plySize[q.type];
+            }
+        }
+    }
+    return false;
+}
+
+// binary size of one record starting at p, lists included. 0 if it does not fit
+static size_t plyRecordSize(const PlyElement & el, const unsigned char * p, const unsigned char * end, bool swap) {
+    const size_t left = end - p;
+    size_t s = 0;
+    for (auto & pr : el.props) {
+        if (pr.countType < 0) {
+            s += plySize[pr.type];
+            continue;
+        }
+        if (s + plySize[pr.countType] > left) return 0;
+        double n = plyValue(p + s, pr.countType, swap);
+        if (!(n >= 0 && n <= left)) return 0;
+        s += plySize[pr.countType] + (size_t)n * plySize[pr.type];
+    }
+    return s <= left ? s : 0;
+}
+
+// vertex positions and colors, and the vertex pairs of an edge element
+struct PlyData {
+    std::vector<glm::fvec3> pos, col;
+    std::vector<uint32_t> edges;
+    bool hasEdges = false;
+};
+
+static bool loadPly(const MappedFile & f, TaskPool & pool, PlyData & out, const std::string & path) {
+    int format;
+    std::vector<PlyElement> elements;
+    size_t body;
+    if (!plyHeader(f.data, f.size, format, elements, body)) {
+        fprintf(stderr, "loader: %s has no readable ply header\n", path.c_str());
+        return false;
+    }
+    const PlyElement * vertex = nullptr, * edge = nullptr;
+    for (auto & el : elements) {
+        if (el.name == "vertex") vertex = &el;
+        if (el.name == "edge") edge = &el;
+    }
+    if (!vertex) {
+        fprintf(stderr, "loader: %s has no vertex element\n", path.c_str());
+        return false;
+    }
+    int vi[6] = { vertex->find("x"), vertex->find("y"), vertex->find("z"),
+                  vertex->find("red", "r", "diffuse_red"), vertex->find("green", "g", "diffuse_green"),
+                  vertex->find("blue", "b", "diffuse_blue") };
+    const bool colors = vi[3] >= 0 && vi[4] >= 0 && vi[5] >= 0;
+    // integer colors are 0..255, float ones 0..1
+    const float colorScale = colors && vertex->props[vi[3]].type < PLY_F32 ? 1 / 255.f : 1.f;
+    int ei[2] = { -1, -1 };
+    if (edge) {
+        ei[0] = edge->find("vertex1", "v1");
+        ei[1] = edge->find("vertex2", "v2");
+        if (ei[0] < 0 && edge->props.size() >= 2) { ei[0] = 0; ei[1] = 1; }
+    }
+    if (vi[0] < 0 || vi[1] < 0 || vi[2] < 0 || (edge && (ei[0] < 0 || ei[1] < 0))) {
+        fprintf(stderr, "loader: %s lacks vertex x y z or edge vertex1 vertex2\n", path.c_str());
+        return false;
+    }
+    for (const PlyElement * el : { vertex, edge })
+        if (el) for (auto & pr : el->props)
+            if (pr.countType >= 0) {
+                fprintf(stderr, "loader: %s has a list in its %s element\n", path.c_str(), el->name.c_str());
+                return false;
+            }
+    // the counts come from the header, a damaged one must not allocate more
+    // than the file can hold: a line per record, or a record of fixed size
+    const size_t rest = f.size - body;
+    bool fits = true;
+    if (format == PLY_ASCII) {
+        const PlyElement * last = edge && edge > vertex ? edge : vertex;
+        size_t lines = 0;
+        for (auto & el : elements) {
+            if (el.count > rest - lines) fits = false;
+            else lines += el.count;
+            if (&el == last) break;
+        }
+    } else {
+        for (const PlyElement * el : { vertex, edge })
+            if (el && el->count > rest / el->stride) fits = false;
+    }
+    if (!fits) {
+        fprintf(stderr, "loader: %s is truncated\n", path.c_str());
+        return false;
+    }
+    out.pos.resize(vertex->count);
+    out.col.resize(vertex->count, glm::fvec3(-1));
+    out.hasEdges = edge != nullptr;
+    if (edge) out.edges.resize(edge->count * 2);
+    std::atomic<size_t> bad{ 0 };
+
+    if (format == PLY_ASCII) {
+        // element of a line from the running line counts
+        std::vector<size_t> first(elements.size() + 1, 0);
+        for (size_t i = 0; i < elements.size(); i++) first[i + 1] = first[i] + elements[i].count;
+        const size_t vFirst = first[vertex - elements.data()];
+        const size_t eFirst = edge ? first[edge - elements.data()] : 0;
+        int vFields = 0, eFields = std::max(ei[0], ei[1]) + 1;
+        for (int i = 0; i < (colors ? 6 : 3); i++) vFields = std::max(vFields, vi[i] + 1);
+        std::vector<TextChunk> chunks = splitLines(f.data + body, f.data + f.size, pool);
+        const size_t lines = chunks.empty() ? 0 : chunks.back().firstLine + chunks.back().lines;
+        if (lines < vFirst + vertex->count || (edge && lines < eFirst + edge->count)) {
+            fprintf(stderr, "loader: %s is truncated\n", path.c_str());
+            return false;
+        }
+        pool.parallelFor(chunks.size(), [&](size_t c) {
+            std::vector<double> v(std::max(vFields, eFields));
+            eachLine(chunks[c], [&](size_t line, const char * p, const char * e) {
+                if (line >= vFirst && line < vFirst + vertex->count) {
+                    if (parseLine(p, e, v.data(), vFields) < vFields) { bad++; return; }
+                    const size_t i = line - vFirst;
+                    out.pos[i] = glm::fvec3(v[vi[0]], v[vi[1]], v[vi[2]]);
+                    if (colors) out.col[i] = glm::fvec3(v[vi[3]], v[vi[4]], v[vi[5]]) * colorScale;
+                } else if (edge && line >= eFirst && line < eFirst + edge->count) {
+                    if (parseLine(p, e, v.data(), eFields) < eFields) { bad++; return; }
+                    const size_t i = line - eFirst;
+                    out.edges[2 * i] = (uint32_t)v[ei[0]];
+                    out.edges[2 * i + 1] = (uint32_t)v[ei[1]];
+                }
+            });
+        });
+    } else {
+        const uint16_t one = 1;
+        const bool swap = (format == PLY_BIG) == (*(const unsigned char *)&one == 1);
+        const unsigned char * p = (const unsigned char *)f.data + body, * end = (const unsigned char *)f.data + f.size;
+        for (auto & el : elements) {
+            // records of fixed size are read in parallel, others are walked to skip them
+            const size_t stride = el.stride;
+            if (&el != vertex && &el != edge) {
+                if (stride || el.props.empty())
+                    p += stride && el.count > (size_t)(end - p) / stride ? end - p : el.count * stride;
+                else for (size_t i = 0; i < el.count && p < end; i++) {
+                    size_t s = plyRecordSize(el, p, end, swap);
+                    if (!s) break;
+                    p += s;
+                }
+                if ((&el > vertex) && (!edge || &el > edge)) break; // nothing needed after this one
+                continue;
+            }
+            if (el.count > (size_t)(end - p) / stride) {
+                fprintf(stderr, "loader: %s is truncated\n", path.c_str());
+                return false;
+            }
+            std::vector<size_t> offset(el.props.size());
+            for (size_t i = 1; i < offset.size(); i++) offset[i] = offset[i - 1] + plySize[el.props[i - 1].type];
+            const size_t chunk = 1 << 16;
+            const unsigned char * base = p;
+            pool.parallelFor((el.count + chunk - 1) / chunk, [&](size_t c) {
+                for (size_t i = c * chunk; i < std::min(el.count, (c + 1) * chunk); i++) {
+                    const unsigned char * r = base + i * stride;
+                    auto value = [&](int k) { return plyValue(r + offset[k], el.props[k].type, swap); };
+                    if (&el == vertex) {
+                        out.pos[i] = glm::fvec3(value(vi[0]), value(vi[1]), value(vi[2]));
+                        if (colors) out.col[i] = glm::fvec3(value(vi[3]), value(vi[4]), value(vi[5])) * colorScale;
+                    } else {
+                        out.edges[2 * i] = (uint32_t)value(ei[0]);
+                        out.edges[2 * i + 1] = (uint32_t)value(ei[1]);
+                    }
+                }
+            });
+            p += el.count * stride;
+        }
+    }
+    if (bad) {
+        fprintf(stderr, "loader: %s has %zu unreadable lines\n", path.c_str(), bad.load());
+        return false;
+    }
+    return true;
+}
+
+// missing colors take the default, text colors above 1 are 0..255
+static void finishColors(std::vector<glm::fvec3> & col, const glm::fvec3 & fallback, bool rescale, TaskPool & pool) {
+    const size_t n = col.size(), chunk = 1 << 16, chunks = (n + chunk - 1) / chunk;
+    float scale = 1;
+    if (rescale) {
+        std::vector<float> top(chunks, 0);
+        pool.parallelFor(chunks, [&](size_t c) {
+            for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++)
+                top[c] = std::max(top[c], std::max(col[i].x, std::max(col[i].y, col[i].z)));
+        });
+        if (chunks && *std::max_element(top.begin(), top.end()) > 1) scale = 1 / 255.f;
+    }
+    pool.parallelFor(chunks, [&](size_t c) {
+        for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++)
+            col[i] = col[i].x < 0 ? fallback : col[i] * scale;
+    });
+}
+
+// about half the spacing of the points if they filled their bounding box
+static float autoRadius(const std::vector<glm::fvec3> & pos, TaskPool & pool) {
+    const size_t n = pos.size(), chunk = 1 << 16, chunks = (n + chunk - 1) / chunk;
+    if (!n) return 1;
+    std::vector<glm::fvec3> lo(chunks, glm::fvec3(INFINITY)), hi(chunks, glm::fvec3(-INFINITY));
+    pool.parallelFor(chunks, [&](size_t c) {
+        for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++) {
+            lo[c] = glm::min(lo[c], pos[i]);
+            hi[c] = glm::max(hi[c], pos[i]);
+        }
+    });
+    for (size_t c = 1; c < chunks; c++) {
+        lo[0] = glm::min(lo[0], lo[c]);
+        hi[0] = glm::max(hi[0], hi[c]);
+    }
+    float r = glm::length(hi[0] - lo[0]) / cbrtf((float)n) * 0.25f;
+    return std::isfinite(r) && r > 0 ? r : 1;
+}
+
+static std::string extension(const std::string & path) {
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || path.find_first_of("/\\", dot) != std::string::npos) return "";
+    std::string e = path.substr(dot + 1);
+    for (auto & c : e) c = (char)tolower((unsigned char)c);
+    return e;
+}
+
+std::unique_ptr<DrawerFactory> loadPointFile(const std::string & path, const PointFileOptions & opt) {
+    MappedFile f;
+    if (!f.open(path)) {
+        fprintf(stderr, "loader: cannot read %s\n", path.c_str());
+        return nullptr;
+    }
+    TaskPool pool(opt.threads);
+    const std::string ext = extension(path);
+    std::vector<glm::fvec3> pos, col;
+    if (ext == "ply") {
+        PlyData ply;
+        if (!loadPly(f, pool, ply, path)) return nullptr;
+        finishColors(ply.col, opt.color, false, pool);
+        if (ply.hasEdges) {
+            std::unique_ptr<LinesDrawerFactory> ldf = std::make_unique<LinesDrawerFactory>();
+            const size_t n = ply.edges.size(), chunk = 1 << 16;
+            ldf->pos.resize(n);
+            ldf->col.resize(n);
+            std::atomic<size_t> bad{ 0 };
+            pool.parallelFor((n + chunk - 1) / chunk, [&](size_t c) {
+                for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++) {
+                    const uint32_t v = ply.edges[i];
+                    if (v >= ply.pos.size()) { bad++; continue; }
+                    ldf->pos[i] = ply.pos[v];
+                    ldf->col[i] = ply.col[v];
+                }
+            });
+            if (bad) {
+                fprintf(stderr, "loader: %s has edges to missing vertices\n", path.c_str());
+                return nullptr;
+            }
+            ldf->vertexNumber = n;
+            return ldf;
+        }
+        pos = std::move(ply.pos);
+        col = std::move(ply.col);
+    } else if (ext == "xyz" || ext == "csv" || ext == "txt") {
+        loadText(f.data, f.data + f.size, pool, pos, col);
+        finishColors(col, opt.color, true, pool);
+    } else {
+        const size_t k = (size_t)std::max(3, opt.rawFloats), record = k * sizeof(float);
+        const size_t n = f.size / record, chunk = 1 << 16;
+        if (f.size % record)
+            fprintf(stderr, "loader: %s is not a whole number of %zu float records\n", path.c_str(), k);
+        pos.resize(n);
+        col.resize(n);
+        pool.parallelFor((n + chunk - 1) / chunk, [&](size_t c) {
+            for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++) {
+                float v[6];
+                memcpy(v, f.data + i * record, std::min(k, (size_t)6) * sizeof(float));
+                pos[i] = glm::fvec3(v[0], v[1], v[2]);
+                col[i] = k >= 6 ? glm::fvec3(v[3], v[4], v[5]) : opt.color;
+            }
+        });
+    }
+    std::unique_ptr<PointsDrawerFactory> pdf = std::make_unique<PointsDrawerFactory>();
+    pdf->particleRadius = opt.radius > 0 ? opt.radius : autoRadius(pos, pool);
+    pdf->particleNumber = pos.size();
+    pdf->pos = std::move(pos);
+    pdf->col = std::move(col);
+    return pdf;
+}
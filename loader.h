@@ -0,0 +1,30 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <glm/glm.hpp>
+
+#include "drawer.h"
+
+// point files written by other tools, parsed from a memory mapping straight
+// into drawer factories. text is cut into chunks at line breaks and the
+// chunks are parsed in parallel.
+//
+//   .ply              ascii, binary_little_endian or binary_big_endian. vertex
+//                     x y z and optionally red green blue (integer 0..255 or
+//                     float 0..1); an edge element (vertex1 vertex2) makes lines
+//   .xyz .csv .txt    x y z [r g b] per line, split by spaces, tabs, commas or
+//                     semicolons. '#' comments and header lines are skipped,
+//                     colors above 1 are taken as 0..255
+//   anything else     raw float32 records of rawFloats values, x y z [r g b]
+struct PointFileOptions {
+    float radius = 0;                    // 0 picks one from the point density
+    glm::fvec3 color = glm::fvec3(0.6f); // for files without colors
+    int rawFloats = 3;
+    int threads = -1;                    // as TaskPool
+};
+
+// a PointsDrawerFactory, or a LinesDrawerFactory for ply files with edges;
+// null if the file cannot be read
+std::unique_ptr<DrawerFactory> loadPointFile(const std::string & path,
+                                             const PointFileOptions & opt = PointFileOptions());
@@ -0,0 +1,295 @@
+#include "plots.h"
+#include "trace.h"
+#include "imgui.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+struct PlotSample {
+    uint64_t t;
+    double v;
+};
+
+// one series of one thread: single producer, the display as single consumer
+struct PlotRing {
+    static const size_t N = 4096;
+    PlotSample samples[N];
+    std::atomic<size_t> head{ 0 }, tail{ 0 };
+    std::atomic<size_t> dropped{ 0 };
+    std::string name;
+};
+
+static std::mutex registry_lock;
+static std::vector<std::unique_ptr<PlotRing>> rings;
+static std::atomic<size_t> defaultHistory{ 1 << 20 };
+
+namespace threedbg {
+
+void plot(const std::string & name, double value) {
+    static thread_local std::unordered_map<std::string, PlotRing *> mine;
+    PlotRing *& r = mine[name];
+    if (!r) {
+        std::lock_guard<std::mutex> lk(registry_lock);
+        rings.push_back(std::make_unique<PlotRing>());
+        r = rings.back().get();
+        r->name = name;
+    }
+    const size_t h = r->head.load(std::memory_order_relaxed);
+    if (h - r->tail.load(std::memory_order_acquire) == PlotRing::N) {
+        r->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    r->samples[h % PlotRing::N] = PlotSample{ trace::now(), value };
+    r->head.store(h + 1, std::memory_order_release);
+}
+
+void setPlotHistory(size_t samples) {
+    defaultHistory.store(std::max<size_t>(samples, 64));
+}
+
+}
+
+static size_t blockOf(size_t level) {
+    return (size_t)8 << 3 * level;
+}
+
+void PlotView::Series::append(double time, float value) {
+    // samples of different threads can arrive a little out of order
+    if (!t.empty() && time < t.back()) time = t.back();
+    t.push_back(time);
+    v.push_back(value);
+    const size_t i = v.size() - 1;
+    for (size_t k = 0; k < lo.size(); k++) {
+        const size_t b = i / blockOf(k);
+        if (b == lo[k].size()) {
+            lo[k].push_back(value);
+            hi[k].push_back(value);
+        } else {
+            lo[k][b] = std::min(lo[k][b], value);
+            hi[k][b] = std::max(hi[k][b], value);
+        }
+    }
+    if (v.size() > history) compact();
+    else if (v.size() > blockOf(lo.size())) rebuild();
+}
+
+void PlotView::Series::rebuild(void) {
+    lo.clear();
+    hi.clear();
+    for (size_t k = 0; blockOf(k) < v.size(); k++) {
+        // each level from 8 entries of the one below
+        const float * l = k ? lo[k - 1].data() : v.data();
+        const float * h = k ? hi[k - 1].data() : v.data();
+        const size_t n = k ? lo[k - 1].size() : v.size();
+        std::vector<float> nl, nh;
+        for (size_t i = 0; i < n; i += 8) {
+            const size_t e = std::min(n, i + 8);
+            nl.push_back(*std::min_element(l + i, l + e));
+            nh.push_back(*std::max_element(h + i, h + e));
+        }
+        lo.push_back(std::move(nl));
+        hi.push_back(std::move(nh));
+    }
+}
+
+// the older half keeps the minimum and maximum of every 4 samples, in the
+// order they came, so the curve's envelope survives
+void PlotView::Series::compact(void) {
+    const size_t half = v.size() / 8 * 4;
+    std::vector<double> nt;
+    std::vector<float> nv;
+    nt.reserve(v.size() - half / 2);
+    nv.reserve(v.size() - half / 2);
+    for (size_t i = 0; i < half; i += 4) {
+        const size_t a = std::min_element(&v[i], &v[i + 4]) - v.data();
+        const size_t b = std::max_element(&v[i], &v[i + 4]) - v.data();
+        nt.push_back(t[std::min(a, b)]); nv.push_back(v[std::min(a, b)]);
+        nt.push_back(t[std::max(a, b)]); nv.push_back(v[std::max(a, b)]);
+    }
+    nt.insert(nt.end(), t.begin() + half, t.end());
+    nv.insert(nv.end(), v.begin() + half, v.end());
+    t.swap(nt);
+    v.swap(nv);
+    rebuild();
+}
+
+// level 0 reads the samples, level k the blocks of 8^k around them
+void PlotView::Series::range(size_t i0, size_t i1, int level, float & mn, float & mx) const {
+    if (level == 0) {
+        for (size_t i = i0; i < i1; i++) {
+            mn = std::min(mn, v[i]);
+            mx = std::max(mx, v[i]);
+        }
+        return;
+    }
+    const size_t b = blockOf(level - 1);
+    for (size_t j = i0 / b; j <= (i1 - 1) / b; j++) {
+        mn = std::min(mn, lo[level - 1][j]);
+        mx = std::max(mx, hi[level - 1][j]);
+    }
+}
+
+void PlotView::collect(void) {
+    std::vector<PlotRing *> rs;
+    {
+        std::lock_guard<std::mutex> lk(registry_lock);
+        for (auto & r : rings) rs.push_back(r.get());
+    }
+    for (size_t i = ringSeries.size(); i < rs.size(); i++) {
+        size_t s = 0;
+        while (s < series.size() && series[s].name != rs[i]->name) s++;
+        if (s == series.size()) {
+            series.emplace_back();
+            series.back().name = rs[i]->name;
+            series.back().history = defaultHistory.load();
+        }
+        ringSeries.push_back(s);
+    }
+    // a series written by several threads is merged in time order
+    std::vector<std::vector<PlotSample>> batch(series.size());
+    for (auto & s : series) s.dropped = 0;
+    for (size_t i = 0; i < rs.size(); i++) {
+        PlotRing * r = rs[i];
+        std::vector<PlotSample> & b = batch[ringSeries[i]];
+        const size_t t = r->tail.load(std::memory_order_relaxed);
+        const size_t h = r->head.load(std::memory_order_acquire);
+        const size_t n = b.size();
+        for (size_t k = t; k < h; k++) b.push_back(r->samples[k % PlotRing::N]);
+        r->tail.store(h, std::memory_order_release);
+        series[ringSeries[i]].dropped += r->dropped.load(std::memory_order_relaxed);
+        if (n && h > t)
+            std::inplace_merge(b.begin(), b.begin() + n, b.end(),
+                               [](const PlotSample & x, const PlotSample & y) { return x.t < y.t; });
+    }
+    for (size_t s = 0; s < series.size(); s++) {
+        for (auto & p : batch[s]) series[s].append(p.t * 1e-9, (float)p.v);
+        if (!series[s].t.empty()) latest = std::max(latest, series[s].t.back());
+    }
+}
+
+static ImU32 colorOf(size_t index) {
+    return ImColor::HSV(fmodf(index * 0.618034f, 1.f), 0.6f, 0.95f);
+}
+
+void PlotView::strip(Series & s, size_t index, double t0, double t1) {
+    ImDrawList * dl = ImGui::GetWindowDrawList();
+    const ImVec2 a = ImGui::GetItemRectMin(), b = ImGui::GetItemRectMax();
+    dl->AddRectFilled(a, b, ImGui::GetColorU32(ImGuiCol_FrameBg));
+    const float w = b.x - a.x;
+    const int cols = std::max(1, (int)w);
+    size_t i0 = std::lower_bound(s.t.begin(), s.t.end(), t0) - s.t.begin();
+    size_t i1 = std::upper_bound(s.t.begin(), s.t.end(), t1) - s.t.begin();
+    // one sample past each edge so the curve leaves the strip
+    if (i0 > 0) i0--;
+    if (i1 < s.t.size()) i1++;
+    static std::vector<ImVec2> pts; // display thread only
+    pts.clear();
+    float mn = INFINITY, mx = -INFINITY;
+    if (i1 > i0 && i1 - i0 <= 2 * (size_t)cols) {
+        for (size_t i = i0; i < i1; i++) {
+            pts.push_back(ImVec2(a.x + (float)((s.t[i] - t0) / (t1 - t0)) * w, s.v[i]));
+            if (s.t[i] >= t0 && s.t[i] <= t1) {
+                mn = std::min(mn, s.v[i]);
+                mx = std::max(mx, s.v[i]);
+            }
+        }
+    } else if (i1 > i0) {
+        // a level whose blocks are a quarter of a column or less
+        const double per = (double)(i1 - i0) / cols;
+        int level = 0;
+        while (level < (int)s.lo.size() && blockOf(level) * 4 <= per) level++;
+        size_t i = i0;
+        for (int c = 0; c < cols && i < i1; c++) {
+            const double edge = t0 + (c + 1) * (t1 - t0) / cols;
+            const size_t j = c == cols - 1 ? i1 : std::upper_bound(s.t.begin() + i, s.t.begin() + i1, edge) - s.t.begin();
+            if (j == i) continue;
+            float l = INFINITY, h = -INFINITY;
+            s.range(i, j, level, l, h);
+            pts.push_back(ImVec2(a.x + c, l));
+            pts.push_back(ImVec2(a.x + c, h));
+            mn = std::min(mn, l);
+            mx = std::max(mx, h);
+            i = j;
+        }
+    }
+    if (mn > mx) {
+        // nothing inside, scale to what is drawn
+        for (auto & p : pts) { mn = std::min(mn, p.y); mx = std::max(mx, p.y); }
+    }
+    if (mn == mx) { mn -= 0.5f; mx += 0.5f; }
+    const float pad = 2, h = b.y - a.y - 2 * pad;
+    for (auto & p : pts) p.y = a.y + pad + (mx - p.y) / (mx - mn) * h;
+    dl->PushClipRect(a, b, true);
+    if (pts.size() == 1) dl->AddCircleFilled(pts[0], 1.5f, colorOf(index));
+    else if (pts.size() > 1) dl->AddPolyline(pts.data(), (int)pts.size(), colorOf(index), false, 1);
+    char text[128];
+    if (!s.v.empty()) snprintf(text, sizeof(text), "%s %.6g", s.name.c_str(), s.v.back());
+    else snprintf(text, sizeof(text), "%s", s.name.c_str());
+    const ImU32 fg = ImGui::GetColorU32(ImGuiCol_Text);
+    dl->AddText(ImVec2(a.x + 4, a.y + pad), fg, text);
+    snprintf(text, sizeof(text), "%.4g", mx);
+    dl->AddText(ImVec2(b.x - ImGui::CalcTextSize(text).x - 4, a.y + pad), fg, text);
+    snprintf(text, sizeof(text), "%.4g", mn);
+    dl->AddText(ImVec2(b.x - ImGui::CalcTextSize(text).x - 4, b.y - pad - ImGui::GetTextLineHeight()), fg, text);
+    dl->PopClipRect();
+
+    if (ImGui::IsItemHovered() && !s.t.empty()) {
+        const float x = ImGui::GetIO().MousePos.x;
+        dl->AddLine(ImVec2(x, a.y), ImVec2(x, b.y), fg);
+        const double tm = t0 + (x - a.x) / w * (t1 - t0);
+        size_t k = std::lower_bound(s.t.begin(), s.t.end(), tm) - s.t.begin();
+        if (k == s.t.size() || (k > 0 && tm - s.t[k - 1] < s.t[k] - tm)) k--;
+        if (s.dropped)
+            ImGui::SetTooltip("%s\nt %.4f s\n%.6g\n%zu samples, %zu dropped", s.name.c_str(), s.t[k], s.v[k], s.t.size(), s.dropped);
+        else
+            ImGui::SetTooltip("%s\nt %.4f s\n%.6g\n%zu samples", s.name.c_str(), s.t[k], s.v[k], s.t.size());
+    }
+}
+
+void PlotView::Show(void) {
+    ImGuiIO & io = ImGui::GetIO();
+    const double t1 = follow ? latest : end, t0 = t1 - span;
+    ImGui::Checkbox("follow", &follow);
+    ImGui::SameLine();
+    ImGui::PushItemWidth(160);
+    ImGui::InputText("filter", filter, sizeof(filter));
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    ImGui::Text("%.4g s", span);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("drag to pan, ctrl + wheel to zoom\ndouble click to follow the newest samples");
+
+    ImGui::BeginChild("series");
+    const float width = std::max(ImGui::GetContentRegionAvailWidth(), 1.f);
+    const float height = 3 * ImGui::GetTextLineHeightWithSpacing();
+    for (size_t k = 0; k < series.size(); k++) {
+        Series & s = series[k];
+        if (filter[0] && !strstr(s.name.c_str(), filter)) continue;
+        ImGui::PushID((int)k);
+        ImGui::InvisibleButton("strip", ImVec2(width, height));
+        const float x = ImGui::GetItemRectMin().x;
+        if (ImGui::IsItemActive() && io.MouseDelta.x != 0) {
+            end = t1 - io.MouseDelta.x / width * span;
+            follow = false;
+        }
+        if (ImGui::IsItemHovered()) {
+            if (io.KeyCtrl && io.MouseWheel != 0) {
+                // keeps the time under the cursor in place
+                const double c = t0 + (io.MousePos.x - x) / width * span;
+                const double f = pow(0.8, io.MouseWheel);
+                span = std::min(std::max(span * f, 1e-6), 1e7);
+                if (!follow) end = c + (t1 - c) * f;
+            }
+            if (ImGui::IsMouseDoubleClicked(0)) follow = true;
+        }
+        if (ImGui::IsItemVisible()) strip(s, k, t0, t1);
+        ImGui::PopID();
+    }
+    ImGui::EndChild();
+}
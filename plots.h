@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace threedbg {
+
+// appends a sample to the named time series, shown in the viewer's "plots"
+// window. each thread writes into its own ring per series without locks, a
+// full ring drops samples until the display thread catches up.
+//
+//   threedbg::plot("energy", e);
+void plot(const std::string & name, double value);
+// samples the display keeps per series at full resolution, older ones are
+// thinned to their minima and maxima. applies to series created afterwards
+void setPlotHistory(size_t samples);
+
+}
+
+// the display side: merges the rings into series and draws each in a strip
+// decimated to min/max per pixel column, so the cost follows the width and
+// not the sample count. the strips share one time axis; drag pans, the wheel
+// zooms and a double click goes back to following the newest samples
+class PlotView {
+public:
+    struct Series {
+        std::string name;
+        std::vector<double> t; // seconds, sorted
+        std::vector<float> v;
+        // min/max over blocks of 8^(k+1) samples
+        std::vector<std::vector<float>> lo, hi;
+        size_t history;
+        size_t dropped = 0; // by the producers, full rings
+        void append(double time, float value);
+        void range(size_t i0, size_t i1, int level, float & mn, float & mx) const;
+    private:
+        void rebuild(void);
+        void compact(void);
+    };
+    void collect(void);
+    bool empty(void) const { return series.empty(); }
+    void Show(void);
+private:
+    std::vector<Series> series;
+    std::vector<size_t> ringSeries; // series of each ring seen so far
+    bool follow = true;
+    double span = 10, end = 0, latest = 0;
+    char filter[64] = "";
+    void strip(Series & s, size_t index, double t0, double t1);
+};
@@ -1,5 +1,7 @@
 #include "points.h"
 
+#include <algorithm>
+
 static const char vert_src[] = R"(
 #version 330
 uniform mat4 VP;
@@ -28,12 +30,16 @@ void main() {
 
 static const char frag_src[] = R"(
 #version 330
+uniform uint drawerId;
 in float fDepthA;
 in float fDepthB;
 in float fDist;
 in float fBallRadius;
 in float fEdgeWidth;
 in vec3 fCol;
+layout (location = 0) out vec4 fragColor;
+layout (location = 1) out float fragDist;
+layout (location = 2) out uvec2 fragId;
 void main() {
     vec2 pc = gl_PointCoord * 2.0 - 1.0;
     float l2 = dot(pc, pc);
@@ -43,7 +49,9 @@ void main() {
     gl_FragDepth = (gl_FragDepth + 1.0) / 2.0; // [-1, 1] normalized to [0, 1]
     vec3 col = fCol;
     col *= 1.0 - smoothstep(1.0-fEdgeWidth*2.0,1.0-fEdgeWidth,l2) + smoothstep(1.0-fEdgeWidth,1.0,l2);
-    gl_FragColor = vec4(col, 1.0);
+    fragColor = vec4(col, 1.0);
+    fragDist = dist;
+    fragId = uvec2(drawerId, uint(gl_PrimitiveID));
 }
 )";
 
@@ -83,11 +91,21 @@ void PointsDrawer::draw(const struct draw_param & dp) {
     glUniform1f(vUnitSizeLoc, dp.cam.resolution[1]/dp.cam.getFovy());
     int radiusLoc = glGetUniformLocation(program, "radius");
     glUniform1f(radiusLoc, particleRadius);
+    int drawerIdLoc = glGetUniformLocation(program, "drawerId");
+    glUniform1ui(drawerIdLoc, dp.drawerId);
     glBindVertexArray(vao);
     glDrawArrays(GL_POINTS, 0, particleNumber);
     glCheckError();
 }
 
+bool PointsDrawer::view(DrawerView & v) const {
+    v.type = "points";
+    v.params = { particleRadius };
+    v.vertices = particleNumber;
+    v.buffers = { buffers[0], buffers[1] };
+    return true;
+}
+
 PointsDrawer::~PointsDrawer() {
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(sizeof(buffers)/sizeof(buffers[0]), buffers);
@@ -95,13 +113,50 @@ PointsDrawer::~PointsDrawer() {
 }
 
 PointsDrawer * PointsDrawerFactory::createPointDrawer() {
+    FactoryView v;
+    view(v);
+    PointsDrawer * p = static_cast<PointsDrawer *>(upload(v));
+    p->particleNumber = std::min(p->particleNumber, particleNumber);
+    return p;
+}
+
+bool PointsDrawerFactory::view(FactoryView & v) const {
+    v.type = "points";
+    v.params = { particleRadius };
+    v.streams = { { pos.data(), pos.size() * sizeof(pos[0]) }, { col.data(), col.size() * sizeof(col[0]) } };
+    return true;
+}
+
+// whole vertices that have both a position and a color, views may come
+// from other processes
+static size_t count(const FactoryView & v) {
+    return std::min(v.streams[0].bytes, v.streams[1].bytes) / sizeof(glm::fvec3);
+}
+
+std::unique_ptr<DrawerFactory> PointsDrawerFactory::load(const FactoryView & v) {
+    if (v.params.size() < 1 || v.streams.size() < 2) return nullptr;
+    auto f = std::make_unique<PointsDrawerFactory>();
+    const glm::fvec3 * p = (const glm::fvec3 *)v.streams[0].data;
+    const glm::fvec3 * c = (const glm::fvec3 *)v.streams[1].data;
+    f->particleRadius = v.params[0];
+    f->pos.assign(p, p + count(v));
+    f->col.assign(c, c + count(v));
+    f->particleNumber = f->pos.size();
+    return f;
+}
+
+// builds the drawer from the view's memory without an intermediate factory
+Drawer * PointsDrawerFactory::upload(const FactoryView & v) {
+    if (v.params.size() < 1 || v.streams.size() < 2) return nullptr;
     PointsDrawer * p = new PointsDrawer();
-    p->particleNumber = particleNumber;
-    p->particleRadius = particleRadius;
+    p->particleNumber = count(v);
+    p->particleRadius = v.params[0];
     glBindBuffer(GL_ARRAY_BUFFER, p->buffers[0]);
-    glBufferData(GL_ARRAY_BUFFER, pos.size() * sizeof(pos[0]), pos.data(), GL_DYNAMIC_DRAW);
+    const size_t bytes = p->particleNumber * sizeof(glm::fvec3);
+    glBufferData(GL_ARRAY_BUFFER, bytes, v.streams[0].data, GL_DYNAMIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, p->buffers[1]);
-    glBufferData(GL_ARRAY_BUFFER, col.size() * sizeof(col[0]), col.data(), GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, bytes, v.streams[1].data, GL_DYNAMIC_DRAW);
+    p->gpuBytes = 2 * bytes;
     glCheckError();
     return p;
 }
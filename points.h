@@ -3,6 +3,7 @@
 #include "drawer.h"
 
 #include <vector>
+#include <memory>
 #include <glm/glm.hpp>
 
 struct PointsDrawer : Drawer {
@@ -17,12 +18,19 @@ struct PointsDrawer : Drawer {
     PointsDrawer();
     virtual ~PointsDrawer() override;
     virtual void draw(const struct draw_param &) override;
+    virtual bool view(DrawerView & v) const override;
 };
 
 struct PointsDrawerFactory : DrawerFactory {
     virtual Drawer * createDrawer() override {
         return createPointDrawer();
     }
+    virtual bool view(FactoryView & v) const override;
+    virtual size_t hostBytes() const override {
+        return (pos.capacity() + col.capacity()) * sizeof(glm::fvec3);
+    }
+    static std::unique_ptr<DrawerFactory> load(const FactoryView & v);
+    static Drawer * upload(const FactoryView & v);
     size_t particleNumber;
     float particleRadius;
     std::vector<glm::fvec3> pos, col;
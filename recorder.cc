@@ -0,0 +1,176 @@
+#include "recorder.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#define popen _popen
+#define pclose _pclose
+#endif
+
+// an exiting encoder must not kill the simulation. SIGPIPE is blocked only
+// on the threads writing to the pipe, the pending one is consumed afterwards,
+// so the program's own handler stays as it was
+struct PipeSignalGuard {
+#ifndef _WIN32
+    sigset_t set, old;
+    PipeSignalGuard() {
+        sigemptyset(&set);
+        sigaddset(&set, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &set, &old);
+    }
+    ~PipeSignalGuard() {
+        const timespec zero = { 0, 0 };
+        while (sigtimedwait(&set, nullptr, &zero) > 0) {}
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    }
+#endif
+};
+
+static bool makeDir(const std::string & dir) {
+#ifdef _WIN32
+    int r = _mkdir(dir.c_str());
+#else
+    int r = mkdir(dir.c_str(), 0755);
+#endif
+    return r == 0 || errno == EEXIST;
+}
+
+Recorder::Recorder(std::string d, std::string fmt, size_t queueSize, int threads)
+    : dir(std::move(d)), capacity(queueSize ? queueSize : 1) {
+    if (dir.empty()) dir = ".";
+    if (!makeDir(dir)) {
+        fprintf(stderr, "recorder: cannot create directory %s\n", dir.c_str());
+        ok = false; return;
+    }
+    if (fmt == "png") format = FORMAT_PNG;
+    else if (fmt == "y4m") format = FORMAT_Y4M;
+    else if (fmt.compare(0, 5, "pipe:") == 0) {
+        format = FORMAT_PIPE;
+        std::string cmd = "cd \"" + dir + "\" && " + fmt.substr(5);
+        pipe = popen(cmd.c_str(), "w");
+        if (!pipe) {
+            fprintf(stderr, "recorder: cannot run %s\n", cmd.c_str());
+            ok = false; return;
+        }
+    } else {
+        fprintf(stderr, "recorder: unknown format %s\n", fmt.c_str());
+        ok = false; return;
+    }
+    // png frames are independent, the stream formats are written in order
+    // but their rgb->yuv conversion still runs in parallel
+    if (threads <= 0) {
+        threads = std::thread::hardware_concurrency() / 4;
+        if (threads < 1) threads = 1;
+        if (threads > 4) threads = 4;
+    }
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back([this] { work(); });
+}
+
+Recorder::~Recorder() {
+    finish();
+}
+
+Recorder::Stats Recorder::finish() {
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        stopping = true;
+        ok = false;
+    }
+    cv.notify_all();
+    for (auto & t : workers) t.join();
+    workers.clear();
+    PipeSignalGuard guard; // flushing the stream writes to the pipe
+    y4m.close();
+    if (pipe) pclose(pipe);
+    pipe = nullptr;
+    return st;
+}
+
+bool Recorder::reserve() {
+    std::unique_lock<std::mutex> lk(mtx);
+    if (!ok || pending >= capacity) {
+        st.dropped++;
+        return false;
+    }
+    pending++;
+    return true;
+}
+
+std::vector<unsigned char> Recorder::buffer() {
+    std::unique_lock<std::mutex> lk(mtx);
+    if (pool.empty()) return std::vector<unsigned char>();
+    std::vector<unsigned char> b = std::move(pool.back());
+    pool.pop_back();
+    return b;
+}
+
+void Recorder::push(int w, int h, std::vector<unsigned char> && pixels) {
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        queue.push_back(Frame{ next_index++, w, h, std::move(pixels) });
+        st.queued++;
+    }
+    cv.notify_one();
+}
+
+Recorder::Stats Recorder::stats() {
+    std::unique_lock<std::mutex> lk(mtx);
+    return st;
+}
+
+void Recorder::work() {
+    PipeSignalGuard guard;
+    while (true) {
+        Frame f;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            while (queue.empty() && !stopping) cv.wait(lk);
+            if (queue.empty()) return;
+            f = std::move(queue.front());
+            queue.pop_front();
+        }
+        encode(f);
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            pending--;
+            pool.push_back(std::move(f.pixels));
+        }
+    }
+}
+
+void Recorder::encode(Frame & f) {
+    bool written = false;
+    if (format == FORMAT_PNG) {
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%06zu.png", f.index);
+        written = writePng(dir + name, f.pixels.data(), f.w, f.h, 4, true);
+        std::unique_lock<std::mutex> lk(mtx);
+        if (written) st.written++;
+        else st.dropped++;
+        return;
+    }
+    std::vector<unsigned char> yuv;
+    Y4mWriter::convert(yuv, f.pixels.data(), f.w, f.h, true);
+    // separate lock, so a slow disk or encoder never blocks reserve()/push()
+    std::unique_lock<std::mutex> lk(write_mtx);
+    while (next_write != f.index) cv_order.wait(lk);
+    // the stream is opened with the first frame, later frames must match its size
+    if (next_write == 0) {
+        if (format == FORMAT_Y4M) y4m.open(dir + "/record.y4m", f.w, f.h);
+        else y4m.open(pipe, f.w, f.h);
+    }
+    if (f.w == y4m.getWidth() && f.h == y4m.getHeight())
+        written = y4m.writeFrame(yuv);
+    else
+        fprintf(stderr, "recorder: frame %zu is %dx%d, stream is %dx%d, skipped\n",
+                f.index, f.w, f.h, y4m.getWidth(), y4m.getHeight());
+    next_write++;
+    lk.unlock();
+    cv_order.notify_all();
+    std::unique_lock<std::mutex> slk(mtx);
+    if (written) st.written++;
+    else st.dropped++;
+}
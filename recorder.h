@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "image_io.h"
+
+// background encoder for snapshot sequences. frames are queued by the
+// simulation thread and compressed by a small pool of workers; when the
+// queue is full the frame is dropped instead of stalling the caller.
+class Recorder {
+public:
+    enum { FORMAT_PNG, FORMAT_Y4M, FORMAT_PIPE };
+    struct Stats {
+        size_t queued = 0, written = 0, dropped = 0;
+    };
+    // format: "png" (dir/frame_000000.png ...), "y4m" (dir/record.y4m) or
+    // "pipe:<command>", which streams y4m into the stdin of <command> run in dir
+    Recorder(std::string dir, std::string format, size_t queueSize = 8, int threads = 0);
+    ~Recorder();
+    // encodes everything still queued and closes the output
+    Stats finish();
+    bool good() const { return ok; }
+    // reserve a queue slot before reading back a frame, false means dropped
+    bool reserve();
+    // recycled pixel buffer to read a reserved frame into
+    std::vector<unsigned char> buffer();
+    // hand over rgba pixels (bottom-up rows) for a reserved slot
+    void push(int w, int h, std::vector<unsigned char> && pixels);
+    Stats stats();
+private:
+    struct Frame {
+        size_t index;
+        int w, h;
+        std::vector<unsigned char> pixels;
+    };
+    std::string dir;
+    int format;
+    size_t capacity;
+    bool ok = true;
+    bool stopping = false;
+
+    std::mutex mtx, write_mtx;
+    std::condition_variable cv, cv_order;
+    std::deque<Frame> queue;
+    std::vector<std::vector<unsigned char>> pool;
+    size_t pending = 0, next_index = 0, next_write = 0;
+    Stats st;
+    std::vector<std::thread> workers;
+
+    FILE * pipe = nullptr;
+    Y4mWriter y4m;
+
+    void work();
+    void encode(Frame & f);
+};
@@ -0,0 +1,664 @@
+#include "remote.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#endif
+
+using namespace remote;
+
+// ring records that never reach the caller
+static const uint32_t RING_PAD = 0xffff0000, RING_SOCKET = 0xffff0001;
+
+#ifndef _WIN32
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SO_NOSIGPIPE is set instead
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+struct Header {
+    uint32_t type, flags;
+    uint64_t size;
+};
+
+// "unix:/path", "tcp:host:port" or "host:port". quiet leaves failed connects
+// unreported, for callers that retry
+static int openSocket(const std::string & address, bool server, std::string & unixPath, bool quiet = false) {
+    if (address.compare(0, 5, "unix:") == 0) {
+        sockaddr_un sa = {};
+        sa.sun_family = AF_UNIX;
+        std::string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(sa.sun_path)) {
+            fprintf(stderr, "remote: bad socket path %s\n", path.c_str());
+            return -1;
+        }
+        memcpy(sa.sun_path, path.c_str(), path.size() + 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        int r;
+        if (server) {
+            unlink(path.c_str()); // left behind by a viewer that did not exit cleanly
+            r = bind(fd, (sockaddr *)&sa, sizeof(sa));
+            if (r == 0) r = ::listen(fd, 64);
+            unixPath = path;
+        } else {
+            r = ::connect(fd, (sockaddr *)&sa, sizeof(sa));
+        }
+        if (r != 0) {
+            if (server || !quiet) fprintf(stderr, "remote: %s: %s\n", address.c_str(), strerror(errno));
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    std::string hp = address.compare(0, 4, "tcp:") == 0 ? address.substr(4) : address;
+    size_t colon = hp.rfind(':');
+    if (colon == std::string::npos) {
+        fprintf(stderr, "remote: address %s has no port\n", address.c_str());
+        return -1;
+    }
+    std::string host = hp.substr(0, colon), port = hp.substr(colon + 1);
+    addrinfo hints = {}, * res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = server ? AI_PASSIVE : 0;
+    int e = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res);
+    if (e != 0) {
+        fprintf(stderr, "remote: %s: %s\n", address.c_str(), gai_strerror(e));
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo * ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        if (server) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(fd, 64) == 0) break;
+        } else if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            // requests are small and answered one by one
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0 && (server || !quiet))
+        fprintf(stderr, "remote: cannot %s %s\n", server ? "listen on" : "connect to", address.c_str());
+    return fd;
+}
+
+static void noSigpipe(int fd) {
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#else
+    (void)fd;
+#endif
+}
+
+SocketTransport::~SocketTransport() {
+    for (int f : fds) ::close(f);
+    ::close(fd);
+}
+
+std::unique_ptr<SocketTransport> SocketTransport::connect(const std::string & address, int retryMs) {
+    std::string unused;
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(retryMs);
+    int fd;
+    while ((fd = openSocket(address, false, unused, true)) < 0 && std::chrono::steady_clock::now() < until)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    if (fd < 0) fd = openSocket(address, false, unused); // once more to report why
+    if (fd < 0) return nullptr;
+    noSigpipe(fd);
+    return std::make_unique<SocketTransport>(fd);
+}
+
+// the header and every payload piece go out in one gather list, so factory
+// buffers are copied only by the kernel
+bool SocketTransport::send(uint32_t type, const ScatterBuffer & payload, const std::vector<int> & fds) {
+    const Header head = { type, 0, (uint64_t)payload.total };
+    std::vector<iovec> iov;
+    iov.reserve(payload.pieces.size() + 1);
+    iov.push_back(iovec{ (void *)&head, sizeof(head) });
+    for (auto & p : payload.pieces)
+        iov.push_back(iovec{ (void *)payload.data(p), p.size });
+    std::vector<char> control(fds.empty() ? 0 : CMSG_SPACE(fds.size() * sizeof(int)));
+    size_t first = 0;
+    while (first < iov.size()) {
+        msghdr msg = {};
+        msg.msg_iov = &iov[first];
+        msg.msg_iovlen = std::min<size_t>(iov.size() - first, IOV_MAX);
+        if (first == 0 && !control.empty()) { // descriptors travel with the first byte
+            msg.msg_control = control.data();
+            msg.msg_controllen = control.size();
+            cmsghdr * c = CMSG_FIRSTHDR(&msg);
+            c->cmsg_level = SOL_SOCKET;
+            c->cmsg_type = SCM_RIGHTS;
+            c->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+            memcpy(CMSG_DATA(c), fds.data(), fds.size() * sizeof(int));
+        }
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        control.clear();
+        // skip what went out, partially sent pieces are advanced in place
+        while (first < iov.size() && (size_t)n >= iov[first].iov_len) n -= iov[first++].iov_len;
+        if (n > 0) {
+            iov[first].iov_base = (char *)iov[first].iov_base + n;
+            iov[first].iov_len -= n;
+        }
+    }
+    return true;
+}
+
+static bool readAll(int fd, void * data, size_t n) {
+    char * p = (char *)data;
+    while (n) {
+        ssize_t r = recv(fd, p, n, MSG_WAITALL);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+bool SocketTransport::receive(uint32_t & type, const unsigned char *& data, size_t & size) {
+    for (int f : fds) ::close(f);
+    fds.clear();
+    Header head;
+    iovec iov = { &head, sizeof(head) };
+    char control[CMSG_SPACE(4 * sizeof(int))];
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t r;
+    do r = recvmsg(fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    while (r < 0 && errno == EINTR);
+    if (r <= 0) return false;
+    for (cmsghdr * c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        size_t n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        fds.resize(n);
+        memcpy(fds.data(), CMSG_DATA(c), n * sizeof(int));
+    }
+    if ((size_t)r < sizeof(head) && !readAll(fd, (char *)&head + r, sizeof(head) - r)) return false;
+    type = head.type;
+    uint64_t n = head.size;
+    buffer.resize(n);
+    if (!readAll(fd, buffer.data(), n)) return false;
+    data = buffer.data();
+    size = n;
+    return true;
+}
+
+static bool readable(int fd) {
+    pollfd p = { fd, POLLIN, 0 };
+    return poll(&p, 1, 0) > 0;
+}
+
+bool SocketTransport::ready() {
+    return readable(fd);
+}
+
+bool SocketListener::listen(const std::string & address) {
+    close();
+    fd = openSocket(address, true, path);
+    return fd >= 0;
+}
+
+std::unique_ptr<SocketTransport> SocketListener::accept(int timeoutMs) {
+    if (fd < 0) return nullptr;
+    pollfd p = { fd, POLLIN, 0 };
+    if (poll(&p, 1, timeoutMs) <= 0) return nullptr;
+    int c = ::accept(fd, nullptr, nullptr);
+    if (c < 0) return nullptr;
+    int one = 1;
+    setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on unix sockets
+    noSigpipe(c);
+    return std::make_unique<SocketTransport>(c);
+}
+
+void SocketListener::close() {
+    if (fd >= 0) ::close(fd);
+    if (!path.empty()) unlink(path.c_str());
+    fd = -1;
+    path.clear();
+}
+#else
+SocketTransport::~SocketTransport() {}
+std::unique_ptr<SocketTransport> SocketTransport::connect(const std::string &, int) {
+    fprintf(stderr, "remote: viewer sockets are not supported on windows\n");
+    return nullptr;
+}
+bool SocketTransport::send(uint32_t, const ScatterBuffer &, const std::vector<int> &) { return false; }
+bool SocketTransport::receive(uint32_t &, const unsigned char *&, size_t &) { return false; }
+bool SocketTransport::ready() { return false; }
+bool SocketListener::listen(const std::string &) {
+    fprintf(stderr, "remote: viewer sockets are not supported on windows\n");
+    return false;
+}
+std::unique_ptr<SocketTransport> SocketListener::accept(int) { return nullptr; }
+void SocketListener::close() {}
+#endif
+
+#ifdef __linux__
+struct ShmTransport::Ring {
+    // shared header page, the data follows at offset 4096
+    struct Shared {
+        std::atomic<uint64_t> head; // bytes published by the client
+        char pad0[56];
+        std::atomic<uint64_t> tail; // bytes handed back by the viewer
+        char pad1[56];
+    };
+    static const size_t HEADER = 4096;
+    Shared * shared = nullptr;
+    unsigned char * data = nullptr;
+    size_t capacity = 0;
+    int memfd = -1, dataEvent = -1, spaceEvent = -1;
+    // viewer side: messages in ring order, released in any order
+    struct Span {
+        uint64_t start, end;
+        bool released;
+    };
+    std::mutex mtx;
+    std::deque<Span> spans;
+
+    ~Ring() {
+        if (shared) munmap(shared, HEADER + capacity);
+        for (int f : { memfd, dataEvent, spaceEvent })
+            if (f >= 0) ::close(f);
+    }
+    bool map() {
+        void * p = mmap(nullptr, HEADER + capacity, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (p == MAP_FAILED) return false;
+        shared = (Shared *)p;
+        data = (unsigned char *)p + HEADER;
+        return true;
+    }
+    static void signal(int fd) {
+        uint64_t one = 1;
+        ssize_t r = write(fd, &one, sizeof(one));
+        (void)r;
+    }
+    void push(uint64_t start, uint64_t end) {
+        std::lock_guard<std::mutex> lk(mtx);
+        spans.push_back(Span{ start, end, false });
+    }
+    // moves the tail over the released prefix
+    void release(uint64_t start) {
+        std::lock_guard<std::mutex> lk(mtx);
+        for (auto & s : spans)
+            if (s.start == start) s.released = true;
+        uint64_t tail = 0;
+        while (!spans.empty() && spans.front().released) {
+            tail = spans.front().end;
+            spans.pop_front();
+        }
+        if (tail) {
+            shared->tail.store(tail, std::memory_order_release);
+            signal(spaceEvent);
+        }
+    }
+};
+
+static size_t align16(size_t n) {
+    return (n + 15) & ~(size_t)15;
+}
+
+std::unique_ptr<Transport> ShmTransport::connect(const std::string & socketAddress, size_t capacity, int retryMs) {
+    std::unique_ptr<SocketTransport> s = SocketTransport::connect(socketAddress, retryMs);
+    if (!s) return nullptr;
+    const char * mib = getenv("THREEDBG_SHM_MIB");
+    if (!capacity) capacity = (size_t)std::max(1L, mib ? atol(mib) : 512L) << 20;
+    capacity = (capacity + 15) & ~(size_t)15;
+    auto ring = std::make_shared<Ring>();
+    ring->capacity = capacity;
+    ring->memfd = memfd_create("threedbg-ring", MFD_CLOEXEC);
+    ring->dataEvent = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    ring->spaceEvent = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ring->memfd < 0 || ring->dataEvent < 0 || ring->spaceEvent < 0 ||
+        ftruncate(ring->memfd, Ring::HEADER + capacity) != 0 || !ring->map()) {
+        fprintf(stderr, "remote: cannot create a %zu MiB shared ring: %s\n", capacity >> 20, strerror(errno));
+        return nullptr;
+    }
+    new (ring->shared) Ring::Shared();
+    ScatterBuffer b;
+    b.put((uint64_t)capacity);
+    if (!s->send(MSG_SHM, b, { ring->memfd, ring->dataEvent, ring->spaceEvent })) return nullptr;
+    std::unique_ptr<ShmTransport> t(new ShmTransport());
+    t->ring = std::move(ring);
+    t->socket = std::move(s);
+    return t;
+}
+
+std::unique_ptr<Transport> ShmTransport::accept(std::unique_ptr<SocketTransport> socket,
+                                                const unsigned char * data, size_t size) {
+    ByteReader r(data, size);
+    uint64_t capacity = r.get<uint64_t>();
+    struct stat st;
+    if (!r.ok || socket->fds.size() != 3 || capacity % 16 || fstat(socket->fds[0], &st) != 0 ||
+        (uint64_t)st.st_size < Ring::HEADER + capacity) {
+        fprintf(stderr, "remote: bad shared ring setup\n");
+        return nullptr;
+    }
+    auto ring = std::make_shared<Ring>();
+    ring->capacity = capacity;
+    ring->memfd = socket->fds[0];
+    ring->dataEvent = socket->fds[1];
+    ring->spaceEvent = socket->fds[2];
+    socket->fds.clear();
+    if (!ring->map()) {
+        fprintf(stderr, "remote: cannot map the shared ring: %s\n", strerror(errno));
+        return nullptr;
+    }
+    std::unique_ptr<ShmTransport> t(new ShmTransport());
+    t->server = true;
+    t->pos = ring->shared->tail.load(std::memory_order_acquire);
+    t->events = epoll_create1(EPOLL_CLOEXEC);
+    for (int f : { ring->dataEvent, socket->handle() }) {
+        epoll_event e = {};
+        e.events = EPOLLIN;
+        e.data.fd = f;
+        epoll_ctl(t->events, EPOLL_CTL_ADD, f, &e);
+    }
+    t->ring = std::move(ring);
+    t->socket = std::move(socket);
+    return t;
+}
+
+ShmTransport::~ShmTransport() {
+    if (pending && !retained) ring->release(current);
+    if (events >= 0) ::close(events);
+}
+
+int ShmTransport::handle() const {
+    return server ? events : socket->handle();
+}
+
+bool ShmTransport::ready() {
+    if (!server) return socket->ready();
+    // clear the wakeup first, a message published after the check signals again
+    uint64_t v;
+    ssize_t r = read(ring->dataEvent, &v, sizeof(v));
+    (void)r;
+    return ring->shared->head.load(std::memory_order_acquire) != pos || socket->ready();
+}
+
+bool ShmTransport::send(uint32_t type, const ScatterBuffer & payload) {
+    if (server) return socket->send(type, payload);
+    if (16 + align16(payload.total) > ring->capacity / 2) {
+        // announced in the ring so the viewer reads it in order
+        return put(RING_SOCKET, nullptr) && socket->send(type, payload);
+    }
+    return put(type, &payload);
+}
+
+// the client waits on the space eventfd; the socket only becomes readable
+// then if the viewer went away, as no request is outstanding
+bool ShmTransport::waitSpace(uint64_t need) {
+    while (pos + need - ring->shared->tail.load(std::memory_order_acquire) > ring->capacity) {
+        pollfd p[2] = { { ring->spaceEvent, POLLIN, 0 }, { socket->handle(), POLLIN, 0 } };
+        if (poll(p, 2, -1) < 0 && errno != EINTR) return false;
+        if (p[1].revents) return false;
+        uint64_t v;
+        ssize_t r = read(ring->spaceEvent, &v, sizeof(v));
+        (void)r;
+    }
+    return true;
+}
+
+bool ShmTransport::put(uint32_t type, const ScatterBuffer * payload) {
+    const uint64_t size = payload ? payload->total : 0, need = 16 + align16(size);
+    uint64_t at = pos % ring->capacity;
+    const uint64_t pad = at + need > ring->capacity ? ring->capacity - at : 0;
+    if (!waitSpace(pad + need)) return false;
+    if (pad) {
+        const Header h = { RING_PAD, 0, pad - 16 };
+        memcpy(ring->data + at, &h, sizeof(h));
+        pos += pad;
+        at = 0;
+    }
+    const Header h = { type, 0, size };
+    memcpy(ring->data + at, &h, sizeof(h));
+    unsigned char * dst = ring->data + at + sizeof(h);
+    if (payload) {
+        for (auto & p : payload->pieces) {
+            memcpy(dst, payload->data(p), p.size);
+            dst += p.size;
+        }
+    }
+    pos += need;
+    ring->shared->head.store(pos, std::memory_order_release);
+    Ring::signal(ring->dataEvent);
+    return true;
+}
+
+bool ShmTransport::waitData() {
+    epoll_event e[2];
+    int n = epoll_wait(events, e, 2, -1);
+    if (n < 0) return errno == EINTR;
+    for (int i = 0; i < n; i++) {
+        if (e[i].data.fd == ring->dataEvent) {
+            uint64_t v;
+            ssize_t r = read(ring->dataEvent, &v, sizeof(v));
+            (void)r;
+        } else {
+            // oversized messages are announced in the ring first, so a
+            // readable socket with an empty ring means the client is gone
+            char c;
+            ssize_t r = recv(socket->handle(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+            if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR)) return false;
+        }
+    }
+    return true;
+}
+
+bool ShmTransport::receive(uint32_t & type, const unsigned char *& data, size_t & size) {
+    if (!server) return socket->receive(type, data, size);
+    if (pending && !retained) ring->release(current);
+    pending = retained = false;
+    while (true) {
+        const uint64_t head = ring->shared->head.load(std::memory_order_acquire);
+        if (head == pos) {
+            if (!waitData()) return false;
+            continue;
+        }
+        const uint64_t at = pos % ring->capacity;
+        Header h;
+        memcpy(&h, ring->data + at, sizeof(h));
+        const uint64_t len = 16 + align16(h.size);
+        if (head - pos > ring->capacity || h.size > ring->capacity - at - 16 || len > head - pos) {
+            fprintf(stderr, "remote: damaged shared ring\n");
+            return false;
+        }
+        const uint64_t start = pos;
+        pos += len;
+        ring->push(start, pos);
+        if (h.type == RING_PAD) {
+            ring->release(start);
+            continue;
+        }
+        if (h.type == RING_SOCKET) {
+            ring->release(start);
+            return socket->receive(type, data, size);
+        }
+        type = h.type;
+        data = ring->data + at + 16;
+        size = h.size;
+        current = start;
+        pending = true;
+        return true;
+    }
+}
+
+std::shared_ptr<void> ShmTransport::retain() {
+    if (!pending || retained) return nullptr;
+    retained = true;
+    std::shared_ptr<Ring> r = ring;
+    const uint64_t start = current;
+    return std::shared_ptr<void>(ring->data + start % ring->capacity, [r, start](void *) { r->release(start); });
+}
+
+size_t ShmTransport::capacity() const {
+    return server ? ring->capacity : 0;
+}
+#else
+std::unique_ptr<Transport> ShmTransport::connect(const std::string &, size_t, int) {
+    fprintf(stderr, "remote: the shared memory transport needs linux\n");
+    return nullptr;
+}
+std::unique_ptr<Transport> ShmTransport::accept(std::unique_ptr<SocketTransport>, const unsigned char *, size_t) {
+    return nullptr;
+}
+ShmTransport::~ShmTransport() {}
+int ShmTransport::handle() const { return -1; }
+bool ShmTransport::ready() { return false; }
+bool ShmTransport::send(uint32_t, const ScatterBuffer &) { return false; }
+bool ShmTransport::receive(uint32_t &, const unsigned char *&, size_t &) { return false; }
+size_t ShmTransport::capacity() const { return 0; }
+std::shared_ptr<void> ShmTransport::retain() { return nullptr; }
+#endif
+
+bool RemoteClient::connect(const std::string & address, int rank, int ranks) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (address.compare(0, 4, "shm:") == 0) t = ShmTransport::connect("unix:" + address.substr(4));
+    else t = SocketTransport::connect(address);
+    if (!t) return false;
+    ScatterBuffer b;
+    b.put(VERSION);
+    b.put((int32_t)rank);
+    b.put((int32_t)ranks);
+    ok = true;
+    if (!request(MSG_HELLO, b) || !readState()) {
+        fprintf(stderr, "remote: no answer from the viewer at %s\n", address.c_str());
+        t.reset(nullptr);
+        ok = false;
+    }
+    return ok;
+}
+
+void RemoteClient::bye(bool closeViewer) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (!t) return;
+    ScatterBuffer b;
+    b.put((uint8_t)closeViewer);
+    t->send(MSG_BYE, b);
+    t.reset(nullptr);
+    ok = false;
+}
+
+bool RemoteClient::request(uint32_t type, const ScatterBuffer & b) {
+    uint32_t got;
+    if (!ok || !t->send(type, b) || !t->receive(got, reply, replySize) || got != type) {
+        if (ok) fprintf(stderr, "remote: lost the viewer\n");
+        ok = false;
+        return false;
+    }
+    return true;
+}
+
+bool RemoteClient::readState() {
+    ByteReader r(reply, replySize);
+    bool alive = r.get<uint8_t>() != 0;
+    const unsigned char * c = r.p;
+    Camera rc = getCamera(r);
+    synced.assign(c, r.p);
+    std::vector<std::string> inv = getStrings(r);
+    if (!r.ok) return false;
+    cam = rc;
+    invisible = std::move(inv);
+    return alive;
+}
+
+bool RemoteClient::addFactory(const std::string & name, const DrawerFactory & df) {
+    FactoryView v;
+    if (!df.view(v)) {
+        fprintf(stderr, "remote: drawer %s cannot be serialized, skipped\n", name.c_str());
+        return false;
+    }
+    ScatterBuffer b;
+    putFactory(b, name, v);
+    std::lock_guard<std::mutex> lk(mtx);
+    if (ok && !t->send(MSG_FACTORY, b)) {
+        fprintf(stderr, "remote: lost the viewer\n");
+        ok = false;
+    }
+    return ok;
+}
+
+bool RemoteClient::step() {
+    std::lock_guard<std::mutex> lk(mtx);
+    ScatterBuffer b;
+    putCamera(b, cam);
+    if (ok && (b.bytes.size() != synced.size() || memcmp(b.bytes.data(), synced.data(), synced.size())))
+        ok = t->send(MSG_SET_CAMERA, b);
+    b.clear();
+    if (!request(MSG_STEP, b)) return false;
+    ok = readState();
+    return ok;
+}
+
+bool RemoteClient::snapshot(int x, int y, int w, int h, int downsample, int format,
+                            int & outW, int & outH, std::vector<unsigned char> & pixels) {
+    std::lock_guard<std::mutex> lk(mtx);
+    ScatterBuffer b;
+    for (int32_t v : { x, y, w, h, downsample, format }) b.put(v);
+    outW = outH = 0;
+    if (!request(MSG_SNAPSHOT, b)) return false;
+    ByteReader r(reply, replySize);
+    int32_t rw = r.get<int32_t>(), rh = r.get<int32_t>();
+    bool done = r.get<uint8_t>() != 0;
+    r.align(16);
+    size_t n = r.end - r.p;
+    if (!r.ok || !done) return false;
+    outW = rw; outH = rh;
+    pixels.assign(r.p, r.p + n);
+    return true;
+}
+
+void RemoteClient::setInvisible(const std::vector<std::string> & tl) {
+    std::lock_guard<std::mutex> lk(mtx);
+    invisible = tl;
+    ScatterBuffer b;
+    putStrings(b, tl);
+    if (ok) ok = t->send(MSG_SET_INVISIBLE, b);
+}
+
+void RemoteClient::setMultisample(int samples) {
+    std::lock_guard<std::mutex> lk(mtx);
+    ScatterBuffer b;
+    b.put((int32_t)samples);
+    if (ok) ok = t->send(MSG_MULTISAMPLE, b);
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "serialize.h"
+
+// link between a simulation and a threedbg-viewer process.
+//
+//   address  "unix:/path/to/socket", "tcp:host:port" or "host:port", or
+//            "shm:/path/to/socket" for the shared memory ring (linux)
+//   message  u32 type u32 0 u64 size, then `size` bytes of payload encoded
+//            as in serialize.h, stream data 16-byte aligned to the payload
+//
+// the client sends factories and requests, the viewer answers every request
+// (HELLO, STEP, SNAPSHOT) in order, so one request is in flight at a time.
+// clients with a rank share the viewer: their drawers are named
+// "rank<r>/<name>" and a STEP is answered once every rank has sent one.
+namespace remote {
+const uint32_t VERSION = 2;
+enum : uint32_t {
+    MSG_HELLO = 1,     // u32 version i32 rank (-1 for none) i32 ranks; reply: state
+    MSG_FACTORY,       // putFactory
+    MSG_STEP,          // working(); reply: state
+    MSG_SNAPSHOT,      // i32 x y w h downsample format; reply: i32 w h u8 ok, pixels
+    MSG_SET_CAMERA,    // camera
+    MSG_SET_INVISIBLE, // strings
+    MSG_MULTISAMPLE,   // i32 samples
+    MSG_BYE,           // u8 close the viewer too
+    MSG_SHM,           // u64 capacity, ring memfd and two eventfds attached
+};
+// the state reply is u8 alive, camera, invisible drawers (of this rank)
+}
+
+class Transport {
+public:
+    virtual ~Transport() {}
+    // payload pieces are gathered straight from their buffers
+    virtual bool send(uint32_t type, const ScatterBuffer & payload) = 0;
+    // blocks for the next message, `data` stays valid until the next call
+    virtual bool receive(uint32_t & type, const unsigned char *& data, size_t & size) = 0;
+    // readable when a message may be waiting or the peer left, for poll()
+    virtual int handle() const = 0;
+    // a message or a hangup is waiting, checked without blocking
+    virtual bool ready() = 0;
+    // keeps the data of the last received message valid past the next
+    // receive(), until the handle is dropped. null if the transport cannot
+    virtual std::shared_ptr<void> retain() { return nullptr; }
+    // bytes retained messages can hold up before the sender blocks, 0 if
+    // nothing is retained
+    virtual size_t capacity() const { return 0; }
+};
+
+class SocketTransport : public Transport {
+public:
+    explicit SocketTransport(int fd) : fd(fd) {}
+    ~SocketTransport();
+    // retryMs keeps trying that long while nobody listens yet
+    static std::unique_ptr<SocketTransport> connect(const std::string & address, int retryMs = 0);
+    bool send(uint32_t type, const ScatterBuffer & payload) { return send(type, payload, {}); }
+    // unix sockets only: passes file descriptors along with the message
+    bool send(uint32_t type, const ScatterBuffer & payload, const std::vector<int> & fds);
+    bool receive(uint32_t & type, const unsigned char *& data, size_t & size);
+    int handle() const { return fd; }
+    bool ready();
+    // descriptors that came with the last message, closed by the next
+    // receive() unless taken
+    std::vector<int> fds;
+private:
+    int fd;
+    std::vector<unsigned char> buffer;
+};
+
+// single node path: client messages are copied once into a ring in a memfd
+// that both processes map, and the viewer uploads from it in place. replies
+// and messages over half the ring use the unix socket. records never wrap,
+// a padding record fills the end of the ring; spans are handed back in
+// order, so a retained message holds up the ones after it.
+class ShmTransport : public Transport {
+public:
+    // ring of `capacity` bytes, 0 takes THREEDBG_SHM_MIB or 512 MiB
+    static std::unique_ptr<Transport> connect(const std::string & socketAddress,
+                                              size_t capacity = 0, int retryMs = 0);
+    // viewer side, from the MSG_SHM message received on `socket`
+    static std::unique_ptr<Transport> accept(std::unique_ptr<SocketTransport> socket,
+                                             const unsigned char * data, size_t size);
+    ~ShmTransport();
+    bool send(uint32_t type, const ScatterBuffer & payload);
+    bool receive(uint32_t & type, const unsigned char *& data, size_t & size);
+    int handle() const;
+    bool ready();
+    std::shared_ptr<void> retain();
+    size_t capacity() const;
+private:
+    struct Ring;
+    std::shared_ptr<Ring> ring;
+    std::unique_ptr<SocketTransport> socket;
+    bool server = false;
+    uint64_t pos = 0;        // client: bytes written, viewer: bytes read
+    uint64_t current = 0;    // viewer: ring position of the last message
+    bool pending = false, retained = false;
+    int events = -1;         // viewer: epoll over the data eventfd and the socket
+    bool put(uint32_t type, const ScatterBuffer * payload);
+    bool waitSpace(uint64_t need);
+    bool waitData();
+};
+
+class SocketListener {
+public:
+    ~SocketListener() { close(); }
+    bool listen(const std::string & address);
+    // waits up to timeoutMs (-1 forever), null if nobody connected
+    std::unique_ptr<SocketTransport> accept(int timeoutMs = -1);
+    int handle() const { return fd; }
+    void close();
+private:
+    int fd = -1;
+    std::string path; // unix socket to unlink
+};
+
+// simulation side of the link, used by the threedbg functions when a
+// remote viewer is configured. safe to call from several threads
+class RemoteClient {
+public:
+    bool connect(const std::string & address, int rank = -1, int ranks = 0);
+    void bye(bool closeViewer);
+    bool addFactory(const std::string & name, const DrawerFactory & df);
+    // sends a camera changed through camera() since the last step, then waits
+    // for the viewer's working() and takes over its camera and visibility
+    bool step();
+    bool snapshot(int x, int y, int w, int h, int downsample, int format,
+                  int & outW, int & outH, std::vector<unsigned char> & pixels);
+    void setInvisible(const std::vector<std::string> & tl);
+    void setMultisample(int samples);
+    bool alive() const { return ok; }
+    Camera cam;
+    std::vector<std::string> invisible;
+private:
+    std::mutex mtx;
+    std::unique_ptr<Transport> t;
+    bool ok = false;
+    std::vector<unsigned char> synced; // camera as last received
+    const unsigned char * reply = nullptr;
+    size_t replySize = 0;
+    bool request(uint32_t type, const ScatterBuffer & b);
+    bool readState();
+};
@@ -0,0 +1,304 @@
+#include "threedbg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+// plays a capture file (see capture.h) back through the normal drawer
+// pipeline. interactive by default, --bench renders every frame headless and
+// reports frame times, upload volume and gpu time per drawer.
+
+typedef std::chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+// submits the drawers of one frame. factories whose record did not change
+// since the last submission are skipped, as the original program did not
+// resubmit them either. drawers the frame does not know yet are hidden.
+class Submitter {
+    std::map<std::string, uint64_t> shown;
+    std::set<std::string> absent;
+public:
+    size_t submit(const CaptureReader::Frame & f, bool followCapture) {
+        size_t bytes = 0;
+        std::set<std::string> names;
+        for (size_t i = 0; i < f.factories.size(); i++) {
+            const std::string & name = f.factories[i].first;
+            const FactoryView & v = f.factories[i].second;
+            names.insert(name);
+            auto it = shown.find(name);
+            if (it != shown.end() && it->second == f.offsets[i]) continue;
+            std::unique_ptr<DrawerFactory> df = loadFactory(v);
+            if (!df) continue;
+            for (auto & s : v.streams) bytes += s.bytes;
+            shown[name] = f.offsets[i];
+            threedbg::addDrawerFactory(name, std::move(df));
+        }
+        std::set<std::string> hidden;
+        if (followCapture) {
+            hidden.insert(f.invisible.begin(), f.invisible.end());
+        } else {
+            for (auto & n : threedbg::getInvisible())
+                if (absent.find(n) == absent.end()) hidden.insert(n);
+        }
+        absent.clear();
+        for (auto & s : shown)
+            if (names.find(s.first) == names.end()) absent.insert(s.first);
+        hidden.insert(absent.begin(), absent.end());
+        threedbg::setInvisible(std::vector<std::string>(hidden.begin(), hidden.end()));
+        if (followCapture) threedbg::camera() = f.cam;
+        return bytes;
+    }
+};
+
+struct Distribution {
+    std::vector<double> v;
+    void add(double x) { v.push_back(x); }
+    double sum() const { double s = 0; for (double x : v) s += x; return s; }
+    double mean() const { return v.empty() ? 0 : sum() / v.size(); }
+    // nearest rank
+    double percentile(double p) {
+        if (v.empty()) return 0;
+        std::sort(v.begin(), v.end());
+        size_t i = (size_t)std::max(0.0, p * 0.01 * v.size() - 1e-9);
+        return v[std::min(i, v.size() - 1)];
+    }
+    void print(FILE * fp, const char * name) {
+        fprintf(fp, "%-24s mean %8.3f  min %8.3f  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f ms\n",
+                name, mean(), percentile(0), percentile(50), percentile(90), percentile(99), percentile(100));
+    }
+    void json(FILE * fp, const char * name) {
+        fprintf(fp, "\"%s\": {\"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+                name, mean(), percentile(0), percentile(50), percentile(90), percentile(99), percentile(100));
+    }
+};
+
+static int bench(CaptureReader & reader, size_t first, size_t last, int repeat, const char * jsonPath) {
+    threedbg::showGui = false;
+    threedbg::init();
+    threedbg::setProfiling(true);
+    Distribution frameMs, decodeMs, renderMs;
+    std::map<std::string, Distribution> gpuMs;
+    size_t uploadBytes = 0, frames = 0;
+    CaptureReader::Frame f;
+    std::vector<unsigned char> pixels;
+    Clock::time_point start = Clock::now();
+    for (int pass = 0; pass < repeat; pass++) {
+        Submitter sub; // every pass starts from scratch, uploading all drawers again
+        for (size_t i = first; i < last; i++) {
+            Clock::time_point t0 = Clock::now();
+            if (!reader.frame(i, f)) {
+                fprintf(stderr, "replay: frame %zu is damaged, stopping\n", i);
+                last = i;
+                break;
+            }
+            double decode = msSince(t0);
+            Clock::time_point t1 = Clock::now();
+            uploadBytes += sub.submit(f, true);
+            // a one pixel readback waits for the frame without measuring the transfer
+            threedbg::SnapshotOptions opt;
+            opt.w = opt.h = 1;
+            int w, h;
+            threedbg::snapshot(opt, w, h, pixels);
+            renderMs.add(msSince(t1));
+            decodeMs.add(decode);
+            frameMs.add(msSince(t0));
+            for (auto & d : threedbg::drawerStats())
+                gpuMs[d.first].add(d.second.gpuMs);
+            frames++;
+        }
+    }
+    double total = msSince(start);
+    threedbg::free(false);
+
+    printf("%zu frames in %.1f ms, %.1f fps\n", frames, total, frames ? frames * 1000 / total : 0);
+    printf("upload %.2f MiB, %.1f KiB/frame, %.1f MiB/s\n", uploadBytes / 1048576.0,
+           frames ? uploadBytes / 1024.0 / frames : 0, total > 0 ? uploadBytes / 1048576.0 / total * 1000 : 0);
+    frameMs.print(stdout, "frame");
+    decodeMs.print(stdout, "  decode");
+    renderMs.print(stdout, "  upload + render");
+    for (auto & d : gpuMs) {
+        std::string name = "  gpu " + d.first;
+        d.second.print(stdout, name.c_str());
+    }
+    if (jsonPath) {
+        FILE * fp = fopen(jsonPath, "w");
+        if (!fp) {
+            fprintf(stderr, "replay: cannot write %s\n", jsonPath);
+            return 1;
+        }
+        fprintf(fp, "{\"frames\": %zu, \"totalMs\": %.3f, \"uploadBytes\": %zu,\n ", frames, total, uploadBytes);
+        frameMs.json(fp, "frameMs"); fprintf(fp, ",\n ");
+        decodeMs.json(fp, "decodeMs"); fprintf(fp, ",\n ");
+        renderMs.json(fp, "renderMs"); fprintf(fp, ",\n \"gpuMs\": {");
+        const char * sep = "\n  ";
+        for (auto & d : gpuMs) {
+            fprintf(fp, "%s", sep);
+            d.second.json(fp, d.first.c_str());
+            sep = ",\n  ";
+        }
+        fprintf(fp, "}\n}\n");
+        fclose(fp);
+    }
+    return 0;
+}
+
+// state shared between the replay loop and its panel on the display thread
+struct Player {
+    std::mutex mtx;
+    int frames = 0;
+    int target = 0;          // frame to show next
+    int shown = -1;
+    bool playing = true;
+    bool loop = false;
+    bool follow = true;      // take camera and visibility from the capture
+    float fps = -1;          // -1 follows the capture timestamps, 0 plays as fast as possible
+    float speed = 1;
+    bool restart = true;     // re-anchor the playback clock
+    size_t uploadBytes = 0;
+    double loadMs = 0;
+
+    void panel() {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (ImGui::Button(playing ? "pause" : "play")) { playing = !playing; restart = true; }
+        ImGui::SameLine();
+        if (ImGui::Button("<")) { playing = false; target = std::max(0, target - 1); }
+        ImGui::SameLine();
+        if (ImGui::Button(">")) { playing = false; target = std::min(frames - 1, target + 1); }
+        ImGui::SameLine();
+        ImGui::Checkbox("loop", &loop);
+        ImGui::SameLine();
+        ImGui::Checkbox("follow capture", &follow);
+        if (ImGui::SliderInt("frame", &target, 0, frames - 1)) restart = true;
+        int mode = fps < 0 ? 0 : fps == 0 ? 1 : 2;
+        if (ImGui::Combo("rate", &mode, "capture timing\0" "fastest\0" "fixed fps\0")) {
+            fps = mode == 0 ? -1 : mode == 1 ? 0 : 30;
+            restart = true;
+        }
+        if (mode == 0 && ImGui::SliderFloat("speed", &speed, 0.1f, 10.f, "%.1fx", 2.f)) restart = true;
+        if (mode == 2 && ImGui::SliderFloat("fps", &fps, 1.f, 240.f, "%.0f")) restart = true;
+        ImGui::Text("frame %d/%d, upload %.1f KiB, load %.2f ms", shown, frames, uploadBytes / 1024.0, loadMs);
+    }
+};
+
+static int play(CaptureReader & reader, Player & p) {
+    threedbg::showGui = true;
+    threedbg::init();
+    threedbg::addPanel("replay", [&p] { p.panel(); });
+    Submitter sub;
+    CaptureReader::Frame f;
+    Clock::time_point anchor;
+    double anchorTime = 0;
+    int anchorFrame = 0;
+    while (threedbg::working()) {
+        int next;
+        bool follow;
+        {
+            std::lock_guard<std::mutex> lk(p.mtx);
+            if (p.playing && p.shown == p.target) {
+                if (p.restart) {
+                    anchor = Clock::now();
+                    anchorFrame = p.shown;
+                    anchorTime = reader.time(p.shown);
+                    p.restart = false;
+                }
+                int candidate = p.shown + 1;
+                if (candidate >= p.frames) {
+                    if (p.loop) { candidate = 0; p.restart = true; }
+                    else { p.playing = false; candidate = p.shown; }
+                }
+                // is the candidate due yet
+                double elapsed = msSince(anchor) * 1e-3;
+                bool due = p.fps == 0 || p.restart;
+                if (!due && p.fps > 0) due = elapsed >= (candidate - anchorFrame) / p.fps;
+                if (!due && p.fps < 0) due = elapsed * p.speed >= reader.time(candidate) - anchorTime;
+                if (due) p.target = candidate;
+            }
+            if (!p.playing && p.restart) p.restart = false;
+            next = p.target;
+            follow = p.follow;
+        }
+        if (next == p.shown) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        Clock::time_point t0 = Clock::now();
+        if (!reader.frame(next, f)) {
+            fprintf(stderr, "replay: frame %d is damaged\n", next);
+            std::lock_guard<std::mutex> lk(p.mtx);
+            p.playing = false;
+            p.target = p.shown;
+            continue;
+        }
+        size_t bytes = sub.submit(f, follow);
+        std::lock_guard<std::mutex> lk(p.mtx);
+        p.shown = next;
+        p.uploadBytes = bytes;
+        p.loadMs = msSince(t0);
+    }
+    threedbg::free(false);
+    return 0;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: threedbg-replay <capture> [options]\n"
+            "  --fps <n>      fixed playback rate, 0 plays as fast as possible\n"
+            "                 (default: the timing of the capture)\n"
+            "  --speed <x>    multiplier for the capture timing\n"
+            "  --loop         restart at the end\n"
+            "  --start <i>    first frame\n"
+            "  --end <i>      one past the last frame\n"
+            "  --bench        render every frame headless and print statistics\n"
+            "  --repeat <n>   benchmark passes over the frame range\n"
+            "  --json <path>  also write the benchmark statistics as json\n");
+}
+
+int main(int argc, char ** argv) {
+    const char * path = nullptr, * jsonPath = nullptr;
+    bool benchmark = false;
+    long start = 0, end = -1;
+    int repeat = 1;
+    Player p;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (a == "--fps" && hasValue) p.fps = std::max(0.f, (float)atof(argv[++i]));
+        else if (a == "--speed" && hasValue) p.speed = std::max(0.01f, (float)atof(argv[++i]));
+        else if (a == "--loop") p.loop = true;
+        else if (a == "--start" && hasValue) start = atol(argv[++i]);
+        else if (a == "--end" && hasValue) end = atol(argv[++i]);
+        else if (a == "--bench") benchmark = true;
+        else if (a == "--repeat" && hasValue) repeat = std::max(1, atoi(argv[++i]));
+        else if (a == "--json" && hasValue) jsonPath = argv[++i];
+        else if (a[0] != '-' && !path) path = argv[i];
+        else { usage(); return 1; }
+    }
+    if (!path) { usage(); return 1; }
+    CaptureReader reader;
+    if (!reader.open(path)) {
+        fprintf(stderr, "replay: cannot open capture %s\n", path);
+        return 1;
+    }
+    const long n = (long)reader.frames();
+    if (end < 0 || end > n) end = n;
+    start = std::max(0L, std::min(start, end));
+    if (start == end) {
+        fprintf(stderr, "replay: no frames to play\n");
+        return 1;
+    }
+    printf("%s: %ld frames, %.1f MiB\n", path, n, reader.size() / 1048576.0);
+    if (benchmark) return bench(reader, start, end, repeat, jsonPath);
+    // the interactive player scrubs over the whole capture and starts at --start
+    p.frames = (int)n;
+    p.target = (int)start;
+    return play(reader, p);
+}
@@ -0,0 +1,250 @@
+#include "scene_io.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+static const size_t CHUNK = 1 << 18; // vertices per read, 3 MiB a stream
+
+static std::string extension(const std::string & path) {
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || path.find_first_of("/\\", dot) != std::string::npos) return "";
+    std::string e = path.substr(dot + 1);
+    for (char & c : e) c = (char)tolower((unsigned char)c);
+    return e;
+}
+
+static bool littleEndian() {
+    const uint16_t one = 1;
+    return *(const unsigned char *)&one == 1;
+}
+
+static float clamp01(float c) {
+    return c > 0 ? (c < 1 ? c : 1) : 0; // nan is 0
+}
+
+static unsigned char toByte(float c) {
+    return (unsigned char)(clamp01(c) * 255 + 0.5f);
+}
+
+static bool writePly(FILE * fp, const std::vector<SceneItem> & items, const SceneReader & read) {
+    size_t vertices = 0, edges = 0;
+    for (auto & it : items) {
+        vertices += it.vertices;
+        if (it.lines) edges += it.vertices / 2;
+    }
+    if (edges && vertices > UINT32_MAX) {
+        fprintf(stderr, "scene_io: too many vertices for ply edge indices\n");
+        return false;
+    }
+    std::string h = "ply\nformat ";
+    h += littleEndian() ? "binary_little_endian" : "binary_big_endian";
+    h += " 1.0\ncomment threedbg scene\n";
+    for (auto & it : items) {
+        // names are free text, a comment ends at the line break
+        std::string name = it.name;
+        std::replace(name.begin(), name.end(), '\n', ' ');
+        h += "comment " + name + (it.lines ? " lines " : " points ") + std::to_string(it.vertices) + "\n";
+    }
+    h += "element vertex " + std::to_string(vertices) + "\n"
+         "property float x\nproperty float y\nproperty float z\n"
+         "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+    if (edges) h += "element edge " + std::to_string(edges) + "\nproperty uint vertex1\nproperty uint vertex2\n";
+    h += "end_header\n";
+    if (fwrite(h.data(), 1, h.size(), fp) != h.size()) return false;
+
+    std::vector<glm::fvec3> pos(CHUNK), col(CHUNK);
+    std::vector<unsigned char> rec(CHUNK * 15);
+    for (size_t i = 0; i < items.size(); i++) {
+        for (size_t first = 0; first < items[i].vertices; first += CHUNK) {
+            const size_t n = std::min(CHUNK, items[i].vertices - first);
+            if (!read(i, 0, first, n, pos.data()) || !read(i, 1, first, n, col.data())) return false;
+            unsigned char * r = rec.data();
+            for (size_t k = 0; k < n; k++, r += 15) {
+                memcpy(r, &pos[k], 12);
+                r[12] = toByte(col[k].x); r[13] = toByte(col[k].y); r[14] = toByte(col[k].z);
+            }
+            if (fwrite(rec.data(), 15, n, fp) != n) return false;
+        }
+    }
+    std::vector<uint32_t> e;
+    uint32_t base = 0;
+    for (auto & it : items) {
+        for (size_t first = 0; it.lines && first + 1 < it.vertices; first += CHUNK) {
+            const size_t n = std::min(CHUNK, it.vertices - first) & ~(size_t)1;
+            e.resize(n);
+            for (size_t k = 0; k < n; k++) e[k] = base + (uint32_t)(first + k);
+            if (fwrite(e.data(), 4, n, fp) != n) return false;
+        }
+        base += (uint32_t)it.vertices;
+    }
+    return true;
+}
+
+static void putJsonString(std::string & j, const std::string & s) {
+    j += '"';
+    for (unsigned char c : s) {
+        char buf[8];
+        if (c == '"' || c == '\\') { j += '\\'; j += (char)c; }
+        else if (c < 0x20) { snprintf(buf, sizeof(buf), "\\u%04x", c); j += buf; }
+        else j += (char)c;
+    }
+    j += '"';
+}
+
+// fixed width, so the bounds can be filled in after the data is written
+static void putJsonVec(std::string & j, const glm::fvec3 & v) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "[% .8e,% .8e,% .8e]", v.x, v.y, v.z);
+    j += buf;
+}
+
+struct GltfItem {
+    size_t item, count, offset;
+    glm::fvec3 lo, hi;
+};
+
+static std::string gltfJson(const std::vector<SceneItem> & items, const std::vector<GltfItem> & g,
+                            size_t binBytes, const std::string & uri) {
+    std::string j = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"threedbg\"},\"scene\":0,\"scenes\":[{";
+    if (g.empty()) return j + "}]}";
+    j += "\"nodes\":[";
+    std::string nodes = "\"nodes\":[", meshes = "\"meshes\":[", views = "\"bufferViews\":[", accessors = "\"accessors\":[";
+    for (size_t i = 0; i < g.size(); i++) {
+        const SceneItem & it = items[g[i].item];
+        const std::string sep = i ? "," : "", id = std::to_string(i);
+        j += sep + id;
+        nodes += sep + "{\"name\":";
+        putJsonString(nodes, it.name);
+        nodes += ",\"mesh\":" + id + "}";
+        meshes += sep + "{\"name\":";
+        putJsonString(meshes, it.name);
+        meshes += ",\"primitives\":[{\"attributes\":{\"POSITION\":" + std::to_string(2 * i) +
+                  ",\"COLOR_0\":" + std::to_string(2 * i + 1) + "},\"mode\":" + (it.lines ? "1" : "0") + "}]";
+        if (!it.lines) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.9g", it.radius);
+            meshes += std::string(",\"extras\":{\"radius\":") + buf + "}";
+        }
+        meshes += "}";
+        const std::string bytes = std::to_string(g[i].count * 12), count = std::to_string(g[i].count);
+        for (int s = 0; s < 2; s++) {
+            views += (i || s ? "," : "") + std::string("{\"buffer\":0,\"byteOffset\":") +
+                     std::to_string(g[i].offset + s * g[i].count * 12) + ",\"byteLength\":" + bytes + ",\"target\":34962}";
+            accessors += (i || s ? "," : "") + std::string("{\"bufferView\":") + std::to_string(2 * i + s) +
+                         ",\"componentType\":5126,\"count\":" + count + ",\"type\":\"VEC3\"";
+            if (s == 0) {
+                accessors += ",\"min\":";
+                putJsonVec(accessors, g[i].lo);
+                accessors += ",\"max\":";
+                putJsonVec(accessors, g[i].hi);
+            }
+            accessors += "}";
+        }
+    }
+    j += "]}]," + nodes + "]," + meshes + "]," + views + "]," + accessors + "],\"buffers\":[{\"byteLength\":" + std::to_string(binBytes);
+    if (!uri.empty()) {
+        j += ",\"uri\":";
+        putJsonString(j, uri);
+    }
+    return j + "}]}";
+}
+
+// positions then colors of each item, bounds taken on the way
+static bool writeGltfData(FILE * fp, std::vector<GltfItem> & g, const SceneReader & read) {
+    std::vector<glm::fvec3> buf(CHUNK);
+    for (auto & gi : g) {
+        gi.lo = glm::fvec3(INFINITY); gi.hi = glm::fvec3(-INFINITY);
+        for (int s = 0; s < 2; s++) {
+            for (size_t first = 0; first < gi.count; first += CHUNK) {
+                const size_t n = std::min(CHUNK, gi.count - first);
+                if (!read(gi.item, s, first, n, buf.data())) return false;
+                for (size_t k = 0; k < n; k++) {
+                    if (s == 1) {
+                        // gltf colors are limited to 0..1
+                        for (int c = 0; c < 3; c++) buf[k][c] = clamp01(buf[k][c]);
+                    } else if (std::isfinite(buf[k].x + buf[k].y + buf[k].z)) {
+                        gi.lo = glm::min(gi.lo, buf[k]);
+                        gi.hi = glm::max(gi.hi, buf[k]);
+                    }
+                }
+                if (fwrite(buf.data(), 12, n, fp) != n) return false;
+            }
+        }
+        if (gi.lo.x > gi.hi.x) gi.lo = gi.hi = glm::fvec3(0);
+    }
+    return true;
+}
+
+static FILE * openFile(const std::string & path) {
+    FILE * fp = fopen(path.c_str(), "wb");
+    if (!fp) fprintf(stderr, "scene_io: cannot open %s for writing\n", path.c_str());
+    return fp;
+}
+
+static bool writeGltf(const std::string & path, bool binary, const std::vector<SceneItem> & items,
+                      const SceneReader & read) {
+    std::vector<GltfItem> g;
+    size_t bin = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        // accessors cannot be empty, and lines come in pairs
+        const size_t n = items[i].lines ? items[i].vertices & ~(size_t)1 : items[i].vertices;
+        if (!n) continue;
+        g.push_back(GltfItem{ i, n, bin, glm::fvec3(0), glm::fvec3(0) });
+        bin += n * 24;
+    }
+    if (!binary) {
+        const std::string binPath = path.substr(0, path.size() - 5) + ".bin";
+        const std::string uri = binPath.substr(binPath.find_last_of("/\\") + 1);
+        FILE * fp = openFile(binPath);
+        if (!fp) return false;
+        bool ok = writeGltfData(fp, g, read);
+        ok = fclose(fp) == 0 && ok;
+        if (!ok || !(fp = openFile(path))) return false;
+        const std::string j = gltfJson(items, g, bin, uri);
+        ok = fwrite(j.data(), 1, j.size(), fp) == j.size();
+        return fclose(fp) == 0 && ok;
+    }
+    std::string j = gltfJson(items, g, bin, "");
+    j.resize((j.size() + 3) & ~(size_t)3, ' ');
+    const uint64_t total = 12 + 8 + j.size() + (bin ? 8 + bin : 0);
+    if (total > UINT32_MAX) {
+        fprintf(stderr, "scene_io: scene too large for .glb, use .gltf\n");
+        return false;
+    }
+    FILE * fp = openFile(path);
+    if (!fp) return false;
+    // little-endian words, as the rest of the data
+    const uint32_t head[5] = { 0x46546c67, 2, (uint32_t)total, (uint32_t)j.size(), 0x4e4f534a };
+    const uint32_t binHead[2] = { (uint32_t)bin, 0x004e4942 };
+    bool ok = fwrite(head, 4, 5, fp) == 5 && fwrite(j.data(), 1, j.size(), fp) == j.size();
+    if (ok && bin) ok = fwrite(binHead, 4, 2, fp) == 2 && writeGltfData(fp, g, read);
+    if (ok && bin) {
+        // the bounds are known now, same length as the placeholders
+        std::string k = gltfJson(items, g, bin, "");
+        k.resize(j.size(), ' ');
+        ok = fseek(fp, 20, SEEK_SET) == 0 && fwrite(k.data(), 1, k.size(), fp) == k.size();
+    }
+    return fclose(fp) == 0 && ok;
+}
+
+bool writeScene(const std::string & path, const std::vector<SceneItem> & items, const SceneReader & read) {
+    const std::string ext = extension(path);
+    if (ext == "glb" || ext == "gltf") {
+        if (!littleEndian()) {
+            fprintf(stderr, "scene_io: gltf needs a little-endian host\n");
+            return false;
+        }
+        return writeGltf(path, ext == "glb", items, read);
+    }
+    if (ext != "ply") {
+        fprintf(stderr, "scene_io: unknown scene format %s, use .ply, .glb or .gltf\n", path.c_str());
+        return false;
+    }
+    FILE * fp = openFile(path);
+    if (!fp) return false;
+    bool ok = writePly(fp, items, read);
+    return fclose(fp) == 0 && ok;
+}
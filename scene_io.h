@@ -0,0 +1,26 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// scene writers for other tools. vertices are pulled in chunks of a few MiB
+// from a reader, so a scene is never held in memory as a whole.
+//
+//   .ply          binary, all items in one vertex list with uchar colors;
+//                 lines become an edge element
+//   .glb .gltf    gltf 2.0, a node and mesh per item drawn as POINTS or
+//                 LINES. .gltf puts the data in a .bin file next to it
+
+struct SceneItem {
+    std::string name;
+    bool lines = false; // vertex pairs, else points
+    float radius = 0;   // of points, kept in the gltf extras
+    size_t vertices = 0;
+};
+
+// copies n positions (stream 0) or colors (stream 1) of an item from first on
+typedef std::function<bool(size_t item, int stream, size_t first, size_t n, glm::fvec3 * out)> SceneReader;
+
+bool writeScene(const std::string & path, const std::vector<SceneItem> & items, const SceneReader & read);
@@ -0,0 +1,207 @@
+#include "scopes.h"
+#include "trace.h"
+#include "imgui.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// a null name marks the end of a step
+struct ScopeRecord {
+    const char * name;
+    uint64_t begin, end;
+};
+
+// single producer, the owning thread, and single consumer, the display
+// thread. a full ring drops new records until the display catches up
+struct ScopeRing {
+    static const size_t N = 1 << 14;
+    ScopeRecord records[N];
+    std::atomic<size_t> head{ 0 }, tail{ 0 };
+    std::atomic<size_t> dropped{ 0 };
+    int tid;
+    std::vector<ScopeRecord> pending; // display thread only
+};
+
+static std::mutex registry_lock;
+static std::vector<std::unique_ptr<ScopeRing>> rings;
+// no step marks until the first scope, programs without scopes pay nothing
+static std::atomic<bool> used{ false };
+
+static ScopeRing & local() {
+    static thread_local ScopeRing * ring = nullptr;
+    if (!ring) {
+        std::lock_guard<std::mutex> lk(registry_lock);
+        rings.push_back(std::make_unique<ScopeRing>());
+        ring = rings.back().get();
+        ring->tid = (int)rings.size();
+        used.store(true);
+    }
+    return *ring;
+}
+
+static void push(const ScopeRecord & r) {
+    ScopeRing & g = local();
+    const size_t h = g.head.load(std::memory_order_relaxed);
+    if (h - g.tail.load(std::memory_order_acquire) == ScopeRing::N) {
+        g.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    g.records[h % ScopeRing::N] = r;
+    g.head.store(h + 1, std::memory_order_release);
+}
+
+namespace threedbg {
+
+Scope::Scope(const char * name) : name(name), begin(trace::now()) {}
+
+Scope::~Scope() {
+    const uint64_t end = trace::now();
+    push(ScopeRecord{ name, begin, end });
+    if (trace::enabled.load(std::memory_order_relaxed)) trace::record(name, "sim", begin, end);
+}
+
+}
+
+void ScopeView::step(void) {
+    if (!used.load(std::memory_order_relaxed)) return;
+    const uint64_t t = trace::now();
+    push(ScopeRecord{ nullptr, t, t });
+}
+
+static ScopeView::Node & child(std::vector<ScopeView::Node> & nodes, const char * name) {
+    for (auto & n : nodes)
+        if (n.name == name || !strcmp(n.name, name)) return n;
+    nodes.emplace_back();
+    nodes.back().name = name;
+    return nodes.back();
+}
+
+// nests the records by containment and sums the ones on the same path.
+// nodes on the stack are never moved: siblings are only added to the top
+static std::vector<ScopeView::Node> build(std::vector<ScopeRecord> & rs) {
+    std::sort(rs.begin(), rs.end(), [](const ScopeRecord & a, const ScopeRecord & b) {
+        return a.begin != b.begin ? a.begin < b.begin : a.end > b.end;
+    });
+    std::vector<ScopeView::Node> roots;
+    std::vector<std::pair<const ScopeRecord *, ScopeView::Node *>> open;
+    for (auto & r : rs) {
+        while (!open.empty() && !(open.back().first->begin <= r.begin && r.end <= open.back().first->end))
+            open.pop_back();
+        ScopeView::Node & n = child(open.empty() ? roots : open.back().second->children, r.name);
+        n.ms += (r.end - r.begin) * 1e-6;
+        n.calls++;
+        open.emplace_back(&r, &n);
+    }
+    return roots;
+}
+
+void ScopeView::collect(void) {
+    std::vector<ScopeRing *> rs;
+    {
+        std::lock_guard<std::mutex> lk(registry_lock);
+        for (auto & g : rings) rs.push_back(g.get());
+    }
+    std::vector<uint64_t> marks;
+    dropped = 0;
+    for (ScopeRing * g : rs) {
+        const size_t t = g->tail.load(std::memory_order_relaxed);
+        const size_t h = g->head.load(std::memory_order_acquire);
+        for (size_t i = t; i < h; i++) {
+            const ScopeRecord & r = g->records[i % ScopeRing::N];
+            if (r.name) g->pending.push_back(r);
+            else marks.push_back(r.end);
+        }
+        g->tail.store(h, std::memory_order_release);
+        dropped += g->dropped.load(std::memory_order_relaxed);
+        if (!g->pending.empty()) seen = true;
+    }
+    if (marks.empty()) return;
+    // only the newest step is shown, older ones that ended since the last
+    // frame are dropped
+    std::sort(marks.begin(), marks.end());
+    const uint64_t end = marks.back();
+    const uint64_t begin = marks.size() > 1 ? marks[marks.size() - 2] : last;
+    // the first step begins with its first scope
+    uint64_t first = end;
+    std::vector<Thread> ts;
+    for (ScopeRing * g : rs) {
+        auto split = std::partition(g->pending.begin(), g->pending.end(),
+                                    [&](const ScopeRecord & r) { return r.end <= end; });
+        std::vector<ScopeRecord> step;
+        for (auto it = g->pending.begin(); it != split; ++it) {
+            if (it->end < begin) continue;
+            step.push_back(*it);
+            first = std::min(first, it->begin);
+        }
+        g->pending.erase(g->pending.begin(), split);
+        if (step.empty()) continue;
+        ts.push_back(Thread{ "thread " + std::to_string(g->tid), build(step) });
+    }
+    last = end;
+    if (hold || ts.empty()) return;
+    stepBegin = begin ? begin : first;
+    stepEnd = end;
+    threads = std::move(ts);
+}
+
+static ImU32 colorOf(const char * name) {
+    uint32_t h = 2166136261u;
+    for (; *name; name++) h = (h ^ (unsigned char)*name) * 16777619u;
+    return ImColor::HSV((h % 360) / 360.f, 0.45f, 0.9f);
+}
+
+static int depthOf(const std::vector<ScopeView::Node> & nodes) {
+    int d = 0;
+    for (auto & n : nodes) d = std::max(d, 1 + depthOf(n.children));
+    return d;
+}
+
+static void drawNodes(ImDrawList * dl, const std::vector<ScopeView::Node> & nodes, float x, float y,
+                      float scale, float row, double stepMs) {
+    for (auto & n : nodes) {
+        const float w = (float)(n.ms * scale);
+        if (w >= 1) {
+            const ImVec2 a(x, y), b(x + w - 1, y + row - 1);
+            dl->AddRectFilled(a, b, colorOf(n.name));
+            char label[128];
+            snprintf(label, sizeof(label), "%s %.2f ms", n.name, n.ms);
+            dl->PushClipRect(a, b, true);
+            dl->AddText(ImVec2(x + 2, y), 0xff000000, label);
+            dl->PopClipRect();
+            if (ImGui::IsMouseHoveringRect(a, b))
+                ImGui::SetTooltip("%s\n%.3f ms in %d call%s\n%.1f%% of the step", n.name, n.ms, n.calls,
+                                  n.calls == 1 ? "" : "s", stepMs > 0 ? 100 * n.ms / stepMs : 0.0);
+            drawNodes(dl, n.children, x, y + row, scale, row, stepMs);
+        }
+        x += w;
+    }
+}
+
+void ScopeView::Show(void) {
+    ImGui::Checkbox("hold", &hold);
+    ImGui::SameLine();
+    const double stepMs = (stepEnd > stepBegin ? stepEnd - stepBegin : 0) * 1e-6;
+    ImGui::Text("step %.2f ms", stepMs);
+    if (dropped) {
+        ImGui::SameLine();
+        ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "%zu dropped", dropped);
+    }
+    ImDrawList * dl = ImGui::GetWindowDrawList();
+    const float width = std::max(ImGui::GetContentRegionAvailWidth(), 1.f);
+    const float row = ImGui::GetTextLineHeightWithSpacing();
+    for (auto & t : threads) {
+        if (threads.size() > 1) ImGui::TextUnformatted(t.name.c_str());
+        // scopes spanning a step mark can add up to more than the step
+        double total = 0;
+        for (auto & n : t.roots) total += n.ms;
+        total = std::max(total, stepMs);
+        const ImVec2 origin = ImGui::GetCursorScreenPos();
+        const int depth = depthOf(t.roots);
+        if (total > 0) drawNodes(dl, t.roots, origin.x, origin.y, (float)(width / total), row, stepMs);
+        ImGui::Dummy(ImVec2(width, depth * row));
+    }
+}
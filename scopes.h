@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace threedbg {
+
+// marks a part of the simulation step. the viewer's "scopes" window shows
+// the last step as an icicle, scopes nested the way they ran, per thread.
+// each thread records into its own ring without locks; while tracing (see
+// trace.h) the scopes show up in the trace too.
+//
+//   while (threedbg::working()) {
+//       threedbg::Scope s("step");
+//       { threedbg::Scope c("collision"); ... }
+//       { threedbg::Scope c("integrate"); ... }
+//   }
+//
+// the name is not copied, use literals or trace::intern()
+class Scope {
+    const char * name;
+    uint64_t begin;
+public:
+    explicit Scope(const char * name);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope & operator=(const Scope &) = delete;
+};
+
+}
+
+// the display side: working() ends a step, the display thread collects every
+// frame and keeps the newest complete step
+class ScopeView {
+public:
+    struct Node {
+        const char * name;
+        double ms = 0; // summed over calls
+        int calls = 0;
+        std::vector<Node> children;
+    };
+    struct Thread {
+        std::string name;
+        std::vector<Node> roots;
+    };
+    static void step(void);
+    void collect(void);
+    // nothing was ever recorded
+    bool empty(void) const { return !seen; }
+    void Show(void);
+private:
+    bool seen = false, hold = false;
+    uint64_t last = 0; // the newest step mark collected
+    uint64_t stepBegin = 0, stepEnd = 0;
+    std::vector<Thread> threads;
+    size_t dropped = 0;
+};
@@ -0,0 +1,138 @@
+#include "serialize.h"
+
+#include <map>
+#include <mutex>
+
+#include "points.h"
+#include "lines.h"
+
+void putCamera(ScatterBuffer & b, const Camera & c) {
+    const float f[10] = { c.eye.x, c.eye.y, c.eye.z, c.center.x, c.center.y, c.center.z,
+                          c.up.x, c.up.y, c.up.z, c.target_size };
+    b.put(f, sizeof(f));
+    b.put((int32_t)c.resolution.x);
+    b.put((int32_t)c.resolution.y);
+}
+
+Camera getCamera(ByteReader & r) {
+    Camera c;
+    float f[10];
+    for (auto & v : f) v = r.get<float>();
+    c.eye = glm::vec3(f[0], f[1], f[2]);
+    c.center = glm::vec3(f[3], f[4], f[5]);
+    c.up = glm::vec3(f[6], f[7], f[8]);
+    c.target_size = f[9];
+    c.resolution.x = r.get<int32_t>();
+    c.resolution.y = r.get<int32_t>();
+    return c;
+}
+
+void putStrings(ScatterBuffer & b, const std::vector<std::string> & s) {
+    b.put((uint32_t)s.size());
+    for (auto & t : s) b.putString(t);
+}
+
+std::vector<std::string> getStrings(ByteReader & r) {
+    // counts come from the input, each string takes at least its length
+    uint32_t n = r.get<uint32_t>();
+    if (!r.ok || n > r.left() / sizeof(uint32_t)) return {};
+    std::vector<std::string> s(n);
+    for (auto & t : s) t = r.getString();
+    return s;
+}
+
+void putFactory(ScatterBuffer & b, const std::string & name, const FactoryView & v) {
+    b.putString(name);
+    b.putString(v.type);
+    b.put((uint32_t)v.params.size());
+    b.put(v.params.data(), v.params.size() * sizeof(float));
+    b.put((uint32_t)v.streams.size());
+    for (auto & s : v.streams) {
+        b.put((uint64_t)s.bytes);
+        b.align(16);
+        b.ref(s.data, s.bytes);
+    }
+    b.align(16);
+}
+
+bool getFactory(ByteReader & r, std::string & name, FactoryView & v) {
+    name = r.getString();
+    v.type = r.getString();
+    // counts are checked against the bytes left before anything is allocated
+    uint32_t n = r.get<uint32_t>();
+    if (!r.ok || n > 4096 || n > r.left() / sizeof(float)) return false;
+    v.params.resize(n);
+    for (auto & p : v.params) p = r.get<float>();
+    n = r.get<uint32_t>();
+    if (!r.ok || n > 4096 || n > r.left() / sizeof(uint64_t)) return false;
+    v.streams.resize(n);
+    for (auto & s : v.streams) {
+        s.bytes = r.get<uint64_t>();
+        r.align(16);
+        s.data = r.take(s.bytes);
+    }
+    r.align(16);
+    return r.ok;
+}
+
+struct FactoryType {
+    FactoryLoader load;
+    DrawerLoader upload;
+};
+
+static std::mutex registry_lock;
+static std::map<std::string, FactoryType> & registry() {
+    static std::map<std::string, FactoryType> r = {
+        { "points", { &PointsDrawerFactory::load, &PointsDrawerFactory::upload } },
+        { "lines", { &LinesDrawerFactory::load, &LinesDrawerFactory::upload } },
+    };
+    return r;
+}
+
+void registerFactoryType(const std::string & type, FactoryLoader load, DrawerLoader upload) {
+    std::lock_guard<std::mutex> lk(registry_lock);
+    registry()[type] = FactoryType{ load, upload };
+}
+
+static bool findType(const std::string & type, FactoryType & t) {
+    std::lock_guard<std::mutex> lk(registry_lock);
+    auto it = registry().find(type);
+    if (it == registry().end()) {
+        fprintf(stderr, "unknown drawer factory type '%s'\n", type.c_str());
+        return false;
+    }
+    t = it->second;
+    return true;
+}
+
+std::unique_ptr<DrawerFactory> loadFactory(const FactoryView & v) {
+    FactoryType t;
+    return findType(v.type, t) ? t.load(v) : nullptr;
+}
+
+Drawer * uploadFactory(const FactoryView & v) {
+    FactoryType t;
+    if (!findType(v.type, t)) return nullptr;
+    if (t.upload) return t.upload(v);
+    std::unique_ptr<DrawerFactory> f = t.load(v);
+    return f ? f->createDrawer() : nullptr;
+}
+
+struct ViewFactory : DrawerFactory {
+    FactoryView v;
+    std::shared_ptr<void> keep;
+    DrawerLoader upload;
+    virtual Drawer * createDrawer() override { return upload(v); }
+    virtual bool view(FactoryView & o) const override { o = v; return true; }
+};
+
+std::unique_ptr<DrawerFactory> wrapFactory(const FactoryView & v, std::shared_ptr<void> keep) {
+    FactoryType t;
+    if (!findType(v.type, t)) return nullptr;
+    if (!keep || !t.upload) return t.load(v);
+    auto f = std::make_unique<ViewFactory>();
+    f->v = v;
+    f->keep = std::move(keep);
+    f->upload = t.upload;
+    return f;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "drawer.h"
+
+// binary encoding shared by session capture and the viewer transports.
+// everything is little endian; stream payloads are 16-byte aligned relative
+// to the start of the enclosing record so they can be used in place.
+
+// scatter list of small owned bytes and large referenced payloads, so a
+// record can be handed to fwrite/writev without copying factory buffers
+struct ScatterBuffer {
+    struct Piece {
+        const void * ptr; // null for owned bytes starting at `offset`
+        size_t offset, size;
+    };
+    std::vector<unsigned char> bytes;
+    std::vector<Piece> pieces;
+    size_t total = 0;
+
+    void put(const void * data, size_t n) {
+        if (!n) return;
+        if (pieces.empty() || pieces.back().ptr)
+            pieces.push_back(Piece{ nullptr, bytes.size(), 0 });
+        bytes.insert(bytes.end(), (const unsigned char *)data, (const unsigned char *)data + n);
+        pieces.back().size += n;
+        total += n;
+    }
+    template<class T> void put(const T & v) { put(&v, sizeof(T)); }
+    void putString(const std::string & s) {
+        put((uint32_t)s.size());
+        put(s.data(), s.size());
+    }
+    void ref(const void * data, size_t n) {
+        if (!n) return;
+        pieces.push_back(Piece{ data, 0, n });
+        total += n;
+    }
+    void align(size_t a) {
+        static const unsigned char zeros[64] = {};
+        if (total % a) put(zeros, a - total % a);
+    }
+    // patch owned bytes written earlier, e.g. a size field
+    template<class T> void patch(size_t at, const T & v) {
+        size_t pos = 0;
+        for (auto & p : pieces) {
+            if (!p.ptr && at >= pos && at + sizeof(T) <= pos + p.size) {
+                memcpy(&bytes[p.offset + at - pos], &v, sizeof(T));
+                return;
+            }
+            pos += p.size;
+        }
+    }
+    const void * data(const Piece & p) const { return p.ptr ? p.ptr : &bytes[p.offset]; }
+    void clear() { bytes.clear(); pieces.clear(); total = 0; }
+};
+
+// bounds checked cursor over a mapped or received record
+struct ByteReader {
+    const unsigned char * base, * p, * end;
+    bool ok = true;
+    ByteReader(const void * data, size_t n)
+        : base((const unsigned char *)data), p(base), end(base + n) {}
+    const void * take(size_t n) {
+        if (!ok || (size_t)(end - p) < n) { ok = false; return nullptr; }
+        const void * r = p;
+        p += n;
+        return r;
+    }
+    template<class T> T get() {
+        T v{};
+        const void * d = take(sizeof(T));
+        if (d) memcpy(&v, d, sizeof(T));
+        return v;
+    }
+    std::string getString() {
+        uint32_t n = get<uint32_t>();
+        const char * d = (const char *)take(n);
+        return d ? std::string(d, n) : std::string();
+    }
+    void align(size_t a) {
+        size_t off = p - base;
+        if (off % a) take(a - off % a);
+    }
+    size_t offset() const { return p - base; }
+    size_t left() const { return end - p; }
+};
+
+void putCamera(ScatterBuffer & b, const Camera & c);
+Camera getCamera(ByteReader & r);
+void putStrings(ScatterBuffer & b, const std::vector<std::string> & s);
+std::vector<std::string> getStrings(ByteReader & r);
+// name, type, params and streams; stream payloads are referenced, not copied
+void putFactory(ScatterBuffer & b, const std::string & name, const FactoryView & v);
+// the view's streams point into the reader's memory
+bool getFactory(ByteReader & r, std::string & name, FactoryView & v);
+
+// factory types that can be rebuilt from a view. "points" and "lines" are
+// built in, other drawer types register their loader once at startup.
+// the optional DrawerLoader creates the drawer directly from a view
+typedef std::unique_ptr<DrawerFactory> (*FactoryLoader)(const FactoryView &);
+typedef Drawer * (*DrawerLoader)(const FactoryView &);
+void registerFactoryType(const std::string & type, FactoryLoader load, DrawerLoader upload = nullptr);
+std::unique_ptr<DrawerFactory> loadFactory(const FactoryView & v);
+// drawer straight from a view, through a factory only for types without a
+// DrawerLoader. needs the gl context
+Drawer * uploadFactory(const FactoryView & v);
+// factory over memory that `keep` holds on to, e.g. a shared ring, which is
+// uploaded from in place. types without a DrawerLoader are copied instead
+std::unique_ptr<DrawerFactory> wrapFactory(const FactoryView & v, std::shared_ptr<void> keep);
@@ -0,0 +1,523 @@
+#include "stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+
+#include "image_io.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SO_NOSIGPIPE is set instead
+#endif
+#endif
+
+static const int JPEG_QUALITY = 85, JPEG_DRAG_QUALITY = 50;
+static const std::chrono::milliseconds SETTLE(300);
+
+static const char page[] = R"(<!doctype html>
+<html><head><meta charset="utf-8"><title>threedbg</title>
+<style>
+html, body { margin: 0; height: 100%; background: #7f7f7f; overflow: hidden; }
+canvas { display: block; margin: auto; max-width: 100vw; max-height: 100vh; }
+#status { position: fixed; left: 4px; bottom: 4px; font: 12px monospace; }
+</style></head>
+<body><canvas id="view" width="1" height="1"></canvas><div id="status">connecting</div>
+<script>
+// left drag rotates, middle or shift-left translates, right drag and the wheel zoom
+var view = document.getElementById('view'), g = view.getContext('2d');
+var statusEl = document.getElementById('status');
+var ws = null, busy = false, next = null, frames = 0, button = -1, lastX = 0, lastY = 0;
+function show(blob) {
+    busy = true;
+    createImageBitmap(blob).then(function (img) {
+        if (view.width != img.width || view.height != img.height) {
+            view.width = img.width; view.height = img.height;
+        }
+        g.drawImage(img, 0, 0);
+        img.close();
+        frames++;
+        busy = false;
+        if (next) { var b = next; next = null; show(b); }
+    });
+}
+function connect() {
+    ws = new WebSocket('ws://' + location.host + '/ws');
+    ws.onopen = function () { statusEl.textContent = 'connected'; };
+    ws.onmessage = function (e) { if (busy) next = e.data; else show(e.data); };
+    ws.onclose = function () { statusEl.textContent = 'disconnected'; setTimeout(connect, 1000); };
+}
+function send(m) { if (ws && ws.readyState == 1) ws.send(m); }
+view.oncontextmenu = function (e) { e.preventDefault(); };
+view.onmousedown = function (e) {
+    button = e.shiftKey ? 1 : e.button;
+    lastX = e.clientX; lastY = e.clientY;
+    send('d');
+    e.preventDefault();
+};
+window.onmouseup = function () { if (button >= 0) send('u'); button = -1; };
+window.onmousemove = function (e) {
+    if (button < 0) return;
+    var h = view.getBoundingClientRect().height;
+    send('m ' + button + ' ' + (e.clientX - lastX) / h * 2 + ' ' + -(e.clientY - lastY) / h * 2);
+    lastX = e.clientX; lastY = e.clientY;
+};
+view.onwheel = function (e) { e.preventDefault(); send('w ' + (e.deltaY > 0 ? -0.05 : 0.05)); };
+setInterval(function () {
+    if (ws && ws.readyState == 1) statusEl.textContent = frames + ' fps';
+    frames = 0;
+}, 1000);
+connect();
+</script></body></html>
+)";
+
+static inline uint32_t rol(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+// only for the websocket handshake
+static void sha1(const std::string & msg, unsigned char digest[20]) {
+    uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    std::vector<unsigned char> m(msg.begin(), msg.end());
+    const uint64_t bits = (uint64_t)m.size() * 8;
+    m.push_back(0x80);
+    while (m.size() % 64 != 56) m.push_back(0);
+    for (int i = 7; i >= 0; i--) m.push_back((unsigned char)(bits >> (8 * i)));
+    for (size_t off = 0; off < m.size(); off += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++)
+            w[i] = (uint32_t)m[off + 4 * i] << 24 | m[off + 4 * i + 1] << 16 | m[off + 4 * i + 2] << 8 | m[off + 4 * i + 3];
+        for (int i = 16; i < 80; i++) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5a827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ed9eba1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+            else { f = b ^ c ^ d; k = 0xca62c1d6; }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rol(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+    for (int i = 0; i < 20; i++) digest[i] = (unsigned char)(h[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+static std::string base64(const unsigned char * p, size_t n) {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string r;
+    for (size_t i = 0; i < n; i += 3) {
+        uint32_t v = (uint32_t)p[i] << 16 | (i + 1 < n ? p[i + 1] << 8 : 0) | (i + 2 < n ? p[i + 2] : 0);
+        r += digits[(v >> 18) & 63];
+        r += digits[(v >> 12) & 63];
+        r += i + 1 < n ? digits[(v >> 6) & 63] : '=';
+        r += i + 2 < n ? digits[v & 63] : '=';
+    }
+    return r;
+}
+
+// cheap enough to run on every frame, it only has to notice a change
+static uint64_t hashPixels(const unsigned char * p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ull ^ n;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        h = (h ^ v) * 0x100000001b3ull;
+        h ^= h >> 29;
+    }
+    for (; i < n; i++) h = (h ^ p[i]) * 0x100000001b3ull;
+    return h;
+}
+
+// unmasked server frame
+static std::shared_ptr<std::vector<unsigned char>> wsFrame(int opcode, const unsigned char * data, size_t n) {
+    auto f = std::make_shared<std::vector<unsigned char>>();
+    f->reserve(n + 10);
+    f->push_back((unsigned char)(0x80 | opcode));
+    if (n < 126) f->push_back((unsigned char)n);
+    else if (n < 65536) {
+        f->push_back(126);
+        f->push_back((unsigned char)(n >> 8)); f->push_back((unsigned char)n);
+    } else {
+        f->push_back(127);
+        for (int i = 7; i >= 0; i--) f->push_back((unsigned char)((uint64_t)n >> (8 * i)));
+    }
+    f->insert(f->end(), data, data + n);
+    return f;
+}
+
+FrameStreamer::FrameStreamer(int threads) {
+    for (int i = 0; i < std::max(1, threads); i++)
+        workers.emplace_back([this] { work(); });
+}
+
+FrameStreamer::~FrameStreamer() {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto & t : workers) t.join();
+#ifndef _WIN32
+    if (wake[1] >= 0 && write(wake[1], "", 1) < 0) perror("stream");
+    if (io.joinable()) io.join();
+    for (auto & c : clients) ::close(c->fd);
+    for (int f : { listenFd, wake[0], wake[1] })
+        if (f >= 0) ::close(f);
+#endif
+}
+
+bool FrameStreamer::wants() {
+    if (watching.load() == 0) return false;
+    std::lock_guard<std::mutex> lk(mtx);
+    return idle > 0;
+}
+
+std::vector<unsigned char> FrameStreamer::buffer() {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (pool.empty()) return std::vector<unsigned char>();
+    std::vector<unsigned char> b = std::move(pool.back());
+    pool.pop_back();
+    return b;
+}
+
+void FrameStreamer::push(int w, int h, std::vector<unsigned char> && pixels) {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (pending) pool.push_back(std::move(pending->pixels)); // superseded
+        pending.reset(new Frame{ ++nextSeq, w, h, std::move(pixels) });
+        st.offered++;
+    }
+    cv.notify_one();
+}
+
+bool FrameStreamer::applyInput(Camera & cam) {
+    std::vector<Input> in;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        in.swap(inputs);
+    }
+    // as Camera::ImGuiDrag does with the mouse over the rotate/translate/zoom buttons
+    for (auto & i : in) {
+        if (i.op == 0) cam.rotate(i.delta);
+        else if (i.op == 1) cam.translate(-i.delta);
+        else cam.zoom(i.delta);
+    }
+    return !in.empty();
+}
+
+FrameStreamer::Stats FrameStreamer::stats() {
+    std::lock_guard<std::mutex> lk(mtx);
+    return st;
+}
+
+void FrameStreamer::work() {
+    std::vector<unsigned char> encoded, rgb;
+    std::unique_lock<std::mutex> lk(mtx);
+    while (true) {
+        idle++;
+        while (!stopping && !pending) cv.wait(lk);
+        idle--;
+        if (stopping) return;
+        std::unique_ptr<Frame> f = std::move(pending);
+        lk.unlock();
+        const uint64_t hash = hashPixels(f->pixels.data(), f->pixels.size()) ^ ((uint64_t)f->w << 32 | (uint32_t)f->h);
+        lk.lock();
+        // a view that settled for a moment is sent once more without loss,
+        // then not at all
+        const auto now = std::chrono::steady_clock::now();
+        bool lossless = false, drag = dragging;
+        if (hash == lastHash && (lastLossless || drag || now - changed < SETTLE)) {
+            st.unchanged++;
+            pool.push_back(std::move(f->pixels));
+            continue;
+        }
+        if (hash == lastHash) lossless = lastLossless = true;
+        else {
+            lastHash = hash;
+            lastLossless = false;
+            changed = now;
+        }
+        lk.unlock();
+        encoded.clear();
+        if (lossless) {
+            const size_t n = (size_t)f->w * f->h;
+            rgb.resize(n * 3);
+            for (size_t i = 0; i < n; i++) memcpy(&rgb[3 * i], &f->pixels[4 * i], 3);
+            encodePng(encoded, rgb.data(), f->w, f->h, 3, true);
+        } else {
+            encodeJpeg(encoded, f->pixels.data(), f->w, f->h, 4, drag ? JPEG_DRAG_QUALITY : JPEG_QUALITY, true);
+        }
+        std::shared_ptr<const std::vector<unsigned char>> msg = wsFrame(2, encoded.data(), encoded.size());
+        lk.lock();
+        pool.push_back(std::move(f->pixels));
+        // another worker may have finished a newer frame already
+        if (f->seq > postedSeq) {
+            postedSeq = f->seq;
+            st.encoded++;
+            lk.unlock();
+            post(std::move(msg));
+            lk.lock();
+        }
+    }
+}
+
+#ifndef _WIN32
+void FrameStreamer::post(std::shared_ptr<const std::vector<unsigned char>> data) {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        ready.push_back(std::move(data));
+    }
+    if (write(wake[1], "", 1) < 0 && errno != EAGAIN) perror("stream");
+}
+
+bool FrameStreamer::listen(const std::string & address) {
+    std::string hp = address.compare(0, 4, "tcp:") == 0 ? address.substr(4) : address;
+    size_t colon = hp.rfind(':');
+    std::string host = colon == std::string::npos ? "127.0.0.1" : hp.substr(0, colon);
+    std::string port = colon == std::string::npos ? hp : hp.substr(colon + 1);
+    addrinfo hints = {}, * res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int e = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res);
+    if (e != 0) {
+        fprintf(stderr, "stream: %s: %s\n", address.c_str(), gai_strerror(e));
+        return false;
+    }
+    for (addrinfo * ai = res; ai && listenFd < 0; ai = ai->ai_next) {
+        listenFd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (listenFd < 0) continue;
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(listenFd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(listenFd, 16) == 0) break;
+        ::close(listenFd);
+        listenFd = -1;
+    }
+    freeaddrinfo(res);
+    if (listenFd < 0 || pipe(wake) != 0) {
+        fprintf(stderr, "stream: cannot listen on %s\n", address.c_str());
+        return false;
+    }
+    for (int f : { listenFd, wake[0], wake[1] }) fcntl(f, F_SETFL, fcntl(f, F_GETFL) | O_NONBLOCK);
+    bindHost = host;
+    for (auto & ch : bindHost) ch = (char)tolower((unsigned char)ch);
+    printf("stream: open http://%s:%s in a browser\n", host.c_str(), port.c_str());
+    io = std::thread([this] { serve(); });
+    return true;
+}
+
+void FrameStreamer::serve() {
+    std::vector<pollfd> fds;
+    while (!stopping) {
+        fds.assign({ pollfd{ listenFd, POLLIN, 0 }, pollfd{ wake[0], POLLIN, 0 } });
+        for (auto & c : clients)
+            fds.push_back(pollfd{ c->fd, (short)(POLLIN | (c->out.empty() ? 0 : POLLOUT)), 0 });
+        if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR) break;
+        if (fds[0].revents) {
+            int fd;
+            while ((fd = accept(listenFd, nullptr, nullptr)) >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+                setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+                clients.push_back(std::unique_ptr<Client>(new Client{ fd }));
+            }
+        }
+        if (fds[1].revents) {
+            char drain[64];
+            while (read(wake[0], drain, sizeof(drain)) > 0) {}
+            std::deque<std::shared_ptr<const std::vector<unsigned char>>> frames;
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                frames.swap(ready);
+            }
+            for (auto & f : frames)
+                for (auto & c : clients)
+                    if (c->websocket) queue(*c, f, true);
+        }
+        // clients accepted above have no poll entry yet
+        for (size_t i = 0; i < clients.size();) {
+            Client & c = *clients[i];
+            short ev = i + 2 < fds.size() ? fds[i + 2].revents : 0;
+            bool keep = true;
+            if (ev & (POLLIN | POLLHUP | POLLERR)) keep = readClient(c);
+            if (keep && !c.out.empty()) keep = writeClient(c);
+            if (keep) {
+                i++;
+                continue;
+            }
+            ::close(c.fd);
+            if (c.websocket) {
+                watching--;
+                std::lock_guard<std::mutex> lk(mtx);
+                dragging = false;
+            }
+            clients.erase(clients.begin() + i);
+            if (i + 2 < fds.size()) fds.erase(fds.begin() + i + 2);
+        }
+    }
+}
+
+bool FrameStreamer::readClient(Client & c) {
+    unsigned char buf[16384];
+    ssize_t r;
+    while ((r = recv(c.fd, buf, sizeof(buf), 0)) > 0) c.in.insert(c.in.end(), buf, buf + r);
+    if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) return false;
+    if (!c.websocket) {
+        static const char blank[] = "\r\n\r\n";
+        auto end = std::search(c.in.begin(), c.in.end(), blank, blank + 4);
+        if (end == c.in.end()) return c.in.size() < 16384;
+        handshake(c, end - c.in.begin() + 4);
+        if (!c.websocket) return true;
+    }
+    // frames from the browser are masked and small, some may have come along
+    // with the handshake
+    size_t at = 0;
+    while (c.in.size() - at >= 2) {
+        const unsigned char * p = &c.in[at];
+        const int opcode = p[0] & 15;
+        uint64_t n = p[1] & 127;
+        size_t head = 2;
+        if (n == 126) head = 4;
+        else if (n == 127) head = 10;
+        if (!(p[1] & 128)) return false;
+        if (c.in.size() - at < head + 4) break;
+        if (n == 126) n = (uint64_t)p[2] << 8 | p[3];
+        else if (n == 127) return false;
+        if (c.in.size() - at < head + 4 + n) break;
+        unsigned char * data = &c.in[at + head + 4];
+        for (uint64_t i = 0; i < n; i++) data[i] ^= p[head + i % 4];
+        message(c, opcode, data, (size_t)n);
+        at += head + 4 + n;
+    }
+    c.in.erase(c.in.begin(), c.in.begin() + at);
+    return !c.closing || !c.out.empty();
+}
+
+static std::string header(const std::string & request, const std::string & lowered, const char * name) {
+    size_t p = lowered.find(std::string("\r\n") + name + ":");
+    if (p == std::string::npos) return "";
+    p += strlen(name) + 3;
+    size_t e = request.find("\r\n", p);
+    std::string v = request.substr(p, e - p);
+    v.erase(0, v.find_first_not_of(" \t"));
+    v.erase(v.find_last_not_of(" \t") + 1);
+    return v;
+}
+
+// a Host header naming this server: an address literal, which dns rebinding
+// cannot produce, localhost or the host it was told to listen on
+static bool trustedHost(std::string host, const std::string & bindHost) {
+    for (auto & ch : host) ch = (char)tolower((unsigned char)ch);
+    if (!host.empty() && host[0] == '[') {
+        size_t e = host.find(']');
+        if (e == std::string::npos) return false;
+        host = host.substr(1, e - 1);
+    } else if (host.rfind(':') != std::string::npos) {
+        host.erase(host.rfind(':'));
+    }
+    unsigned char a[16];
+    if (inet_pton(AF_INET, host.c_str(), a) == 1 || inet_pton(AF_INET6, host.c_str(), a) == 1) return true;
+    return host == "localhost" || (!host.empty() && host == bindHost);
+}
+
+void FrameStreamer::handshake(Client & c, size_t end) {
+    std::string req(c.in.begin(), c.in.begin() + end), low = req;
+    c.in.erase(c.in.begin(), c.in.begin() + end);
+    for (auto & ch : low) ch = (char)tolower((unsigned char)ch);
+    std::string path = req.compare(0, 4, "GET ") == 0 ? req.substr(4, req.find(' ', 4) - 4) : "";
+    std::string key = header(req, low, "sec-websocket-key"), origin = header(req, low, "origin");
+    std::string reply;
+    std::string host = header(req, low, "host");
+    // other sites open in the browser must not drive the camera, neither
+    // directly nor through a name of theirs that resolves to this machine
+    if (!trustedHost(host, bindHost) || (!origin.empty() && origin != "http://" + host)) {
+        reply = "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    } else if (!key.empty()) {
+        unsigned char digest[20];
+        sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", digest);
+        reply = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                "Sec-WebSocket-Accept: " + base64(digest, 20) + "\r\n\r\n";
+        c.websocket = true;
+        watching++;
+        std::lock_guard<std::mutex> lk(mtx);
+        lastHash = 0; // the newcomer needs a frame even if nothing changes
+    } else if (path == "/" || path == "/index.html") {
+        reply = "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nCache-Control: no-store\r\n"
+                "Content-Length: " + std::to_string(sizeof(page) - 1) + "\r\nConnection: close\r\n\r\n" + page;
+    } else {
+        reply = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    }
+    c.closing = !c.websocket;
+    queue(c, std::make_shared<std::vector<unsigned char>>(reply.begin(), reply.end()), false);
+}
+
+void FrameStreamer::message(Client & c, int opcode, const unsigned char * data, size_t n) {
+    if (opcode == 8) { // close, echoed
+        queue(c, wsFrame(8, data, std::min(n, (size_t)2)), false);
+        c.closing = true;
+    } else if (opcode == 9) {
+        queue(c, wsFrame(10, data, n), false);
+    } else if (opcode == 1) {
+        // "d" button down, "u" up, "m <button> <dx> <dy>", "w <dy>"
+        std::string m((const char *)data, n);
+        Input in = { 0, glm::vec2(0) };
+        std::lock_guard<std::mutex> lk(mtx);
+        if (m == "d") dragging = true;
+        else if (m == "u") dragging = false;
+        else if (sscanf(m.c_str(), "m %d %f %f", &in.op, &in.delta.x, &in.delta.y) == 3 && in.op >= 0 && in.op <= 2)
+            inputs.push_back(in);
+        else if (sscanf(m.c_str(), "w %f", &in.delta.y) == 1) {
+            in.op = 2;
+            inputs.push_back(in);
+        }
+    }
+}
+
+void FrameStreamer::queue(Client & c, std::shared_ptr<const std::vector<unsigned char>> data, bool frame) {
+    // a frame waiting behind the one in flight is replaced by the newer one
+    if (frame)
+        for (size_t i = c.sent ? 1 : 0; i < c.out.size();) {
+            if (c.out[i].frame) c.out.erase(c.out.begin() + i);
+            else i++;
+        }
+    c.out.push_back(Out{ std::move(data), frame });
+}
+
+bool FrameStreamer::writeClient(Client & c) {
+    while (!c.out.empty()) {
+        const std::vector<unsigned char> & d = *c.out.front().data;
+        ssize_t r = send(c.fd, d.data() + c.sent, d.size() - c.sent, MSG_NOSIGNAL);
+        if (r < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        c.sent += r;
+        if (c.sent < d.size()) continue;
+        if (c.out.front().frame) {
+            std::lock_guard<std::mutex> lk(mtx);
+            st.sent++;
+        }
+        c.out.pop_front();
+        c.sent = 0;
+    }
+    return !c.closing;
+}
+#else
+void FrameStreamer::post(std::shared_ptr<const std::vector<unsigned char>>) {}
+bool FrameStreamer::listen(const std::string &) {
+    fprintf(stderr, "stream: not supported on windows\n");
+    return false;
+}
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera.h"
+
+// serves the rendered view to browsers: http on "[host:]port" hands out a
+// self-contained page, which opens a websocket on the same port for the
+// frames and sends mouse input back. binds to localhost unless a host is
+// given, and needs nothing from the network.
+//
+// frames are encoded on worker threads, the newest frame wins: jpeg while the
+// view changes (lower quality during a drag), one png once it has settled for
+// a moment, and nothing while it stays the same. a client still receiving the last frame
+// skips the ones produced meanwhile.
+class FrameStreamer {
+public:
+    struct Stats {
+        size_t offered = 0, encoded = 0, unchanged = 0, sent = 0;
+    };
+    FrameStreamer(int threads = 2);
+    ~FrameStreamer();
+    bool listen(const std::string & address);
+    // somebody watches and an encoder is free, else the readback can be skipped
+    bool wants();
+    // recycled buffer to read the next frame into
+    std::vector<unsigned char> buffer();
+    // rgba pixels, bottom-up rows
+    void push(int w, int h, std::vector<unsigned char> && pixels);
+    // applies the mouse input received since the last call, true if it moved
+    bool applyInput(Camera & cam);
+    Stats stats();
+private:
+    struct Frame {
+        uint64_t seq;
+        int w, h;
+        std::vector<unsigned char> pixels;
+    };
+    struct Input {
+        int op; // 0 rotate, 1 translate, 2 zoom
+        glm::vec2 delta;
+    };
+    struct Out {
+        std::shared_ptr<const std::vector<unsigned char>> data;
+        bool frame;
+    };
+    struct Client {
+        int fd;
+        bool websocket = false, closing = false;
+        std::vector<unsigned char> in;
+        std::deque<Out> out;
+        size_t sent = 0; // of out.front()
+    };
+
+    int listenFd = -1, wake[2] = { -1, -1 };
+    std::string bindHost; // lowercased, as given to listen()
+    std::atomic<bool> stopping{ false };
+    std::thread io;
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Client>> clients; // io thread only
+    std::atomic<int> watching{ 0 };
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::unique_ptr<Frame> pending;
+    std::vector<std::vector<unsigned char>> pool;
+    int idle = 0;
+    uint64_t nextSeq = 0, postedSeq = 0;
+    uint64_t lastHash = 0;
+    bool lastLossless = false;
+    std::chrono::steady_clock::time_point changed;
+    std::deque<std::shared_ptr<const std::vector<unsigned char>>> ready;
+    std::vector<Input> inputs;
+    bool dragging = false;
+    Stats st;
+
+    void work();
+    void serve();
+    bool readClient(Client & c);
+    bool writeClient(Client & c);
+    void handshake(Client & c, size_t end);
+    void message(Client & c, int opcode, const unsigned char * data, size_t n);
+    void queue(Client & c, std::shared_ptr<const std::vector<unsigned char>> data, bool frame);
+    void post(std::shared_ptr<const std::vector<unsigned char>> data);
+};
@@ -0,0 +1,180 @@
+#include "threedbg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// producers publishing factories concurrently while snapshot() and working()
+// run alongside. every factory is stamped when submitted and again when its
+// drawer is first drawn; the ones never drawn, because a newer factory of
+// the same name replaced them first, count as dropped.
+//
+//   threedbg-stress [--producers n] [--drawers m] [--points p] [--rate hz]
+//                   [--seconds s] [--snapshot-ms ms] [--headless]
+
+typedef std::chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+struct Tally {
+    std::atomic<size_t> submitted{ 0 }, drawn{ 0 };
+    std::mutex mtx;
+    std::vector<double> latency; // ms from submission to the first draw
+    void shown(Clock::time_point submitted) {
+        const double ms = msSince(submitted);
+        drawn++;
+        std::lock_guard<std::mutex> lk(mtx);
+        latency.push_back(ms);
+    }
+};
+
+struct StampedDrawer : Drawer {
+    std::unique_ptr<Drawer> inner;
+    Clock::time_point submitted;
+    Tally * tally;
+    bool drawn = false;
+    StampedDrawer(Drawer * d, Clock::time_point t, Tally * tally) : inner(d), submitted(t), tally(tally) {
+        lo = d->lo; hi = d->hi;
+        gpuBytes = d->gpuBytes;
+    }
+    virtual void draw(const struct draw_param & dp) override {
+        inner->draw(dp);
+        if (!drawn) tally->shown(submitted);
+        drawn = true;
+    }
+    virtual bool view(DrawerView & v) const override { return inner->view(v); }
+};
+
+struct StampedFactory : DrawerFactory {
+    std::unique_ptr<DrawerFactory> inner;
+    Clock::time_point submitted = Clock::now();
+    Tally * tally;
+    StampedFactory(std::unique_ptr<DrawerFactory> f, Tally * tally) : inner(std::move(f)), tally(tally) {}
+    virtual Drawer * createDrawer() override {
+        Drawer * d = inner->createDrawer();
+        return d ? new StampedDrawer(d, submitted, tally) : nullptr;
+    }
+    virtual bool view(FactoryView & v) const override { return inner->view(v); }
+    virtual size_t hostBytes() const override { return inner->hostBytes(); }
+};
+
+int main(int argc, char ** argv) {
+    int producers = 4, drawers = 8, snapshotMs = 100;
+    size_t points = 100000;
+    double rate = 60, seconds = 10;
+    bool headless = false;
+    for (int i = 1; i < argc; i++) {
+        const bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--producers") && more) producers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--drawers") && more) drawers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--points") && more) points = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--rate") && more) rate = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--seconds") && more) seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--snapshot-ms") && more) snapshotMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--headless")) headless = true;
+        else {
+            fprintf(stderr, "usage: threedbg-stress [--producers n] [--drawers m] [--points p] [--rate hz]\n"
+                            "                       [--seconds s] [--snapshot-ms ms] [--headless]\n"
+                            "rate is per producer, 0 publishes as fast as possible. headless runs\n"
+                            "without a display thread, snapshots are then the only draws\n");
+            return 1;
+        }
+    }
+    producers = std::max(1, producers);
+    drawers = std::max(1, drawers);
+    threedbg::showGui = !headless;
+    threedbg::init();
+    Tally tally;
+    std::atomic<bool> running{ true };
+    std::vector<double> publishMs, snapshotLatency, workingMs;
+    std::mutex publishLock;
+
+    std::vector<std::thread> threads;
+    const auto start = Clock::now();
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p] {
+            std::vector<double> mine;
+            auto next = Clock::now();
+            for (size_t k = p; running; k += producers) {
+                auto f = std::make_unique<PointsDrawerFactory>();
+                f->particleRadius = 0.01f;
+                f->pos.resize(points);
+                f->col.assign(points, glm::fvec3((k % 7) / 7.f, 0.5f, 1 - (k % 5) / 5.f));
+                for (size_t i = 0; i < points; i++)
+                    f->pos[i] = glm::fvec3((i % 101) / 50.f - 1, (i / 101 % 101) / 50.f - 1, (k % drawers) / (float)drawers);
+                f->particleNumber = points;
+                auto t = Clock::now();
+                tally.submitted++;
+                threedbg::addDrawerFactory("d" + std::to_string(k % drawers),
+                                           std::make_unique<StampedFactory>(std::move(f), &tally));
+                mine.push_back(msSince(t));
+                if (rate > 0) {
+                    next += std::chrono::microseconds((long long)(1e6 / rate));
+                    std::this_thread::sleep_until(next);
+                }
+            }
+            std::lock_guard<std::mutex> lk(publishLock);
+            publishMs.insert(publishMs.end(), mine.begin(), mine.end());
+        });
+    }
+    if (snapshotMs > 0) {
+        threads.emplace_back([&] {
+            int w, h;
+            std::vector<unsigned char> pixels;
+            while (running) {
+                auto t = Clock::now();
+                threedbg::snapshot(w, h, pixels);
+                snapshotLatency.push_back(msSince(t));
+                std::this_thread::sleep_until(t + std::chrono::milliseconds(snapshotMs));
+            }
+        });
+    }
+    while (msSince(start) < seconds * 1e3) {
+        auto t = Clock::now();
+        if (!threedbg::working()) break;
+        workingMs.push_back(msSince(t));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    running = false;
+    for (auto & t : threads) t.join();
+    const double elapsed = msSince(start) * 1e-3;
+    threedbg::free(true);
+
+    std::vector<double> latency;
+    {
+        std::lock_guard<std::mutex> lk(tally.mtx);
+        latency = tally.latency;
+    }
+    // the last few in flight when the run stopped count as dropped too
+    const size_t dropped = tally.submitted - tally.drawn;
+    printf("{\n  \"producers\": %d, \"drawers\": %d, \"points\": %zu, \"rate\": %g, \"seconds\": %.3f,\n",
+           producers, drawers, points, rate, elapsed);
+    printf("  \"submitted\": %zu, \"drawn\": %zu, \"dropped\": %zu,\n",
+           tally.submitted.load(), tally.drawn.load(), dropped);
+    printf("  \"submit_per_s\": %.2f, \"drawn_per_s\": %.2f,\n",
+           tally.submitted / elapsed, tally.drawn / elapsed);
+    printf("  \"latency_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+           percentile(latency, 0.5), percentile(latency, 0.9), percentile(latency, 0.99), percentile(latency, 1));
+    printf("  \"publish_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+           percentile(publishMs, 0.5), percentile(publishMs, 0.99), percentile(publishMs, 1));
+    printf("  \"snapshot_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+           percentile(snapshotLatency, 0.5), percentile(snapshotLatency, 0.99), percentile(snapshotLatency, 1));
+    printf("  \"working_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f}\n}\n",
+           percentile(workingMs, 0.5), percentile(workingMs, 0.99), percentile(workingMs, 1));
+    return 0;
+}
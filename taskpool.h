@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads for data-parallel loops. the calling thread
+// takes part in the loop, so a pool of size 0 simply runs serially.
+class TaskPool {
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv, cv_done;
+    const std::function<void(size_t)> * job = nullptr;
+    size_t jobSize = 0;
+    std::atomic<size_t> next{ 0 };
+    size_t generation = 0;
+    int busy = 0;
+    bool stopping = false;
+
+    void run() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < jobSize) (*job)(i);
+    }
+public:
+    // threads < 0 picks one less than the number of cores
+    TaskPool(int threads = -1) {
+        if (threads < 0) threads = (int)std::thread::hardware_concurrency() - 1;
+        for (int t = 0; t < threads; t++)
+            workers.emplace_back([this] {
+                size_t seen = 0;
+                std::unique_lock<std::mutex> lk(mtx);
+                while (true) {
+                    while (!stopping && generation == seen) cv.wait(lk);
+                    if (stopping) return;
+                    seen = generation;
+                    busy++;
+                    lk.unlock();
+                    run();
+                    lk.lock();
+                    if (--busy == 0) cv_done.notify_all();
+                }
+            });
+    }
+    ~TaskPool() {
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto & t : workers) t.join();
+    }
+    int size() const { return (int)workers.size() + 1; }
+    // runs fn(i) for every i in [0, n) and returns when all are done.
+    // not reentrant: one loop at a time per pool
+    void parallelFor(size_t n, const std::function<void(size_t)> & fn) {
+        if (n == 0) return;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            // a worker that woke up late for the previous loop may still be leaving it
+            while (busy > 0) cv_done.wait(lk);
+            job = &fn; jobSize = n; next = 0;
+            generation++;
+        }
+        cv.notify_all();
+        run();
+        std::unique_lock<std::mutex> lk(mtx);
+        while (busy > 0 || next.load() < jobSize) {
+            if (busy == 0) { lk.unlock(); run(); lk.lock(); continue; }
+            cv_done.wait(lk);
+        }
+        job = nullptr; jobSize = 0;
+    }
+};
@@ -2,9 +2,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <map>
 #include <set>
+#include <algorithm>
 
+#include <atomic>
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -12,6 +16,12 @@
 #include "Application.h"
 
 #include "widgets.h"
+#include "downsample.h"
+#include "remote.h"
+#include "composite.h"
+#include "stream.h"
+#include "scene_io.h"
+#include "trace.h"
 
 #define errorfln(fmt, ...) fprintf(stderr, fmt"\n", __VA_ARGS__)
 
@@ -26,6 +36,61 @@ public:
     void loopOnce();
     void addDrawer(std::string name, std::unique_ptr<Drawer> d) {
         drawers[name] = std::move(d);
+        scene++;
+    }
+    // the upload is timed like the draws while profiling, and held to the budget
+    Drawer * createDrawer(const std::string & name, DrawerFactory & df) {
+        FactoryView v;
+        const bool viewable = df.view(v);
+        size_t bytes = 0;
+        if (viewable)
+            for (auto & st : v.streams) bytes += st.bytes;
+        if (!profiling) return budgetedCreate(name, df, viewable ? &v : nullptr, bytes);
+        DrawerTimer & t = timers[name];
+        threedbg::DrawerStats & s = stats[name];
+        if (!t.upload) glGenQueries(1, &t.upload);
+        const bool query = !t.uploadPending;
+        if (query) glBeginQuery(GL_TIME_ELAPSED, t.upload);
+        auto t0 = std::chrono::steady_clock::now();
+        Drawer * d = budgetedCreate(name, df, viewable ? &v : nullptr, bytes);
+        s.uploadCpuMs = msSince(t0);
+        if (query) {
+            glEndQuery(GL_TIME_ELAPSED);
+            t.uploadPending = true;
+        }
+        s.uploadBytes = bytes;
+        return d;
+    }
+    size_t budget = 0;
+    int budgetPolicy = threedbg::BUDGET_WARN;
+    std::atomic<size_t> pendingHostBytes{ 0 }; // kept by addDrawerFactory
+    size_t framebufferBytes() const {
+        return ctx.memoryUsed() + ds.target.bytes + (size_t)compositeSize.x * (size_t)compositeSize.y * 4;
+    }
+    size_t drawerBytes() const {
+        size_t n = 0;
+        for (auto & d : drawers) n += d.second->gpuBytes;
+        return n;
+    }
+    void memory(threedbg::MemoryStats & m) const {
+        for (auto & d : drawers) m.drawers[d.first].gpuBytes = d.second->gpuBytes;
+        m.gpuBytes = drawerBytes();
+        m.framebufferBytes = framebufferBytes();
+        m.gpuBudget = budget;
+    }
+    // renders without the gui, for streaming
+    void render() {
+        draw();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    // the frame last drawn by loopOnce() or render()
+    void readFrame(int & w, int & h, std::vector<unsigned char> & pixels) {
+        w = ctx.resolution[0]; h = ctx.resolution[1];
+        pixels.resize((size_t)w * h * 4);
+        glBindTexture(GL_TEXTURE_2D, ctx.texture);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glCheckError();
     }
     void snapshot(int & w, int & h, std::vector<unsigned char> & pixels) {
         draw();
@@ -35,10 +100,37 @@ public:
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glCheckError();
     }
+    bool snapshot(const threedbg::SnapshotOptions & opt, int & w, int & h, std::vector<unsigned char> & pixels);
+    void snapshotViews(const std::vector<Camera> & cams, std::vector<std::vector<unsigned char>> & pixels);
+    void snapshotAOV(unsigned channels, threedbg::SnapshotAOV & out);
+    bool snapshotTiled(const Camera & c, int tileSize, const threedbg::StripWriter & write);
+    bool exportScene(const std::string & path);
+    void setSamples(int samples) {
+        GLint maxSamples;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        ctx.samples = std::max(1, std::min(samples, (int)maxSamples));
+    }
     void barrier() {
         em.barrier();
     }
     Camera cam;
+    // loopOnce() redraws the view only when something it depends on moved
+    // since, the gui can't tell as the image keeps its texture
+    size_t scene = 1; // new drawers, and snapshots drawing into ctx
+    struct {
+        size_t scene = 0;
+        Camera cam;
+        std::set<std::string> invisible;
+        int samples = 0;
+    } shown;
+    bool viewChanged() const {
+        // the profile times the draws, so while profiling every frame draws
+        if (profiling) return true;
+        const Camera & c = shown.cam;
+        return shown.scene != scene || shown.samples != ctx.samples || shown.invisible != invisible ||
+               c.eye != cam.eye || c.center != cam.center || c.up != cam.up ||
+               c.target_size != cam.target_size || c.resolution != cam.resolution;
+    }
     std::vector<std::string> getInvisible() {
         std::vector<std::string> r;
         for (auto &t : invisible)
@@ -49,39 +141,248 @@ public:
     void setInvisible(std::vector<std::string> tl) {
         invisible = std::set<std::string>(tl.begin(), tl.end());
     }
+    void addPanel(const std::string & name, std::function<void()> show) {
+        if (show) panels[name] = std::move(show);
+        else panels.erase(name);
+    }
+    // shown in the "composite" window from the next frame on
+    void showComposite(int w, int h, const unsigned char * rgba) {
+        if (!compositeTex) {
+            glGenTextures(1, &compositeTex);
+            glBindTexture(GL_TEXTURE_2D, compositeTex);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        glBindTexture(GL_TEXTURE_2D, compositeTex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glCheckError();
+        compositeSize = ImVec2(w, h);
+        markDirty();
+    }
+    void setProfiling(bool on) {
+        if (on && !profiling) { // the numbers start over
+            stats.clear();
+            for (auto & t : timers) t.second.samples = 0;
+        }
+        profiling = on;
+        markDirty();
+    }
+    bool profiling = false;
+    std::map<std::string, threedbg::DrawerStats> stats;
 private:
     DrawingCtx ctx;
-    ImageViewer iv;
+    Downsampler ds;
+    ImageViewer iv, compositeView;
+    GLuint compositeTex = 0;
+    ImVec2 compositeSize;
     ExecuteManager em;
+    ScopeView scopes;
+    PlotView plots;
 
     std::map<std::string, struct std::unique_ptr<Drawer>> drawers;
     std::set<std::string> invisible;
-    void draw() {
-        ctx.bindFB(cam.resolution.x, cam.resolution.y);
-        glClearColor(0.5, 0.5, 0.5, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    std::map<std::string, std::function<void()>> panels;
+    // timer queries of one drawer still in flight, read once available
+    struct DrawerTimer {
+        static const int N = 4;
+        GLuint draw[N] = {}, upload = 0;
+        int head = 0, pending = 0;
+        size_t samples = 0;
+        bool uploadPending = false;
+    };
+    std::map<std::string, DrawerTimer> timers;
+    bool overBudget = false; // reported once until uploads fit again
+    Drawer * budgetedCreate(const std::string & name, DrawerFactory & df, const FactoryView * v, size_t bytes) {
+        auto old = drawers.find(name);
+        // the drawer it replaces goes once the new one is in
+        const size_t used = drawerBytes() + framebufferBytes() - (old != drawers.end() ? old->second->gpuBytes : 0);
+        Drawer * d = nullptr;
+        if (!budget || used + bytes <= budget || budgetPolicy == threedbg::BUDGET_WARN) {
+            if (budget && used + bytes > budget && !overBudget)
+                errorfln("threedbg: drawer %s goes past the gpu budget, %.1f of %.1f MiB",
+                         name.c_str(), (used + bytes) / 1048576.0, budget / 1048576.0);
+            overBudget = budget && used + bytes > budget;
+            d = df.createDrawer();
+            if (!d) errorfln("drawer %s could not be created", name.c_str());
+            return d;
+        }
+        if (budgetPolicy == threedbg::BUDGET_DOWNSAMPLE && v && used < budget) d = thinned(*v, budget - used);
+        if (!overBudget) {
+            if (d) errorfln("threedbg: drawer %s thinned out to fit the gpu budget of %.1f MiB", name.c_str(), budget / 1048576.0);
+            else errorfln("threedbg: drawer %s refused, it would need %.1f of %.1f MiB gpu budget",
+                          name.c_str(), (used + bytes) / 1048576.0, budget / 1048576.0);
+        }
+        overBudget = true;
+        return d;
+    }
+    // every k-th point or line, with k large enough to fit in `avail`
+    static Drawer * thinned(const FactoryView & v, size_t avail) {
+        size_t unit = sizeof(glm::fvec3), bytes = 0;
+        if (v.type == "lines") unit *= 2;
+        else if (v.type != "points") return nullptr;
+        if (v.streams.empty()) return nullptr;
+        for (auto & s : v.streams) bytes += s.bytes;
+        const size_t n = v.streams[0].bytes / unit, k = (bytes + avail - 1) / avail, m = n / k;
+        FactoryView t = v;
+        std::vector<std::vector<unsigned char>> data(v.streams.size());
+        for (size_t i = 0; i < v.streams.size(); i++) {
+            if (v.streams[i].bytes != n * unit) continue; // not per vertex
+            data[i].resize(m * unit);
+            for (size_t j = 0; j < m; j++)
+                memcpy(&data[i][j * unit], (const unsigned char *)v.streams[i].data + j * k * unit, unit);
+            t.streams[i] = FactoryView::Stream{ data[i].data(), data[i].size() };
+        }
+        return uploadFactory(t);
+    }
+    // running mean over the first n samples, then over about the last 30
+    static void rolling(double & avg, double x, size_t n) {
+        avg += (x - avg) / (double)std::min<size_t>(n + 1, 30);
+    }
+    static double msSince(std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+    }
+    void collectTimers() {
+        for (auto & t : timers) {
+            DrawerTimer & dt = t.second;
+            threedbg::DrawerStats & s = stats[t.first];
+            GLint ready = 0;
+            GLuint64 ns = 0;
+            while (dt.pending) {
+                GLuint q = dt.draw[(dt.head - dt.pending + DrawerTimer::N) % DrawerTimer::N];
+                glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &ready);
+                if (!ready) break;
+                glGetQueryObjectui64v(q, GL_QUERY_RESULT, &ns);
+                rolling(s.gpuMs, ns * 1e-6, dt.samples++);
+                dt.pending--;
+            }
+            if (dt.uploadPending) {
+                glGetQueryObjectiv(dt.upload, GL_QUERY_RESULT_AVAILABLE, &ready);
+                if (ready) {
+                    glGetQueryObjectui64v(dt.upload, GL_QUERY_RESULT, &ns);
+                    s.uploadGpuMs = ns * 1e-6;
+                    dt.uploadPending = false;
+                }
+            }
+        }
+    }
+    void draw(unsigned attachments = 0) {
+        ctx.bindFB(cam.resolution.x, cam.resolution.y, GL_RGBA8, attachments);
+        ctx.clear(0.5, 0.5, 0.5, 0);
+        drawScene(cam, glm::mat4(1), profiling);
+        ctx.resolve();
+    }
+    // `crop` maps the camera's clip space onto a sub-rectangle (tiled rendering)
+    void drawScene(const Camera & c, const glm::mat4 & crop = glm::mat4(1), bool timed = false) {
         struct draw_param dp;
         {
-            auto mat = cam.getMat();
+            auto mat = crop * c.getMat();
             memcpy(&dp.mat, &mat, 16 * sizeof(float));
-            dp.cam = cam;
+            dp.cam = c;
         }
-        for (auto & d : drawers)
-            if (invisible.find(d.first) == invisible.end())
+        dp.drawerId = 0;
+        if (timed) collectTimers();
+        for (auto & d : drawers) {
+            dp.drawerId++;
+            if (invisible.find(d.first) != invisible.end()) continue;
+            if (outside(dp.mat, d.second->lo, d.second->hi)) continue;
+            trace::Scope span(trace::enabled ? trace::intern(d.first) : "", "draw");
+            if (!timed) {
                 d.second->draw(dp);
+                continue;
+            }
+            DrawerTimer & t = timers[d.first];
+            threedbg::DrawerStats & s = stats[d.first];
+            if (!t.draw[0]) glGenQueries(DrawerTimer::N, t.draw);
+            // with all queries in flight this draw goes without gpu time
+            const bool query = t.pending < DrawerTimer::N;
+            if (query) glBeginQuery(GL_TIME_ELAPSED, t.draw[t.head]);
+            auto t0 = std::chrono::steady_clock::now();
+            d.second->draw(dp);
+            rolling(s.cpuMs, msSince(t0), s.draws++);
+            if (query) {
+                glEndQuery(GL_TIME_ELAPSED);
+                t.head = (t.head + 1) % DrawerTimer::N;
+                t.pending++;
+            }
+        }
     }
     void ImGuiManipulateCamera() {
         cam.ImGuiDrag();
         cam.ImGuiEdit();
+        int msaa = 0;
+        while (msaa < 3 && (2 << msaa) <= ctx.samples) msaa++;
+        if (ImGui::Combo("msaa", &msaa, "off\0" "2x\0" "4x\0" "8x\0"))
+            setSamples(msaa ? 1 << msaa : 1);
     }
+    // true if the box lies entirely beyond one of the clip planes
+    static bool outside(const float (&m)[4][4], const glm::fvec3 & lo, const glm::fvec3 & hi) {
+        if (lo.x > hi.x) return false;
+        int out[6] = {};
+        for (int i = 0; i < 8; i++) {
+            const float c[3] = { i & 1 ? hi.x : lo.x, i & 2 ? hi.y : lo.y, i & 4 ? hi.z : lo.z };
+            float p[4];
+            for (int r = 0; r < 4; r++)
+                p[r] = m[0][r] * c[0] + m[1][r] * c[1] + m[2][r] * c[2] + m[3][r];
+            out[0] += p[0] < -p[3]; out[1] += p[0] > p[3];
+            out[2] += p[1] < -p[3]; out[3] += p[1] > p[3];
+            out[4] += p[2] < -p[3]; out[5] += p[2] > p[3];
+        }
+        for (int k : out)
+            if (k == 8) return true;
+        return false;
+    }
+    void ImGuiSwitchDrawer(const std::string & name, const char * label) {
+        auto it = invisible.find(name);
+        bool vf = (it == invisible.end());
+        if (ImGui::Checkbox(label, &vf)) {
+            if (vf) invisible.erase(it);
+            else invisible.insert(name);
+        }
+        auto d = drawers.find(name);
+        if (d != drawers.end() && d->second->gpuBytes) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("%.1f MiB", d->second->gpuBytes / 1048576.0);
+        }
+        auto st = stats.find(name);
+        if (!profiling || st == stats.end()) return;
+        const threedbg::DrawerStats & s = st->second;
+        ImGui::SameLine();
+        ImGui::TextDisabled("gpu %.2f cpu %.2f ms", s.gpuMs, s.cpuMs);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("upload: %.2f ms gpu, %.2f ms cpu, %.1f MiB\n%zu draws timed",
+                              s.uploadGpuMs, s.uploadCpuMs, s.uploadBytes / 1048576.0, s.draws);
+    }
+    // names like "rank3/points" are grouped under their prefix
     void ImGuiSwitchDrawers() {
-        for (auto & d : drawers) {
-            auto it = invisible.find(d.first);
-            bool vf = (it == invisible.end());
-            if (ImGui::Checkbox(d.first.c_str(), &vf)) {
-                if (vf) invisible.erase(it);
-                else invisible.insert(d.first);
+        for (auto it = drawers.begin(); it != drawers.end();) {
+            size_t slash = it->first.find('/');
+            if (slash == std::string::npos) {
+                ImGuiSwitchDrawer(it->first, it->first.c_str());
+                ++it;
+                continue;
             }
+            const std::string group = it->first.substr(0, slash + 1);
+            auto end = it;
+            bool all = true;
+            for (; end != drawers.end() && end->first.compare(0, group.size(), group) == 0; ++end)
+                all = all && invisible.find(end->first) == invisible.end();
+            ImGui::PushID(group.c_str());
+            if (ImGui::Checkbox("##all", &all)) {
+                for (auto i = it; i != end; ++i) {
+                    if (all) invisible.erase(i->first);
+                    else invisible.insert(i->first);
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::TreeNode(group.c_str())) {
+                for (auto i = it; i != end; ++i)
+                    ImGuiSwitchDrawer(i->first, i->first.c_str() + group.size());
+                ImGui::TreePop();
+            }
+            ImGui::PopID();
+            it = end;
         }
     }
 };
@@ -92,14 +393,248 @@ ThreedbgApp::ThreedbgApp(int width, int height) : Application("3D debug", 0, wid
     glEnable(GL_DEPTH_TEST);
     PointsDrawer::initGL();
     LinesDrawer::initGL();
+    Downsampler::initGL();
     glCheckError();
 }
 ThreedbgApp::~ThreedbgApp() {
+    for (auto & t : timers) {
+        glDeleteQueries(DrawerTimer::N, t.second.draw);
+        glDeleteQueries(1, &t.second.upload);
+    }
+    if (compositeTex) glDeleteTextures(1, &compositeTex);
+    Downsampler::freeGL();
     LinesDrawer::freeGL();
     PointsDrawer::freeGL();
     glCheckError();
     em.setState(ExecuteManager::RUNNING);
 }
+// crops and shrinks on the gpu so that only the requested pixels are transferred
+bool ThreedbgApp::snapshot(const threedbg::SnapshotOptions & opt, int & w, int & h, std::vector<unsigned char> & pixels) {
+    static const GLenum glFormat[] = { GL_RGBA, GL_RGB, GL_BGRA, GL_RED };
+    static const int channels[] = { 4, 3, 4, 1 };
+    if (opt.format < 0 || opt.format > threedbg::PIXEL_R8) return false;
+    draw();
+    int x = std::max(0, opt.x), y = std::max(0, opt.y);
+    w = opt.w > 0 ? opt.w : cam.resolution.x - x;
+    h = opt.h > 0 ? opt.h : cam.resolution.y - y;
+    w = std::min(w, cam.resolution.x - x);
+    h = std::min(h, cam.resolution.y - y);
+    const int factor = std::max(1, opt.downsample);
+    bool ok = w > 0 && h > 0;
+    if (ok && (factor > 1 || opt.format == threedbg::PIXEL_R8)) {
+        ds.run(ctx.texture, x, y, w, h, factor, opt.format == threedbg::PIXEL_R8);
+        x = y = 0;
+        w = ds.target.resolution[0]; h = ds.target.resolution[1];
+    }
+    const size_t bytes = ok ? (size_t)w * h * channels[opt.format] : 0;
+    unsigned char * dst = nullptr;
+    if (!ok) {
+        w = h = 0;
+    } else if (opt.out) {
+        if (opt.capacity >= bytes) dst = opt.out;
+        else errorfln("snapshot buffer holds %zu bytes, %zu needed", opt.capacity, bytes);
+    } else {
+        pixels.resize(bytes);
+        dst = pixels.data();
+    }
+    if (dst) {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(x, y, w, h, glFormat[opt.format], GL_UNSIGNED_BYTE, dst);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glCheckError();
+    return dst != nullptr;
+}
+
+// all views are rendered side by side into one atlas framebuffer and read
+// back with a single transfer, views that do not fit go to another batch
+void ThreedbgApp::snapshotViews(const std::vector<Camera> & cams, std::vector<std::vector<unsigned char>> & pixels) {
+    scene++; // ctx no longer holds the view
+    pixels.resize(cams.size());
+    GLint maxSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    std::vector<unsigned char> atlas;
+    size_t first = 0;
+    while (first < cams.size()) {
+        // shelf packing, rows roughly as wide as the atlas is tall
+        double area = 0;
+        int widest = 0;
+        for (size_t i = first; i < cams.size(); i++) {
+            area += (double)cams[i].resolution.x * cams[i].resolution.y;
+            widest = std::max(widest, cams[i].resolution.x);
+        }
+        int rowLimit = std::min<int>(maxSize, std::max<int>(widest, (int)ceil(sqrt(area))));
+        std::vector<glm::ivec2> origin;
+        int x = 0, y = 0, rowHeight = 0, atlasWidth = 0;
+        size_t last = first;
+        for (; last < cams.size(); last++) {
+            glm::ivec2 r = cams[last].resolution;
+            if (r.x > maxSize || r.y > maxSize) {
+                errorfln("view %zu (%dx%d) exceeds GL_MAX_TEXTURE_SIZE", last, r.x, r.y);
+                break;
+            }
+            if (x + r.x > rowLimit) { x = 0; y += rowHeight; rowHeight = 0; }
+            if (y + r.y > maxSize) break;
+            origin.push_back(glm::ivec2(x, y));
+            x += r.x;
+            rowHeight = std::max(rowHeight, r.y);
+            atlasWidth = std::max(atlasWidth, x);
+        }
+        if (last == first) { // oversized view, leave it empty
+            pixels[first].clear();
+            first++;
+            continue;
+        }
+        int atlasHeight = y + rowHeight;
+
+        ctx.bindFB(atlasWidth, atlasHeight);
+        glEnable(GL_SCISSOR_TEST);
+        for (size_t i = first; i < last; i++) {
+            glm::ivec2 o = origin[i - first], r = cams[i].resolution;
+            glViewport(o.x, o.y, r.x, r.y);
+            glScissor(o.x, o.y, r.x, r.y);
+            ctx.clear(0.5, 0.5, 0.5, 0);
+            drawScene(cams[i]);
+        }
+        glDisable(GL_SCISSOR_TEST);
+        glViewport(0, 0, atlasWidth, atlasHeight);
+        ctx.resolve();
+
+        atlas.resize((size_t)atlasWidth * atlasHeight * 4);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, atlasWidth, atlasHeight, GL_RGBA, GL_UNSIGNED_BYTE, atlas.data());
+        for (size_t i = first; i < last; i++) {
+            glm::ivec2 o = origin[i - first], r = cams[i].resolution;
+            pixels[i].resize((size_t)r.x * r.y * 4);
+            for (int row = 0; row < r.y; row++)
+                memcpy(&pixels[i][(size_t)row * r.x * 4],
+                       &atlas[((size_t)(o.y + row) * atlasWidth + o.x) * 4], (size_t)r.x * 4);
+        }
+        first = last;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glCheckError();
+}
+
+// one pass renders color and whichever aux outputs are requested
+void ThreedbgApp::snapshotAOV(unsigned channels, threedbg::SnapshotAOV & out) {
+    scene++; // ctx no longer holds the view
+    unsigned attachments = 0;
+    if (channels & threedbg::AOV_DEPTH) attachments |= FrameBuffer::ATTACH_DEPTH;
+    if (channels & (threedbg::AOV_DRAWER_ID | threedbg::AOV_PRIMITIVE_ID)) attachments |= FrameBuffer::ATTACH_ID;
+    draw(attachments);
+    const int w = out.w = cam.resolution[0], h = out.h = cam.resolution[1];
+    const size_t n = (size_t)w * h;
+    out.drawers.clear();
+    for (auto & d : drawers) out.drawers.push_back(d.first);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    if (channels & threedbg::AOV_COLOR) {
+        out.color.resize(n * 4);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, out.color.data());
+    } else out.color.clear();
+    if (channels & threedbg::AOV_DEPTH) {
+        out.depth.resize(n);
+        glReadBuffer(GL_COLOR_ATTACHMENT1);
+        glReadPixels(0, 0, w, h, GL_RED, GL_FLOAT, out.depth.data());
+    } else out.depth.clear();
+    out.drawerId.clear(); out.primitiveId.clear();
+    if (attachments & FrameBuffer::ATTACH_ID) {
+        std::vector<unsigned> ids(n * 2);
+        glReadBuffer(GL_COLOR_ATTACHMENT2);
+        glReadPixels(0, 0, w, h, GL_RG_INTEGER, GL_UNSIGNED_INT, ids.data());
+        if (channels & threedbg::AOV_DRAWER_ID) {
+            out.drawerId.resize(n);
+            for (size_t i = 0; i < n; i++) out.drawerId[i] = ids[2 * i];
+        }
+        if (channels & threedbg::AOV_PRIMITIVE_ID) {
+            out.primitiveId.resize(n);
+            for (size_t i = 0; i < n; i++) out.primitiveId[i] = ids[2 * i + 1];
+        }
+    }
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glCheckError();
+}
+
+// renders c.resolution in tiles through one small pooled framebuffer. each
+// tile is drawn with a guard band since point sprites are clipped by their
+// centers, rows are handed out as full-width strips from the top down.
+bool ThreedbgApp::snapshotTiled(const Camera & c, int tileSize, const threedbg::StripWriter & write) {
+    scene++; // ctx no longer holds the view
+    const int W = c.resolution.x, H = c.resolution.y;
+    const int guard = 64;
+    GLint maxDims[2];
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxDims);
+    tileSize = std::max(1, std::min(tileSize, std::min(maxDims[0], maxDims[1]) - 2 * guard));
+    const int fbSize = tileSize + 2 * guard;
+    std::vector<unsigned char> tile((size_t)tileSize * tileSize * 4), strip;
+    bool ok = true;
+    for (int top = 0; top < H && ok; top += tileSize) {
+        const int rows = std::min(tileSize, H - top);
+        const int y0 = H - top - rows; // gl rows are counted from the bottom
+        strip.resize((size_t)W * rows * 4);
+        for (int x0 = 0; x0 < W; x0 += tileSize) {
+            const int cols = std::min(tileSize, W - x0);
+            // clip space of the guarded tile: scale the full frustum by W/fbSize
+            // and shift the tile center onto the origin
+            const float sx = (float)W / fbSize, sy = (float)H / fbSize;
+            const float cx = 2.f * (x0 - guard + fbSize * 0.5f) / W - 1.f;
+            const float cy = 2.f * (y0 - guard + fbSize * 0.5f) / H - 1.f;
+            glm::mat4 crop(1);
+            crop[0][0] = sx; crop[1][1] = sy;
+            crop[3][0] = -sx * cx; crop[3][1] = -sy * cy;
+
+            ctx.bindFB(fbSize, fbSize);
+            ctx.clear(0.5, 0.5, 0.5, 0);
+            drawScene(c, crop);
+            ctx.resolve();
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(guard, guard, cols, rows, GL_RGBA, GL_UNSIGNED_BYTE, tile.data());
+            for (int r = 0; r < rows; r++)
+                memcpy(&strip[((size_t)(rows - 1 - r) * W + x0) * 4], &tile[(size_t)r * cols * 4], (size_t)cols * 4);
+        }
+        ok = write(top, rows, strip.data());
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glCheckError();
+    return ok;
+}
+
+// reads the drawers' buffers back a chunk at a time, the scene is not copied
+// to host memory as a whole
+bool ThreedbgApp::exportScene(const std::string & path) {
+    std::vector<SceneItem> items;
+    std::vector<DrawerView> views;
+    for (auto & d : drawers) {
+        DrawerView v;
+        if (!d.second->view(v) || (v.type != "points" && v.type != "lines") || v.buffers.size() < 2) {
+            errorfln("threedbg: drawer '%s' cannot be exported, skipped", d.first.c_str());
+            continue;
+        }
+        SceneItem it;
+        it.name = d.first;
+        it.lines = v.type == "lines";
+        it.radius = v.params.empty() ? 0 : v.params[0];
+        it.vertices = v.vertices;
+        items.push_back(it);
+        views.push_back(v);
+    }
+    bool ok = writeScene(path, items, [&](size_t i, int stream, size_t first, size_t n, glm::fvec3 * out) {
+        glBindBuffer(GL_ARRAY_BUFFER, views[i].buffers[stream]);
+        GLint64 bytes = 0;
+        glGetBufferParameteri64v(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &bytes);
+        // a color buffer may be shorter than the positions
+        const size_t have = std::min(n, (size_t)std::max<GLint64>(0, bytes / (GLint64)sizeof(glm::fvec3) - (GLint64)first));
+        if (have) glGetBufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::fvec3), have * sizeof(glm::fvec3), out);
+        std::fill(out + have, out + n, glm::fvec3(0));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return glGetError() == GL_NO_ERROR;
+    });
+    glCheckError();
+    return ok;
+}
+
 void ThreedbgApp::loopOnce() {
     glCheckError();
     Application::newFrame();
@@ -113,7 +648,8 @@ void ThreedbgApp::loopOnce() {
         drawList->PushClipRectFullScreen();
         {
             char text[64];
-            sprintf(text, "%.1f fps", ImGui::GetIO().Framerate);
+            // whole numbers, a jittering digit would make every frame new
+            sprintf(text, "%.0f fps", ImGui::GetIO().Framerate);
             ImVec2 size = ImGui::CalcTextSize(text);
             drawList->AddText(ImVec2(io.DisplaySize.x - size.x - 4, io.DisplaySize.y - size.y - 4), 0xff000000, text);
         }
@@ -121,6 +657,15 @@ void ThreedbgApp::loopOnce() {
     }
 
     if (ImGui::Begin("drawers")) {
+        bool p = profiling;
+        if (ImGui::Checkbox("profile", &p)) setProfiling(p);
+        ImGui::SameLine();
+        const size_t gpu = drawerBytes() + framebufferBytes();
+        if (budget) ImGui::Text("gpu %.1f / %.1f MiB", gpu / 1048576.0, budget / 1048576.0);
+        else ImGui::Text("gpu %.1f MiB", gpu / 1048576.0);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("drawers %.1f MiB, framebuffers %.1f MiB\nfactories waiting for upload %.1f MiB",
+                              drawerBytes() / 1048576.0, framebufferBytes() / 1048576.0, pendingHostBytes / 1048576.0);
         ImGuiSwitchDrawers();
     }
     ImGui::End();
@@ -129,7 +674,14 @@ void ThreedbgApp::loopOnce() {
     }
     ImGui::End();
 
-    draw();
+    if (viewChanged()) {
+        draw();
+        shown.scene = scene;
+        shown.cam = cam;
+        shown.invisible = invisible;
+        shown.samples = ctx.samples;
+        markDirty();
+    }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     if (ImGui::Begin("image")) {
@@ -142,6 +694,36 @@ void ThreedbgApp::loopOnce() {
     }
     ImGui::End();
 
+    scopes.collect();
+    if (!scopes.empty()) {
+        if (ImGui::Begin("scopes")) {
+            scopes.Show();
+        }
+        ImGui::End();
+    }
+
+    plots.collect();
+    if (!plots.empty()) {
+        if (ImGui::Begin("plots")) {
+            plots.Show();
+        }
+        ImGui::End();
+    }
+
+    if (compositeTex) {
+        if (ImGui::Begin("composite")) {
+            compositeView.Show(compositeTex, compositeSize);
+        }
+        ImGui::End();
+    }
+
+    for (auto & p : panels) {
+        if (ImGui::Begin(p.first.c_str())) {
+            p.second();
+        }
+        ImGui::End();
+    }
+
     //ImGui::ShowDemoWindow();
 
     Application::endFrame();
@@ -155,6 +737,17 @@ void ThreedbgApp::loopOnce() {
 namespace threedbg {
 // basicly ThreedbgApp + thread-safe drawerfactories as cache
 bool showGui = true;
+std::string viewer = getenv("THREEDBG_VIEWER") ? getenv("THREEDBG_VIEWER") : "";
+std::string stream = getenv("THREEDBG_STREAM") ? getenv("THREEDBG_STREAM") : "";
+std::string profile = getenv("THREEDBG_PROFILE") ? getenv("THREEDBG_PROFILE") : "";
+std::string traceFile = getenv("THREEDBG_TRACE") ? getenv("THREEDBG_TRACE") : "";
+static int envInt(std::initializer_list<const char *> names, int fallback) {
+    for (const char * n : names)
+        if (getenv(n)) return atoi(getenv(n));
+    return fallback;
+}
+int rank = envInt({ "THREEDBG_RANK", "OMPI_COMM_WORLD_RANK", "PMI_RANK", "SLURM_PROCID" }, -1);
+int ranks = envInt({ "THREEDBG_RANKS", "OMPI_COMM_WORLD_SIZE", "PMI_SIZE", "SLURM_NTASKS" }, 0);
 static std::thread displayThread;
 #ifdef _MSC_VER
 class queued_lock {
@@ -187,32 +780,87 @@ static queued_lock context_lock;
 static queued_lock cache_lock;
 static bool allow_free = false;
 
-static std::map<std::string, std::unique_ptr<DrawerFactory>> drawerFactories;
+// waits show up in the trace, see trace.h
+static void lockTraced(queued_lock & l, const char * what) {
+    trace::Scope s(what, "lock");
+    l.lock();
+}
+
+// shared so a running capture can serialize factories after the display
+// thread has uploaded and released them
+static std::map<std::string, std::shared_ptr<DrawerFactory>> drawerFactories;
 static std::unique_ptr<ThreedbgApp> app = nullptr;
+static std::mutex record_lock;
+static std::unique_ptr<Recorder> recorder = nullptr;
+static std::mutex capture_lock;
+static std::unique_ptr<CaptureWriter> capture = nullptr;
+// set when rendering in a viewer process, app is null then
+static std::unique_ptr<RemoteClient> client = nullptr;
+static std::mutex composite_lock;
+static std::unique_ptr<Compositor> compositor = nullptr;
+static std::unique_ptr<FrameStreamer> streamer = nullptr;
+
+static bool inProcess(const char * what) {
+    if (!client) return true;
+    errorfln("threedbg: %s needs the in-process viewer", what);
+    return false;
+}
 
 static void flushDrawers() {
-    std::map<std::string, std::unique_ptr<DrawerFactory>> dfs = std::move(drawerFactories);
+    trace::Scope s("flushDrawers");
+    std::map<std::string, std::shared_ptr<DrawerFactory>> dfs = std::move(drawerFactories);
     drawerFactories.clear();
-    for (auto & p : dfs)
-        app->addDrawer(p.first, std::unique_ptr<Drawer>(p.second->createDrawer()));
+    app->pendingHostBytes = 0;
+    for (auto & p : dfs) {
+        trace::Scope u(trace::enabled ? trace::intern(p.first) : "", "upload");
+        Drawer * d = app->createDrawer(p.first, *p.second);
+        if (d) app->addDrawer(p.first, std::unique_ptr<Drawer>(d));
+    }
 }
 
 void init(void) {
-    if (showGui) {
+    if (!traceFile.empty()) trace::start();
+    if (!viewer.empty()) {
+        client = std::make_unique<RemoteClient>();
+        if (client->connect(viewer, rank, ranks)) return;
+        errorfln("threedbg: no viewer at %s, rendering in-process", viewer.c_str());
+        client.reset(nullptr);
+    }
+    if (!stream.empty()) {
+        streamer = std::make_unique<FrameStreamer>();
+        if (!streamer->listen(stream)) streamer.reset(nullptr);
+    }
+    if (showGui || streamer) {
         allow_free = false;
         displayThread = std::thread([&](void) { // new thread for opengl display
-            context_lock.lock();
+            trace::nameThread("display");
+            lockTraced(context_lock, "wait context_lock");
             app = std::make_unique<ThreedbgApp>();
-            app->show();
+            if (showGui) app->show();
+            else app->hide();
             app->unbindContext();
             context_lock.unlock();
+            std::vector<unsigned char> frame;
             while (!app->shouldClose()) {
-                cache_lock.lock();
-                context_lock.lock();
+                lockTraced(cache_lock, "wait cache_lock");
+                lockTraced(context_lock, "wait context_lock");
                 app->bindContext();
                 flushDrawers();
                 cache_lock.unlock();
-                app->loopOnce();
+                if (streamer) streamer->applyInput(app->cam);
+                {
+                    trace::Scope f("frame");
+                    if (showGui) app->loopOnce();
+                    else app->render();
+                }
+                // no readback while nobody watches or the encoders are busy
+                if (streamer && streamer->wants()) {
+                    trace::Scope r("stream readback");
+                    int w, h;
+                    frame = streamer->buffer();
+                    app->readFrame(w, h, frame);
+                    streamer->push(w, h, std::move(frame));
+                }
                 app->unbindContext();
                 context_lock.unlock();
                 // limit fps
@@ -232,47 +880,370 @@ void init(void) {
         app->hide();
         app->unbindContext();
     }
+    if (!profile.empty()) setProfiling(true);
 }
 void free(bool force) {
-    context_lock.lock();
-    if (force) app->close();
+    if (client) {
+        client->bye(force);
+        client.reset(nullptr);
+        return;
+    }
+    if (!profile.empty()) writeDrawerStats(profile);
+    if (!traceFile.empty()) trace::write(traceFile);
+    lockTraced(context_lock, "wait context_lock");
+    // a hidden window (streaming only) has nobody to close it
+    if (force || !showGui) app->close();
     context_lock.unlock();
     allow_free = true;
-    if (showGui) displayThread.join();
+    if (displayThread.joinable()) displayThread.join();
     else {
         app->bindContext();
         app.reset(nullptr);
     }
+    streamer.reset(nullptr);
 }
 void addDrawerFactory(std::string name, std::unique_ptr<DrawerFactory> && df) {
-    cache_lock.lock();
-    drawerFactories[name] = std::move(df);
+    trace::Scope s("addDrawerFactory");
+    std::shared_ptr<DrawerFactory> sdf(std::move(df));
+    {
+        std::lock_guard<std::mutex> lk(capture_lock);
+        if (capture) capture->add(name, sdf);
+    }
+    if (client) {
+        client->addFactory(name, *sdf);
+        return;
+    }
+    const size_t bytes = sdf->hostBytes();
+    lockTraced(cache_lock, "wait cache_lock");
+    std::shared_ptr<DrawerFactory> & slot = drawerFactories[name];
+    app->pendingHostBytes += bytes - (slot ? slot->hostBytes() : 0);
+    slot = std::move(sdf);
     cache_lock.unlock();
 }
 bool working(void) {
-    if (showGui) app->barrier();
-    context_lock.lock();
+    ScopeView::step();
+    {
+        std::lock_guard<std::mutex> lk(capture_lock);
+        if (capture && client) {
+            capture->endFrame(client->cam, client->invisible);
+        } else if (capture) {
+            lockTraced(context_lock, "wait context_lock");
+            Camera cam = app->cam;
+            std::vector<std::string> invisible = app->getInvisible();
+            context_lock.unlock();
+            capture->endFrame(cam, invisible);
+        }
+    }
+    if (client) return client->step();
+    if (showGui) {
+        trace::Scope s("barrier");
+        app->barrier();
+    }
+    lockTraced(context_lock, "wait context_lock");
     bool r = !app->shouldClose();
     context_lock.unlock();
     return r;
 }
 void snapshot(int & w, int & h, std::vector<unsigned char> & pixels) {
-    cache_lock.lock();
-    context_lock.lock();
+    trace::Scope t("snapshot");
+    if (client) {
+        client->snapshot(0, 0, 0, 0, 1, PIXEL_RGBA8, w, h, pixels);
+    } else {
+        lockTraced(cache_lock, "wait cache_lock");
+        lockTraced(context_lock, "wait context_lock");
+        app->bindContext();
+        flushDrawers();
+        app->snapshot(w, h, pixels);
+        app->unbindContext();
+        context_lock.unlock();
+        cache_lock.unlock();
+    }
+    std::lock_guard<std::mutex> lk(record_lock);
+    if (recorder && recorder->reserve()) {
+        std::vector<unsigned char> buf = recorder->buffer();
+        buf.assign(pixels.begin(), pixels.end());
+        recorder->push(w, h, std::move(buf));
+    }
+}
+bool snapshot(const SnapshotOptions & opt, int & w, int & h, std::vector<unsigned char> & pixels) {
+    trace::Scope t("snapshot");
+    if (client) {
+        std::vector<unsigned char> buf;
+        bool r = client->snapshot(opt.x, opt.y, opt.w, opt.h, opt.downsample, opt.format,
+                                  w, h, opt.out ? buf : pixels);
+        if (r && opt.out) {
+            r = opt.capacity >= buf.size();
+            if (r) memcpy(opt.out, buf.data(), buf.size());
+            else errorfln("snapshot buffer holds %zu bytes, %zu needed", opt.capacity, buf.size());
+        }
+        return r;
+    }
+    lockTraced(cache_lock, "wait cache_lock");
+    lockTraced(context_lock, "wait context_lock");
+    app->bindContext();
+    flushDrawers();
+    bool r = app->snapshot(opt, w, h, pixels);
+    app->unbindContext();
+    context_lock.unlock();
+    cache_lock.unlock();
+    return r;
+}
+void snapshotViews(const std::vector<Camera> & cams, std::vector<std::vector<unsigned char>> & pixels) {
+    trace::Scope t("snapshotViews");
+    if (!inProcess("snapshotViews")) { pixels.clear(); return; }
+    lockTraced(cache_lock, "wait cache_lock");
+    lockTraced(context_lock, "wait context_lock");
+    app->bindContext();
+    flushDrawers();
+    app->snapshotViews(cams, pixels);
+    app->unbindContext();
+    context_lock.unlock();
+    cache_lock.unlock();
+}
+void snapshotAOV(unsigned channels, SnapshotAOV & out) {
+    trace::Scope t("snapshotAOV");
+    if (!inProcess("snapshotAOV")) { out = SnapshotAOV(); return; }
+    lockTraced(cache_lock, "wait cache_lock");
+    lockTraced(context_lock, "wait context_lock");
+    app->bindContext();
+    flushDrawers();
+    app->snapshotAOV(channels, out);
+    app->unbindContext();
+    context_lock.unlock();
+    cache_lock.unlock();
+}
+bool snapshotTiled(const Camera & c, const StripWriter & write, int tileSize) {
+    trace::Scope t("snapshotTiled");
+    if (!inProcess("snapshotTiled")) return false;
+    lockTraced(cache_lock, "wait cache_lock");
+    lockTraced(context_lock, "wait context_lock");
+    app->bindContext();
+    flushDrawers();
+    bool r = app->snapshotTiled(c, tileSize, write);
+    app->unbindContext();
+    context_lock.unlock();
+    cache_lock.unlock();
+    return r;
+}
+bool snapshotTiled(const Camera & c, std::vector<unsigned char> & pixels, int tileSize) {
+    const int W = c.resolution.x, H = c.resolution.y;
+    pixels.resize((size_t)W * H * 4);
+    return snapshotTiled(c, [&](int top, int rows, const unsigned char * strip) {
+        for (int r = 0; r < rows; r++)
+            memcpy(&pixels[(size_t)(H - 1 - top - r) * W * 4], strip + (size_t)r * W * 4, (size_t)W * 4);
+        return true;
+    }, tileSize);
+}
+bool snapshotToPng(const std::string & path, const Camera & c, int tileSize) {
+    PngWriter png;
+    if (!png.open(path, c.resolution.x, c.resolution.y, 4)) return false;
+    bool ok = snapshotTiled(c, [&](int, int rows, const unsigned char * strip) {
+        return png.writeRows(strip, rows);
+    }, tileSize);
+    return png.close() && ok;
+}
+bool exportScene(const std::string & path) {
+    trace::Scope t("exportScene");
+    if (!inProcess("exportScene")) return false;
+    lockTraced(cache_lock, "wait cache_lock");
+    lockTraced(context_lock, "wait context_lock");
     app->bindContext();
     flushDrawers();
-    app->snapshot(w, h, pixels);
+    bool r = app->exportScene(path);
     app->unbindContext();
     context_lock.unlock();
     cache_lock.unlock();
+    return r;
+}
+void addPanel(const std::string & name, std::function<void()> show) {
+    if (!inProcess("addPanel")) return;
+    lockTraced(context_lock, "wait context_lock");
+    app->addPanel(name, std::move(show));
+    context_lock.unlock();
+}
+void setProfiling(bool on) {
+    if (!inProcess("setProfiling")) return;
+    lockTraced(context_lock, "wait context_lock");
+    app->setProfiling(on);
+    context_lock.unlock();
+}
+std::map<std::string, DrawerStats> drawerStats(void) {
+    if (client) return std::map<std::string, DrawerStats>();
+    lockTraced(context_lock, "wait context_lock");
+    std::map<std::string, DrawerStats> r = app->stats;
+    context_lock.unlock();
+    return r;
+}
+bool writeDrawerStats(const std::string & path) {
+    if (!inProcess("writeDrawerStats")) return false;
+    const bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    FILE * fp = fopen(path.c_str(), "w");
+    if (!fp) {
+        errorfln("threedbg: cannot open %s for writing", path.c_str());
+        return false;
+    }
+    // names are quoted, with quotes doubled for csv and escaped for json
+    auto quote = [&](const std::string & name) {
+        std::string q = "\"";
+        for (char c : name) {
+            if (c == '"') q += csv ? "\"\"" : "\\\"";
+            else if (c == '\\' && !csv) q += "\\\\";
+            else if ((unsigned char)c < 0x20 && !csv) q += ' ';
+            else q += c;
+        }
+        return q + "\"";
+    };
+    if (csv) fprintf(fp, "drawer,gpu_ms,cpu_ms,upload_gpu_ms,upload_cpu_ms,upload_bytes,draws\n");
+    else fprintf(fp, "[");
+    bool first = true;
+    for (auto & d : drawerStats()) {
+        const DrawerStats & s = d.second;
+        if (csv) {
+            fprintf(fp, "%s,%.4f,%.4f,%.4f,%.4f,%zu,%zu\n", quote(d.first).c_str(),
+                    s.gpuMs, s.cpuMs, s.uploadGpuMs, s.uploadCpuMs, s.uploadBytes, s.draws);
+        } else {
+            fprintf(fp, "%s\n  {\"drawer\": %s, \"gpu_ms\": %.4f, \"cpu_ms\": %.4f, \"upload_gpu_ms\": %.4f, "
+                    "\"upload_cpu_ms\": %.4f, \"upload_bytes\": %zu, \"draws\": %zu}", first ? "" : ",",
+                    quote(d.first).c_str(), s.gpuMs, s.cpuMs, s.uploadGpuMs, s.uploadCpuMs, s.uploadBytes, s.draws);
+        }
+        first = false;
+    }
+    if (!csv) fprintf(fp, "\n]\n");
+    return fclose(fp) == 0;
+}
+MemoryStats memoryStats(void) {
+    MemoryStats m;
+    if (!inProcess("memoryStats")) return m;
+    lockTraced(cache_lock, "wait cache_lock");
+    for (auto & f : drawerFactories) {
+        const size_t n = f.second->hostBytes();
+        m.drawers[f.first].hostBytes = n;
+        m.hostBytes += n;
+    }
+    lockTraced(context_lock, "wait context_lock");
+    app->memory(m);
+    context_lock.unlock();
+    cache_lock.unlock();
+    return m;
+}
+void setGpuBudget(size_t bytes, int policy) {
+    if (!inProcess("setGpuBudget")) return;
+    lockTraced(context_lock, "wait context_lock");
+    app->budget = bytes;
+    app->budgetPolicy = policy;
+    context_lock.unlock();
+}
+bool startCompositing(const std::string & address, int threads) {
+    if (!inProcess("startCompositing")) return false;
+    std::lock_guard<std::mutex> lk(composite_lock);
+    compositor = std::make_unique<Compositor>();
+    if (!compositor->connect(address, rank, ranks, 60000, threads)) compositor.reset(nullptr);
+    return compositor != nullptr;
+}
+bool compositeFrame(int & w, int & h, std::vector<unsigned char> & pixels) {
+    std::lock_guard<std::mutex> lk(composite_lock);
+    w = h = 0;
+    pixels.clear();
+    if (!compositor) return false;
+    lockTraced(context_lock, "wait context_lock");
+    Camera cam = app->cam;
+    context_lock.unlock();
+    bool ok = compositor->shareCamera(cam);
+    if (ok && !compositor->root()) {
+        lockTraced(context_lock, "wait context_lock");
+        app->cam = cam;
+        context_lock.unlock();
+    }
+    SnapshotAOV aov;
+    if (ok) snapshotAOV(AOV_COLOR | AOV_DEPTH, aov);
+    ok = ok && compositor->reduce(aov.w, aov.h, aov.color.data(), aov.depth.data());
+    if (!ok) {
+        compositor.reset(nullptr);
+        return false;
+    }
+    if (!compositor->root()) return true;
+    if (showGui) {
+        lockTraced(context_lock, "wait context_lock");
+        app->bindContext();
+        app->showComposite(aov.w, aov.h, aov.color.data());
+        app->unbindContext();
+        context_lock.unlock();
+    }
+    w = aov.w; h = aov.h;
+    pixels = std::move(aov.color);
+    return true;
+}
+void stopCompositing(void) {
+    std::lock_guard<std::mutex> lk(composite_lock);
+    compositor.reset(nullptr);
+}
+bool startCapture(const std::string & path, const CaptureOptions & opt) {
+    std::lock_guard<std::mutex> lk(capture_lock);
+    capture.reset(nullptr);
+    capture = std::make_unique<CaptureWriter>(path, opt);
+    if (!capture->good()) capture.reset(nullptr);
+    return capture != nullptr;
+}
+void stopCapture(void) {
+    std::lock_guard<std::mutex> lk(capture_lock);
+    capture.reset(nullptr);
+}
+bool startRecording(std::string dir, std::string format) {
+    std::lock_guard<std::mutex> lk(record_lock);
+    recorder.reset(nullptr);
+    recorder = std::make_unique<Recorder>(std::move(dir), std::move(format));
+    if (!recorder->good()) recorder.reset(nullptr);
+    return recorder != nullptr;
+}
+void recordFrame(void) {
+    std::lock_guard<std::mutex> lk(record_lock);
+    if (!recorder || !recorder->reserve()) return;
+    int w, h;
+    std::vector<unsigned char> buf = recorder->buffer();
+    if (client) {
+        client->snapshot(0, 0, 0, 0, 1, PIXEL_RGBA8, w, h, buf);
+    } else {
+        lockTraced(cache_lock, "wait cache_lock");
+        lockTraced(context_lock, "wait context_lock");
+        app->bindContext();
+        flushDrawers();
+        app->snapshot(w, h, buf);
+        app->unbindContext();
+        context_lock.unlock();
+        cache_lock.unlock();
+    }
+    recorder->push(w, h, std::move(buf));
+}
+Recorder::Stats recordingStats(void) {
+    std::lock_guard<std::mutex> lk(record_lock);
+    return recorder ? recorder->stats() : Recorder::Stats();
+}
+Recorder::Stats stopRecording(void) {
+    std::lock_guard<std::mutex> lk(record_lock);
+    if (!recorder) return Recorder::Stats();
+    Recorder::Stats st = recorder->finish();
+    recorder.reset(nullptr);
+    return st;
+}
+void setMultisample(int samples) {
+    if (client) {
+        client->setMultisample(samples);
+        return;
+    }
+    lockTraced(context_lock, "wait context_lock");
+    app->bindContext();
+    app->setSamples(samples);
+    app->unbindContext();
+    context_lock.unlock();
 }
 Camera & camera() {
-    return app->cam;
+    return client ? client->cam : app->cam;
 }
 std::vector<std::string> getInvisible() {
-    return app->getInvisible();
+    return client ? client->invisible : app->getInvisible();
 }
 void setInvisible(std::vector<std::string> tl) {
-    app->setInvisible(std::move(tl));
+    if (client) client->setInvisible(tl);
+    else app->setInvisible(std::move(tl));
 }
 }
\ No newline at end of file
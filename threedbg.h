@@ -1,19 +1,138 @@
 #pragma once
 
+#include <map>
 #include <memory>
 #include <vector>
+#include <functional>
 #include "drawer.h"
 #include "points.h"
 #include "lines.h"
+#include "recorder.h"
+#include "capture.h"
+#include "scopes.h"
+#include "plots.h"
 
 namespace threedbg {
+enum { AOV_COLOR = 1, AOV_DEPTH = 2, AOV_DRAWER_ID = 4, AOV_PRIMITIVE_ID = 8 };
+// per-pixel outputs of one render pass, rows bottom-up like snapshot()
+struct SnapshotAOV {
+    int w = 0, h = 0;
+    std::vector<unsigned char> color; // rgba
+    std::vector<float> depth;         // view space depth, inf for background
+    std::vector<unsigned> drawerId;   // 0 for background, else drawers[id - 1]
+    std::vector<unsigned> primitiveId;// point or line index inside the drawer
+    std::vector<std::string> drawers;
+};
+enum { PIXEL_RGBA8, PIXEL_RGB8, PIXEL_BGRA8, PIXEL_R8 };
+struct SnapshotOptions {
+    int x = 0, y = 0, w = 0, h = 0; // region from the bottom-left, 0 size extends to the edge
+    int downsample = 1;             // box filter factor, applied on the gpu
+    int format = PIXEL_RGBA8;       // PIXEL_R8 holds luminance
+    unsigned char * out = nullptr;  // optional caller buffer instead of `pixels`
+    size_t capacity = 0;            // bytes available at out
+};
+struct DrawerStats {
+    double gpuMs = 0, cpuMs = 0;             // per draw, averaged over recent frames
+    double uploadGpuMs = 0, uploadCpuMs = 0; // createDrawer of the current drawer
+    size_t uploadBytes = 0;
+    size_t draws = 0;                        // timed draws since profiling began
+};
+struct DrawerMemory {
+    size_t hostBytes = 0; // of its factory while it waits for the upload
+    size_t gpuBytes = 0;
+};
+struct MemoryStats {
+    size_t hostBytes = 0;        // factories not uploaded yet
+    size_t gpuBytes = 0;         // drawers
+    size_t framebufferBytes = 0; // render targets and textures of the viewer
+    size_t gpuBudget = 0;
+    std::map<std::string, DrawerMemory> drawers;
+};
+enum { BUDGET_WARN, BUDGET_REFUSE, BUDGET_DOWNSAMPLE };
+// receives full-width rgba strips, top-down rows, starting at image row `top`
+typedef std::function<bool(int top, int rows, const unsigned char * rgba)> StripWriter;
 extern bool showGui;
+// address of a threedbg-viewer process to render in (see remote.h), empty
+// renders in this process. defaults to $THREEDBG_VIEWER, read before init().
+// snapshotViews/AOV/Tiled, panels and profiling need the in-process viewer
+extern std::string viewer;
+// drawer stats are written here (.csv or .json) by free(), and profiling is
+// on from init(). defaults to $THREEDBG_PROFILE
+extern std::string profile;
+// a trace of lock waits, uploads, draws, snapshots and barrier stalls is
+// written here by free() (see trace.h). defaults to $THREEDBG_TRACE
+extern std::string traceFile;
+// "[host:]port" to watch in a browser (see stream.h), localhost unless a host
+// is given. the view is then rendered continuously, also without showGui, and
+// the browser's mouse moves the camera. defaults to $THREEDBG_STREAM
+extern std::string stream;
+// processes sharing one viewer, e.g. mpi ranks, each pass their rank and the
+// rank count. drawers then show up as "rank<r>/<name>" and the viewer steps
+// once all ranks are in working(). default to $THREEDBG_RANK/$THREEDBG_RANKS,
+// else the rank variables of Open MPI, MPICH/PMI or Slurm; -1 for no rank
+extern int rank, ranks;
 void init(void);
+// waits until the window is closed, force closes it. without showGui there
+// is no window to wait for
 void free(bool force = false);
 void addDrawerFactory(std::string name, std::unique_ptr<DrawerFactory> && df);
 bool working(void);
 void snapshot(int & w, int & h, std::vector<unsigned char> & pixels);
+// reads back only the region/size/format asked for, w and h are the output size
+bool snapshot(const SnapshotOptions & opt, int & w, int & h, std::vector<unsigned char> & pixels);
+// renders every camera in one go, pixels[i] is cams[i].resolution sized rgba
+void snapshotViews(const std::vector<Camera> & cams, std::vector<std::vector<unsigned char>> & pixels);
+// reads back any subset of the AOV_* channels from a single render
+void snapshotAOV(unsigned channels, SnapshotAOV & out);
+// tiled rendering for images beyond the framebuffer limits, gpu memory only
+// depends on tileSize. the vector version returns bottom-up rows like snapshot()
+bool snapshotTiled(const Camera & c, const StripWriter & write, int tileSize = 1024);
+bool snapshotTiled(const Camera & c, std::vector<unsigned char> & pixels, int tileSize = 1024);
+bool snapshotToPng(const std::string & path, const Camera & c, int tileSize = 1024);
+// writes the drawers' points and lines to .ply, .glb or .gltf (see
+// scene_io.h), read back from the gpu in chunks
+bool exportScene(const std::string & path);
+// msaa sample count of the render target (1 = off), resolved on the gpu
+// before display and readback. AOV snapshots always render single sampled
+void setMultisample(int samples);
 Camera & camera();
 std::vector<std::string> getInvisible();
 void setInvisible(std::vector<std::string> tl);
+// extra imgui window drawn by the display thread every frame, an empty
+// function removes it. `show` runs with the context held and must not call
+// other threedbg functions
+void addPanel(const std::string & name, std::function<void()> show);
+// times each drawer's draws and uploads on the cpu and with gpu timer
+// queries. the queries are read a few frames later, once their results are
+// in, so the numbers lag a little but the pipeline never waits for them
+void setProfiling(bool on);
+std::map<std::string, DrawerStats> drawerStats(void);
+// .csv, or .json for any other extension
+bool writeDrawerStats(const std::string & path);
+MemoryStats memoryStats(void);
+// limit for drawers and framebuffers together, 0 for none. an upload that
+// would go past it warns, is refused (the drawer keeps its old contents) or
+// keeps only every n-th point or line so it fits; other drawer types are
+// refused then
+void setGpuBudget(size_t bytes, int policy = BUDGET_WARN);
+// sort-last rendering for scenes too big for one process: every rank renders
+// its own drawers with rank 0's camera and the color/depth images are merged
+// over `address` (see composite.h), using the rank and ranks above. all ranks
+// call compositeFrame() together; rank 0 gets the image in w, h and pixels
+// (rgba, bottom-up) and shows it in the "composite" window. threads as in
+// Compositor::connect
+bool startCompositing(const std::string & address, int threads = -1);
+bool compositeFrame(int & w, int & h, std::vector<unsigned char> & pixels);
+void stopCompositing(void);
+// logs every factory passed to addDrawerFactory, and the camera and
+// visibility at each working() call, into a capture file (see capture.h)
+bool startCapture(const std::string & path, const CaptureOptions & opt = CaptureOptions());
+void stopCapture(void);
+// background recording of snapshots, see Recorder for the formats.
+// while recording every snapshot() is queued as well, recordFrame() takes a
+// snapshot only for the recorder and skips the readback if the queue is full
+bool startRecording(std::string dir, std::string format = "png");
+void recordFrame(void);
+Recorder::Stats recordingStats(void);
+Recorder::Stats stopRecording(void);
 }
@@ -0,0 +1,293 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace trace {
+
+std::atomic<bool> enabled{ false };
+
+struct Event {
+    const char * name, * category;
+    uint64_t begin, end;
+};
+
+// events of one thread in a chain of blocks. only the owner appends, readers
+// see a block's events up to its published count
+struct Block {
+    static const size_t N = 4096;
+    Event events[N];
+    std::atomic<size_t> count{ 0 };
+    std::atomic<Block *> next{ nullptr };
+};
+
+struct ThreadBuffer {
+    int tid;
+    std::string name; // under registry_lock
+    Block head;
+    Block * tail = &head;
+    size_t blocks = 1;
+    std::atomic<size_t> dropped{ 0 };
+    ~ThreadBuffer() {
+        for (Block * b = head.next.load(); b;) {
+            Block * n = b->next.load();
+            delete b;
+            b = n;
+        }
+    }
+};
+
+// 32 MiB a thread, later events are counted and dropped
+static const size_t MAX_BLOCKS = 256;
+
+static std::mutex registry_lock;
+static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+static std::unordered_set<std::string> names;
+static const auto epoch = std::chrono::steady_clock::now();
+
+static ThreadBuffer & local() {
+    // buffers outlive their threads, the registry owns them
+    static thread_local ThreadBuffer * buf = nullptr;
+    if (!buf) {
+        std::lock_guard<std::mutex> lk(registry_lock);
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        buf = buffers.back().get();
+        buf->tid = (int)buffers.size();
+    }
+    return *buf;
+}
+
+void start(void) {
+    enabled.store(true);
+}
+
+void stop(void) {
+    enabled.store(false);
+}
+
+void nameThread(const std::string & name) {
+    ThreadBuffer & b = local();
+    std::lock_guard<std::mutex> lk(registry_lock);
+    b.name = name;
+}
+
+const char * intern(const std::string & name) {
+    std::lock_guard<std::mutex> lk(registry_lock);
+    return names.insert(name).first->c_str();
+}
+
+uint64_t now(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void record(const char * name, const char * category, uint64_t begin, uint64_t end) {
+    ThreadBuffer & b = local();
+    Block * t = b.tail;
+    size_t n = t->count.load(std::memory_order_relaxed);
+    if (n == Block::N) {
+        if (b.blocks == MAX_BLOCKS) {
+            b.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Block * fresh = new Block();
+        t->next.store(fresh, std::memory_order_release);
+        b.tail = t = fresh;
+        b.blocks++;
+        n = 0;
+    }
+    t->events[n] = Event{ name, category, begin, end };
+    t->count.store(n + 1, std::memory_order_release);
+}
+
+struct Snapshot {
+    int tid;
+    std::string name;
+    std::vector<Event> events;
+};
+
+// what the threads have published so far, each sorted by start with
+// enclosing spans first
+static std::vector<Snapshot> collect(size_t & dropped) {
+    std::vector<Snapshot> r;
+    std::lock_guard<std::mutex> lk(registry_lock);
+    dropped = 0;
+    for (auto & b : buffers) {
+        Snapshot s;
+        s.tid = b->tid;
+        s.name = b->name.empty() ? "thread " + std::to_string(b->tid) : b->name;
+        for (const Block * k = &b->head; k; k = k->next.load(std::memory_order_acquire)) {
+            const size_t n = k->count.load(std::memory_order_acquire);
+            s.events.insert(s.events.end(), k->events, k->events + n);
+        }
+        std::sort(s.events.begin(), s.events.end(), [](const Event & a, const Event & b) {
+            return a.begin != b.begin ? a.begin < b.begin : a.end > b.end;
+        });
+        dropped += b->dropped.load();
+        r.push_back(std::move(s));
+    }
+    return r;
+}
+
+static void putJsonString(std::string & out, const char * s) {
+    out += '"';
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') { out += '\\'; out += *s; }
+        else if ((unsigned char)*s < 0x20) out += ' ';
+        else out += *s;
+    }
+    out += '"';
+}
+
+static bool writeJson(FILE * fp, const std::vector<Snapshot> & threads) {
+    const int pid = (int)getpid();
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    char buf[128];
+    for (auto & t : threads) {
+        snprintf(buf, sizeof(buf), "%s{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":",
+                 first ? "" : ",\n", pid, t.tid);
+        out += buf;
+        putJsonString(out, t.name.c_str());
+        out += "}}";
+        first = false;
+        for (auto & e : t.events) {
+            out += ",\n{\"ph\":\"X\",\"name\":";
+            putJsonString(out, e.name);
+            out += ",\"cat\":";
+            putJsonString(out, e.category);
+            snprintf(buf, sizeof(buf), ",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                     pid, t.tid, e.begin * 1e-3, (e.end - e.begin) * 1e-3);
+            out += buf;
+            if (out.size() > (1 << 20)) {
+                if (fwrite(out.data(), 1, out.size(), fp) != out.size()) return false;
+                out.clear();
+            }
+        }
+    }
+    out += "\n]}\n";
+    return fwrite(out.data(), 1, out.size(), fp) == out.size();
+}
+
+// the few protobuf pieces perfetto's trace format needs
+static void putVarint(std::string & out, uint64_t v) {
+    while (v >= 0x80) {
+        out += (char)(v | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+static void putField(std::string & out, int field, uint64_t v) {
+    putVarint(out, (uint64_t)field << 3);
+    putVarint(out, v);
+}
+
+static void putField(std::string & out, int field, const std::string & bytes) {
+    putVarint(out, (uint64_t)field << 3 | 2);
+    putVarint(out, bytes.size());
+    out += bytes;
+}
+
+// fields of perfetto.protos.TracePacket and what it carries
+enum {
+    TRACE_PACKET = 1,
+    PACKET_TIMESTAMP = 8, PACKET_SEQUENCE_ID = 10, PACKET_TRACK_EVENT = 11,
+    PACKET_SEQUENCE_FLAGS = 13, PACKET_TRACK_DESCRIPTOR = 60,
+    TRACK_UUID = 1, TRACK_NAME = 2, TRACK_PROCESS = 3, TRACK_THREAD = 4, TRACK_PARENT = 5,
+    PROCESS_PID = 1, PROCESS_NAME = 6,
+    THREAD_PID = 1, THREAD_TID = 2, THREAD_NAME = 5,
+    EVENT_TYPE = 9, EVENT_TRACK = 11, EVENT_CATEGORIES = 22, EVENT_NAME = 23,
+    SLICE_BEGIN = 1, SLICE_END = 2,
+    SEQ_INCREMENTAL_STATE_CLEARED = 1,
+};
+
+static bool writePerfetto(FILE * fp, const std::vector<Snapshot> & threads) {
+    const int pid = (int)getpid();
+    const uint64_t processTrack = 1;
+    std::string out, packet, msg, inner;
+    auto emit = [&](std::string & p) {
+        putField(p, PACKET_SEQUENCE_ID, 1);
+        putField(out, TRACE_PACKET, p);
+        p.clear();
+    };
+    putField(inner, PROCESS_PID, pid);
+    putField(inner, PROCESS_NAME, std::string("threedbg"));
+    putField(msg, TRACK_UUID, processTrack);
+    putField(msg, TRACK_PROCESS, inner);
+    putField(packet, PACKET_TRACK_DESCRIPTOR, msg);
+    putField(packet, PACKET_SEQUENCE_FLAGS, SEQ_INCREMENTAL_STATE_CLEARED);
+    emit(packet);
+    for (auto & t : threads) {
+        const uint64_t track = processTrack + t.tid;
+        inner.clear(); msg.clear();
+        putField(inner, THREAD_PID, pid);
+        putField(inner, THREAD_TID, t.tid);
+        putField(inner, THREAD_NAME, t.name);
+        putField(msg, TRACK_UUID, track);
+        putField(msg, TRACK_PARENT, processTrack);
+        putField(msg, TRACK_THREAD, inner);
+        putField(packet, PACKET_TRACK_DESCRIPTOR, msg);
+        emit(packet);
+        // spans become begin/end pairs, closed in nesting order
+        std::vector<const Event *> open;
+        auto slice = [&](int type, uint64_t ts, const Event * e) {
+            msg.clear();
+            putField(msg, EVENT_TYPE, type);
+            putField(msg, EVENT_TRACK, track);
+            if (e) {
+                putField(msg, EVENT_CATEGORIES, std::string(e->category));
+                putField(msg, EVENT_NAME, std::string(e->name));
+            }
+            putField(packet, PACKET_TIMESTAMP, ts);
+            putField(packet, PACKET_TRACK_EVENT, msg);
+            emit(packet);
+        };
+        for (size_t i = 0; i <= t.events.size(); i++) {
+            const Event * e = i < t.events.size() ? &t.events[i] : nullptr;
+            while (!open.empty() && (!e || open.back()->end <= e->begin)) {
+                slice(SLICE_END, open.back()->end, nullptr);
+                open.pop_back();
+            }
+            if (!e) break;
+            slice(SLICE_BEGIN, e->begin, e);
+            open.push_back(e);
+            if (out.size() > (1 << 20)) {
+                if (fwrite(out.data(), 1, out.size(), fp) != out.size()) return false;
+                out.clear();
+            }
+        }
+    }
+    return fwrite(out.data(), 1, out.size(), fp) == out.size();
+}
+
+bool write(const std::string & path) {
+    size_t dropped;
+    std::vector<Snapshot> threads = collect(dropped);
+    if (dropped) fprintf(stderr, "trace: buffers were full, %zu events dropped\n", dropped);
+    FILE * fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        fprintf(stderr, "trace: cannot open %s for writing\n", path.c_str());
+        return false;
+    }
+    auto endsWith = [&](const char * e) {
+        const size_t n = strlen(e);
+        return path.size() >= n && path.compare(path.size() - n, n, e) == 0;
+    };
+    bool ok = endsWith(".pftrace") || endsWith(".perfetto-trace") ? writePerfetto(fp, threads) : writeJson(fp, threads);
+    return fclose(fp) == 0 && ok;
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// timeline of what the threads spend their time on, written for
+// chrome://tracing or ui.perfetto.dev. each thread records spans into its own
+// buffer without locks; the writer reads them while recording goes on. with
+// tracing off a span costs one relaxed load.
+//
+//   trace::start();
+//   { trace::Scope s("step", "sim"); ... }
+//   trace::write("run.json"); // or run.pftrace for perfetto's protobuf
+namespace trace {
+
+extern std::atomic<bool> enabled;
+
+void start(void);
+void stop(void);
+// everything recorded since the program began, chrome json or perfetto
+// protobuf for .pftrace/.perfetto-trace
+bool write(const std::string & path);
+// shown instead of the thread number
+void nameThread(const std::string & name);
+// a stable copy of a name built at run time, takes a lock
+const char * intern(const std::string & name);
+
+// nanoseconds, steady clock
+uint64_t now(void);
+// name and category are not copied, they have to live as long as the program
+void record(const char * name, const char * category, uint64_t begin, uint64_t end);
+
+class Scope {
+    const char * name, * category;
+    uint64_t begin;
+public:
+    Scope(const char * name, const char * category = "threedbg")
+        : name(enabled.load(std::memory_order_relaxed) ? name : nullptr), category(category),
+          begin(this->name ? now() : 0) {}
+    ~Scope() {
+        if (name) record(name, category, begin, now());
+    }
+    Scope(const Scope &) = delete;
+    Scope & operator=(const Scope &) = delete;
+};
+
+}
@@ -0,0 +1,310 @@
+#include "threedbg.h"
+#include "loader.h"
+#include "remote.h"
+#include "taskpool.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+#include <poll.h>
+#include <map>
+#include <set>
+#include <string>
+
+// renders for simulations running in other processes. they connect when
+// threedbg::viewer or THREEDBG_VIEWER holds the same address, and use the
+// usual api; the scene of the last clients stays up until the next connect.
+// any number of clients may connect, ranked ones are stepped together and
+// what they submit during a step is shown once all of them finished it.
+// point files given on the command line are shown alongside.
+
+using namespace remote;
+
+struct Client {
+    std::unique_ptr<SocketTransport> socket;
+    std::unique_ptr<Transport> shm;
+    Transport * t;
+    int rank = -1;
+    std::string prefix; // "rank<r>/" for ranked clients
+    bool stepping = false;
+    // factories of the step in progress, published together in Server::step()
+    std::map<std::string, std::unique_ptr<DrawerFactory>> pending;
+    size_t retained = 0; // ring bytes held by them
+};
+
+// sets the culling box on the drawer of the wrapped factory
+struct BoundedFactory : DrawerFactory {
+    std::unique_ptr<DrawerFactory> inner;
+    glm::fvec3 lo, hi;
+    virtual Drawer * createDrawer() override {
+        Drawer * d = inner->createDrawer();
+        if (d) { d->lo = lo; d->hi = hi; }
+        return d;
+    }
+    virtual bool view(FactoryView & v) const override { return inner->view(v); }
+};
+
+class Server {
+public:
+    bool open = true;
+    void add(std::unique_ptr<SocketTransport> s);
+    // serves whatever is waiting, steps the scene when all clients are in
+    void update(int timeoutMs, SocketListener & listener);
+    bool empty() const { return clients.empty(); }
+private:
+    enum { KEEP, DROP, QUIT };
+    std::vector<std::unique_ptr<Client>> clients;
+    std::set<int> seen;  // ranks connected since the group formed
+    int ranks = 0;       // expected ranks, from the hellos
+    std::vector<unsigned char> pixels;
+    TaskPool pool;
+
+    int handle(Client & c, uint32_t type, const unsigned char * data, size_t size);
+    void publish(Client & c);
+    void putState(ScatterBuffer & b, const Client & c, bool alive);
+    void step();
+    bool bounds(const FactoryView & v, glm::fvec3 & lo, glm::fvec3 & hi);
+};
+
+void Server::add(std::unique_ptr<SocketTransport> s) {
+    std::unique_ptr<Client> c = std::make_unique<Client>();
+    c->t = s.get();
+    c->socket = std::move(s);
+    clients.push_back(std::move(c));
+}
+
+// a drawer belongs to a ranked client by its prefix, unranked clients share
+// all names without a rank prefix
+static bool owns(const Client & c, const std::string & name) {
+    if (!c.prefix.empty()) return name.compare(0, c.prefix.size(), c.prefix) == 0;
+    size_t i = 4;
+    if (name.compare(0, 4, "rank") != 0) return true;
+    while (i < name.size() && isdigit((unsigned char)name[i])) i++;
+    return i == 4 || i == name.size() || name[i] != '/';
+}
+
+void Server::putState(ScatterBuffer & b, const Client & c, bool alive) {
+    b.put((uint8_t)alive);
+    putCamera(b, threedbg::camera());
+    std::vector<std::string> mine;
+    for (auto & n : threedbg::getInvisible())
+        if (owns(c, n)) mine.push_back(n.substr(c.prefix.size()));
+    putStrings(b, mine);
+}
+
+// box around the positions (stream 0) of points and lines, so ranks whose
+// subdomain is out of view are not drawn
+bool Server::bounds(const FactoryView & v, glm::fvec3 & lo, glm::fvec3 & hi) {
+    if ((v.type != "points" && v.type != "lines") || v.streams.empty()) return false;
+    const glm::fvec3 * p = (const glm::fvec3 *)v.streams[0].data;
+    const size_t n = v.streams[0].bytes / sizeof(glm::fvec3), chunk = 1 << 18;
+    if (!n) return false;
+    const size_t chunks = (n + chunk - 1) / chunk;
+    std::vector<glm::fvec3> clo(chunks, glm::fvec3(INFINITY)), chi(chunks, glm::fvec3(-INFINITY));
+    pool.parallelFor(chunks, [&](size_t c) {
+        for (size_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++) {
+            clo[c] = glm::min(clo[c], p[i]);
+            chi[c] = glm::max(chi[c], p[i]);
+        }
+    });
+    lo = clo[0]; hi = chi[0];
+    for (size_t c = 1; c < chunks; c++) {
+        lo = glm::min(lo, clo[c]);
+        hi = glm::max(hi, chi[c]);
+    }
+    if (v.type == "points" && !v.params.empty()) {
+        lo -= glm::fvec3(v.params[0]);
+        hi += glm::fvec3(v.params[0]);
+    }
+    // nan or inf positions would cull wrongly
+    return std::isfinite(lo.x + lo.y + lo.z + hi.x + hi.y + hi.z);
+}
+
+int Server::handle(Client & c, uint32_t type, const unsigned char * data, size_t size) {
+    ByteReader r(data, size);
+    ScatterBuffer b;
+    switch (type) {
+    case MSG_SHM:
+        // the client moves to a shared ring, only the socket accepts this
+        if (c.shm) return DROP;
+        c.shm = ShmTransport::accept(std::move(c.socket), data, size);
+        if (!c.shm) return DROP;
+        c.t = c.shm.get();
+        break;
+    case MSG_HELLO: {
+        uint32_t version = r.get<uint32_t>();
+        c.rank = r.get<int32_t>();
+        int n = r.get<int32_t>();
+        if (version != VERSION || !r.ok) {
+            fprintf(stderr, "viewer: client speaks protocol %u, expected %u\n", version, VERSION);
+            return DROP;
+        }
+        if (c.rank >= 0) {
+            c.prefix = "rank" + std::to_string(c.rank) + "/";
+            if (seen.count(c.rank)) fprintf(stderr, "viewer: rank %d connected twice\n", c.rank);
+            seen.insert(c.rank);
+            ranks = std::max(ranks, n);
+        }
+        printf("viewer: client connected%s\n", c.prefix.empty() ? "" : (", " + c.prefix).c_str());
+        putState(b, c, true);
+        c.t->send(type, b);
+        break;
+    }
+    case MSG_FACTORY: {
+        std::string name;
+        FactoryView v;
+        if (!getFactory(r, name, v)) {
+            fprintf(stderr, "viewer: damaged factory message\n");
+            return DROP;
+        }
+        // with a shared ring the drawer is uploaded from it in place. the ring
+        // stops at a retained message until it is uploaded after the step,
+        // so beyond a quarter of it the factories are copied instead
+        std::shared_ptr<void> keep;
+        if (c.retained + size <= c.t->capacity() / 4 && (keep = c.t->retain())) c.retained += size;
+        std::unique_ptr<DrawerFactory> df = wrapFactory(v, std::move(keep));
+        if (!df) break;
+        std::unique_ptr<BoundedFactory> bf = std::make_unique<BoundedFactory>();
+        if (bounds(v, bf->lo, bf->hi)) {
+            bf->inner = std::move(df);
+            df = std::move(bf);
+        }
+        c.pending[c.prefix + name] = std::move(df);
+        break;
+    }
+    case MSG_STEP:
+        c.stepping = true; // answered in step()
+        break;
+    case MSG_SNAPSHOT: {
+        publish(c); // the client expects to see what it submitted
+        threedbg::SnapshotOptions opt;
+        opt.x = r.get<int32_t>(); opt.y = r.get<int32_t>();
+        opt.w = r.get<int32_t>(); opt.h = r.get<int32_t>();
+        opt.downsample = r.get<int32_t>();
+        opt.format = r.get<int32_t>();
+        int w = 0, h = 0;
+        bool done = r.ok && threedbg::snapshot(opt, w, h, pixels);
+        b.put((int32_t)w); b.put((int32_t)h);
+        b.put((uint8_t)done);
+        b.align(16);
+        if (done) b.ref(pixels.data(), pixels.size());
+        c.t->send(type, b);
+        break;
+    }
+    case MSG_SET_CAMERA: {
+        Camera cam = getCamera(r);
+        if (r.ok) threedbg::camera() = cam;
+        break;
+    }
+    case MSG_SET_INVISIBLE: {
+        // replaces this client's part of the list only
+        std::set<std::string> inv;
+        for (auto & n : threedbg::getInvisible())
+            if (!owns(c, n)) inv.insert(n);
+        for (auto & n : getStrings(r)) inv.insert(c.prefix + n);
+        threedbg::setInvisible(std::vector<std::string>(inv.begin(), inv.end()));
+        break;
+    }
+    case MSG_MULTISAMPLE:
+        threedbg::setMultisample(r.get<int32_t>());
+        break;
+    case MSG_BYE:
+        return r.get<uint8_t>() ? QUIT : DROP;
+    default:
+        fprintf(stderr, "viewer: unknown message %u\n", type);
+        return DROP;
+    }
+    return KEEP;
+}
+
+void Server::publish(Client & c) {
+    for (auto & p : c.pending) threedbg::addDrawerFactory(p.first, std::move(p.second));
+    c.pending.clear();
+    c.retained = 0;
+}
+
+// one working() for the whole group, once every client waits in its own and
+// all expected ranks have shown up
+void Server::step() {
+    if (clients.empty() || (int)seen.size() < ranks) return;
+    for (auto & c : clients)
+        if (!c->stepping) return;
+    for (auto & c : clients) publish(*c);
+    open = threedbg::working();
+    for (auto & c : clients) {
+        ScatterBuffer b;
+        putState(b, *c, open);
+        c->t->send(MSG_STEP, b);
+        c->stepping = false;
+    }
+}
+
+void Server::update(int timeoutMs, SocketListener & listener) {
+    std::vector<pollfd> fds(1, pollfd{ listener.handle(), POLLIN, 0 });
+    for (auto & c : clients) fds.push_back(pollfd{ c->t->handle(), POLLIN, 0 });
+    poll(fds.data(), fds.size(), timeoutMs);
+    if (fds[0].revents) {
+        std::unique_ptr<SocketTransport> s = listener.accept(0);
+        if (s) add(std::move(s));
+    }
+    for (size_t i = 0; i < clients.size();) {
+        Client & c = *clients[i];
+        int r = KEEP;
+        uint32_t type;
+        const unsigned char * data;
+        size_t size;
+        // a stepping client sends nothing until answered, except from other threads
+        while (r == KEEP && c.t->ready())
+            r = c.t->receive(type, data, size) ? handle(c, type, data, size) : DROP;
+        if (r == QUIT) open = false;
+        if (r == KEEP) {
+            i++;
+            continue;
+        }
+        printf("viewer: client disconnected%s\n", c.prefix.empty() ? "" : (", " + c.prefix).c_str());
+        publish(c); // its last scene stays up
+        clients.erase(clients.begin() + i);
+        if (clients.empty()) { // the next run forms a new group
+            seen.clear();
+            ranks = 0;
+        }
+    }
+    if (open) step();
+}
+
+int main(int argc, char ** argv) {
+    std::string address = "unix:/tmp/threedbg.sock";
+    std::vector<std::string> files;
+    bool usage = false;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a.empty() || a[0] == '-') usage = true;
+        else if (a.compare(0, 5, "unix:") == 0 || a.compare(0, 4, "tcp:") == 0) address = a;
+        else files.push_back(a);
+    }
+    if (usage) {
+        fprintf(stderr, "usage: threedbg-viewer [unix:/path | tcp:host:port] [point files..]\n"
+                        "clients reach a unix socket viewer with shm:/path as well.\n"
+                        "files are .ply, .xyz/.csv/.txt or raw float32 xyz\n");
+        return 1;
+    }
+    SocketListener listener;
+    if (!listener.listen(address)) return 1;
+    printf("viewer: listening on %s\n", address.c_str());
+    threedbg::viewer.clear(); // render here, even with THREEDBG_VIEWER set
+    threedbg::showGui = true;
+    threedbg::init();
+    for (auto & f : files) {
+        std::unique_ptr<DrawerFactory> df = loadPointFile(f);
+        if (!df) continue;
+        threedbg::addDrawerFactory(f.substr(f.find_last_of("/\\") + 1), std::move(df));
+    }
+    Server server;
+    while (server.open) {
+        server.update(100, listener);
+        // without clients nothing calls working(), which notices a closed window
+        if (server.empty()) server.open = threedbg::working();
+    }
+    listener.close();
+    threedbg::free(true);
+}